@@ -1,5 +1,5 @@
 #pragma once
-#include "Object3D.h"
+#include "SceneGraph.h"
 
 /**
 * @brief Represents an abstract animation of an object, manipulating one or more of its
@@ -10,7 +10,8 @@ class Animation {
 private:
 	float_t m_duration;
 	float_t m_currentTime;
-	Object3D& m_object;
+	SceneGraph& m_scene;
+	SceneHandle m_object;
 
 	/**
 	 * @brief Called when the animation is activated by an Animator.
@@ -23,7 +24,7 @@ private:
 	virtual void applyAnimation(float_t dt) = 0;
 
 public:
-	Animation(Object3D& obj, float_t duration) : m_object(obj), m_duration(duration),
+	Animation(SceneGraph& scene, SceneHandle obj, float_t duration) : m_scene(scene), m_object(obj), m_duration(duration),
 		m_currentTime(-1) {
 	}
 
@@ -38,9 +39,14 @@ public:
 	float_t currentTime() const { return m_currentTime; }
 
 	/**
-	* @brief The object the animation is manipulating.
+	* @brief The object the animation is manipulating, looked up through its scene handle.
 	*/
-	Object3D& object() const { return m_object; }
+	Object3D& object() const { return m_scene.get(m_object); }
+
+	/**
+	* @brief The scene the animated object lives in.
+	*/
+	SceneGraph& scene() const { return m_scene; }
 
 	/**
 	* @brief Advances the animation by the given interval, in seconds.
@@ -4,6 +4,7 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <filesystem>
+#include <unordered_map>
 
 Mesh3D fromAssimpMesh(const aiMesh* mesh, const std::vector<Map> maps) 
 {	
@@ -103,36 +104,48 @@ Object3D assimpLoad(const std::string& path, bool flipTextureCoords, bool genNor
 			}
 		}
 		auto obj = Object3D(std::make_shared<Mesh3D>(fromAssimpMesh(scene->mMeshes[i], maps)), baseTransform);
-		meshes.push_back(obj);
+		meshes.push_back(std::move(obj));
 	}
 	for (int i = 1; i < meshes.size(); i++)
 	{
 		meshes[0].addChild(std::move(meshes[i]));
 	}
-	return meshes[0];
+	return std::move(meshes[0]);
 }
 
 std::vector<Map> loadLightingMaps(aiMaterial* mat, aiTextureType type, std::string typeName, const std::string path)
 {
+	//Textures already loaded, by file path, so models loaded more than once share their textures (and can be batched together)
+	static std::unordered_map<std::string, Map> loadedMaps;
+
 	std::vector<Map> maps;
 	for (uint32_t i = 0; i < mat->GetTextureCount(type); i++)
 	{
 		aiString str;
 		mat->Get(AI_MATKEY_NAME, str);
 		mat->GetTexture(type, i, &str);
-		Map map;
-		uint32_t ID;
-		glGenTextures(1, &ID);
 
 		// Locate and load the texture image into RAM.
 		std::filesystem::path modelPath = path;
 		std::filesystem::path texPath = modelPath.parent_path() / str.C_Str();
 
+		auto loaded = loadedMaps.find(texPath.string());
+		if (loaded != loadedMaps.end())
+		{
+			maps.push_back(loaded->second);
+			continue;
+		}
+
+		Map map;
+		uint32_t ID;
+		glGenTextures(1, &ID);
+
 		map.id = ID;
 		map.path = texPath.string();
 		map.type = typeName;
 		map.texture = IMG_Load(texPath.string().c_str());
 		maps.push_back(map);
+		loadedMaps[map.path] = map;
 	}
 	return maps;
 }
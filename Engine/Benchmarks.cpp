@@ -0,0 +1,412 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <glm/ext.hpp>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "Benchmarks.h"
+#include "TransformSystem.h"
+#include "Components.h"
+#include "OcclusionBuffer.h"
+#include "ClusterGrid.h"
+#include "VirtualPageTable.h"
+
+//Best of several runs, in milliseconds
+template <typename F>
+static double timeBest(F&& run, int repeats = 10)
+{
+	double best = 1e30;
+	for (int i = 0; i < repeats; i++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		run();
+		auto end = std::chrono::high_resolution_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	return best;
+}
+
+static float randomRange(float range)
+{
+	return (rand() / static_cast<float>(RAND_MAX) * 2.0f - 1.0f) * range;
+}
+
+void benchmarkTransforms()
+{
+	std::cout << "Transform rebuild, " << TransformSystem::BatchSize << " transforms per SIMD batch" << std::endl;
+	for (uint32_t count : { 1000u, 10000u, 100000u })
+	{
+		TransformSystem system;
+		std::vector<TransformHandle> handles;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			TransformHandle handle = system.create(glm::mat4(1));
+			system.setPosition(handle, glm::vec3(randomRange(50), randomRange(50), randomRange(50)));
+			system.setOrientation(handle, glm::vec3(randomRange(3.14f), randomRange(3.14f), randomRange(3.14f)));
+			system.setScale(handle, glm::vec3(1.0f + randomRange(0.5f)));
+			system.setCenter(handle, glm::vec3(randomRange(1), randomRange(1), randomRange(1)));
+			handles.push_back(handle);
+		}
+
+		//Both paths move every transform first, so update() has everything to rebuild
+		std::vector<glm::mat4> reference(count);
+		double scalarMs = timeBest([&]() {
+			for (uint32_t i = 0; i < count; i++)
+			{
+				system.setPosition(handles[i], system.position(handles[i]));
+				reference[i] = system.buildReference(handles[i]);
+			}
+		});
+		double simdMs = timeBest([&]() {
+			for (uint32_t i = 0; i < count; i++)
+				system.setPosition(handles[i], system.position(handles[i]));
+			system.update();
+		});
+		double idleMs = timeBest([&]() { system.update(); });
+
+		float maxError = 0;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const glm::mat4& m = system.world(handles[i]);
+			for (int c = 0; c < 4; c++)
+				for (int r = 0; r < 4; r++)
+					maxError = std::max(maxError, std::abs(m[c][r] - reference[i][c][r]));
+		}
+
+		std::cout << count << " transforms: glm " << scalarMs << " ms, SIMD " << simdMs << " ms ("
+			<< scalarMs / simdMs << "x), unchanged " << idleMs << " ms, max difference " << maxError << std::endl;
+	}
+}
+
+void benchmarkEntities()
+{
+	std::cout << "Entity query, " << JobSystem::shared().threadCount() << " threads" << std::endl;
+	for (uint32_t count : { 10000u, 50000u, 100000u })
+	{
+		//The entities' transforms live in a system of their own, so the benchmark leaves the shared one alone
+		TransformSystem transforms;
+		EntityWorld world;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			TransformComponent transform{ transforms.create(glm::mat4(1)) };
+			Entity entity = world.create(transform, SpatialComponent{}, VisibilityComponent{ true });
+			if (i % 3 == 1)
+				world.add(entity, MeshRefComponent());
+			else if (i % 3 == 2)
+				world.add(entity, InteractableComponent());
+		}
+
+		auto move = [&](Entity, TransformComponent& transform, VisibilityComponent& visibility) {
+			if (visibility.visible)
+				transforms.setPosition(transform.handle, transforms.position(transform.handle) + glm::vec3(0, 0.01f, 0));
+		};
+		double serialMs = timeBest([&]() { world.each<TransformComponent, VisibilityComponent>(move); });
+		double parallelMs = timeBest([&]() { world.parallelEach<TransformComponent, VisibilityComponent>(JobSystem::shared(), move, 1024); });
+		double updateMs = timeBest([&]() {
+			world.each<TransformComponent, VisibilityComponent>(move);
+			transforms.update();
+		});
+
+		std::cout << count << " entities in " << world.archetypeCount() << " archetypes: query " << serialMs << " ms, parallel "
+			<< parallelMs << " ms, query and matrix rebuild " << updateMs << " ms" << std::endl;
+	}
+}
+
+//A hilly terrain seen from above one edge, the kind of large occluder the island is
+static void makeTerrain(std::vector<glm::vec3>& positions, std::vector<uint32_t>& faces)
+{
+	const int grid = 128;
+	const float size = 100.0f;
+	for (int z = 0; z <= grid; z++)
+	{
+		for (int x = 0; x <= grid; x++)
+		{
+			float height = 4.0f * std::sin(x * 0.15f) * std::cos(z * 0.1f);
+			positions.push_back(glm::vec3(x * size / grid - size / 2, height, z * size / grid - size / 2));
+		}
+	}
+	for (int z = 0; z < grid; z++)
+	{
+		for (int x = 0; x < grid; x++)
+		{
+			uint32_t a = z * (grid + 1) + x, b = a + grid + 1, c = b + 1, d = a + 1;
+			faces.insert(faces.end(), { a, b, c, a, c, d });
+		}
+	}
+}
+
+static glm::mat4 terrainViewProjection()
+{
+	return glm::perspective(glm::radians(45.0f), 2.0f, 1.0f, 200.0f) * glm::lookAt(glm::vec3(0, 12, 60), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+}
+
+//Every pixel center against every front-facing triangle, one at a time. The whole terrain is in front of the
+//camera, so nothing needs clipping
+static std::vector<float> referenceDepths(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& faces, const glm::mat4& viewProjection)
+{
+	std::vector<glm::vec3> window;
+	for (auto& position : positions)
+	{
+		glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		window.push_back(glm::vec3((ndc.x * 0.5f + 0.5f) * OcclusionBuffer::Width, (ndc.y * 0.5f + 0.5f) * OcclusionBuffer::Height, ndc.z * 0.5f + 0.5f));
+	}
+	std::vector<float> reference(OcclusionBuffer::Width * OcclusionBuffer::Height, 1.0f);
+	for (size_t i = 0; i < faces.size(); i += 3)
+	{
+		glm::vec3 v[3] = { window[faces[i]], window[faces[i + 1]], window[faces[i + 2]] };
+		float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+		if (area <= 0)
+			continue;
+		for (uint32_t y = 0; y < OcclusionBuffer::Height; y++)
+		{
+			for (uint32_t x = 0; x < OcclusionBuffer::Width; x++)
+			{
+				glm::vec2 p(x + 0.5f, y + 0.5f);
+				float w[3];
+				for (int e = 0; e < 3; e++)
+				{
+					const glm::vec3& a = v[(e + 1) % 3];
+					const glm::vec3& b = v[(e + 2) % 3];
+					w[e] = ((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)) / area;
+				}
+				if (w[0] < 0 || w[1] < 0 || w[2] < 0)
+					continue;
+				float depth = w[0] * v[0].z + w[1] * v[1].z + w[2] * v[2].z;
+				reference[y * OcclusionBuffer::Width + x] = std::min(reference[y * OcclusionBuffer::Width + x], depth);
+			}
+		}
+	}
+	return reference;
+}
+
+void benchmarkOcclusion()
+{
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> faces;
+	makeTerrain(positions, faces);
+
+	std::vector<AABB> boxes;
+	for (int i = 0; i < 10000; i++)
+	{
+		glm::vec3 center(randomRange(45), randomRange(8), randomRange(45));
+		glm::vec3 extent(0.5f + std::abs(randomRange(1.5f)));
+		boxes.push_back(AABB(center - extent, center + extent));
+	}
+
+	glm::mat4 viewProjection = terrainViewProjection();
+	OcclusionBuffer buffer;
+	JobSystem serial(0);
+	double binMs = timeBest([&]() {
+		buffer.begin(viewProjection);
+		buffer.addOccluder(positions, faces, glm::mat4(1));
+	});
+	double serialMs = timeBest([&]() { buffer.rasterize(serial); });
+	double parallelMs = timeBest([&]() { buffer.rasterize(JobSystem::shared()); });
+	std::vector<uint8_t> visible(boxes.size());
+	double testMs = timeBest([&]() { buffer.test(boxes.data(), static_cast<uint32_t>(boxes.size()), visible.data()); });
+	uint32_t hidden = static_cast<uint32_t>(std::count(visible.begin(), visible.end(), 0));
+
+	std::cout << "Occlusion buffer " << OcclusionBuffer::Width << "x" << OcclusionBuffer::Height << ", " << buffer.triangleCount()
+		<< " occluder triangles: binning " << binMs << " ms, rasterizing " << serialMs << " ms on one thread, " << parallelMs
+		<< " ms on " << JobSystem::shared().threadCount() << "; testing " << boxes.size() << " boxes " << testMs << " ms, "
+		<< hidden << " hidden" << std::endl;
+}
+
+bool testOcclusion()
+{
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> faces;
+	makeTerrain(positions, faces);
+	glm::mat4 viewProjection = terrainViewProjection();
+	std::vector<float> reference = referenceDepths(positions, faces, viewProjection);
+
+	OcclusionBuffer buffer;
+	buffer.begin(viewProjection);
+	buffer.addOccluder(positions, faces, glm::mat4(1));
+	JobSystem serial(0);
+	buffer.rasterize(serial);
+	std::vector<float> serialDepths(OcclusionBuffer::Width * OcclusionBuffer::Height);
+	for (uint32_t y = 0; y < OcclusionBuffer::Height; y++)
+	{
+		for (uint32_t x = 0; x < OcclusionBuffer::Width; x++)
+			serialDepths[y * OcclusionBuffer::Width + x] = buffer.depth(x, y);
+	}
+	buffer.rasterize(JobSystem::shared());
+
+	//Rasterized depths are raised to their furthest over each pixel, so they may only be further than the reference;
+	//a nearer one would hide things that are in sight. Pixels the reference covers but the buffer left empty are
+	//only allowed along silhouettes
+	uint32_t nearer = 0, uncovered = 0, covered = 0, threadMismatches = 0;
+	for (uint32_t y = 0; y < OcclusionBuffer::Height; y++)
+	{
+		for (uint32_t x = 0; x < OcclusionBuffer::Width; x++)
+		{
+			float depth = buffer.depth(x, y);
+			float expected = reference[y * OcclusionBuffer::Width + x];
+			if (depth < expected - 1e-5f)
+				nearer++;
+			if (expected < 1.0f)
+			{
+				covered++;
+				if (depth == 1.0f)
+					uncovered++;
+			}
+			if (depth != serialDepths[y * OcclusionBuffer::Width + x])
+				threadMismatches++;
+		}
+	}
+
+	bool passed = nearer == 0 && threadMismatches == 0 && covered > 0 && uncovered * 20 < covered;
+	std::cout << "Occlusion buffer against the reference: " << nearer << " pixels nearer, " << uncovered << " of " << covered
+		<< " covered pixels left empty, " << threadMismatches << " pixels differing between one thread and "
+		<< JobSystem::shared().threadCount() << (passed ? ": passed" : ": FAILED") << std::endl;
+	return passed;
+}
+
+bool testVirtualPages()
+{
+	uint32_t failures = 0;
+	auto expect = [&](bool condition, const char* what) {
+		if (!condition)
+		{
+			std::cout << "Virtual page table: " << what << " FAILED" << std::endl;
+			failures++;
+		}
+	};
+	auto rendered = [](const std::vector<PageRender>& renders, uint32_t level, uint32_t x, uint32_t y) {
+		return std::any_of(renders.begin(), renders.end(), [&](const PageRender& render) { return render.level == level && render.x == x && render.y == y; });
+	};
+
+	//8x8 pages over four levels, backed by a pool of four physical pages
+	VirtualPageTable table(8, 2);
+	expect(table.levelCount() == 4, "level count");
+	uint32_t coarsest = table.levelCount() - 1;
+
+	//Requests: duplicates and pages outside the map are dropped, and the coarsest page is always wanted
+	table.beginFrame();
+	table.request(0, 1, 2);
+	table.request(0, 1, 2);
+	table.request(0, 8, 0);
+	table.request(4, 0, 0);
+	expect(table.requestedPages() == 2, "requests dropping duplicates and pages outside the map");
+	std::vector<PageRender> renders = table.update(16);
+	expect(renders.size() == 2 && renders[0].level == coarsest && rendered(renders, 0, 1, 2), "first update rendering the coarsest page first");
+	uint32_t entry = table.entries(0)[2 * 8 + 1];
+	expect(renders.size() == 2 && entry == (VirtualPageTable::ResidentBit | renders[1].physicalY << 8 | renders[1].physicalX), "page table entry of a rendered page");
+	expect(renders.size() == 2 && (renders[0].physicalX != renders[1].physicalX || renders[0].physicalY != renders[1].physicalY), "distinct physical pages");
+	expect(table.residentPages() == 2 && table.levelChanged(0), "resident pages after the first update");
+
+	//Feedback: invalid and repeated texels are skipped, and resident pages are not rendered again
+	table.clearChanged();
+	table.beginFrame();
+	uint32_t feedback[] = { 0, VirtualPageTable::FeedbackValid | 2 << 8 | 1, VirtualPageTable::FeedbackValid | 2 << 8 | 1,
+		VirtualPageTable::FeedbackValid | 1 << 16 | 0 << 8 | 3, 1 << 16 | 5 };
+	table.feedback(feedback, sizeof(feedback) / sizeof(feedback[0]));
+	expect(table.requestedPages() == 3, "requests from feedback");
+	renders = table.update(16);
+	expect(renders.size() == 1 && rendered(renders, 1, 3, 0), "only the missing page rendered from feedback");
+	expect(!table.levelChanged(0) && table.levelChanged(1), "changed levels");
+
+	//Fill the pool, keeping the page requested in the first frame the least recently requested
+	table.beginFrame();
+	table.request(0, 5, 5);
+	table.request(1, 3, 0);
+	renders = table.update(16);
+	expect(renders.size() == 1 && table.residentPages() == 4 && table.evictions() == 0, "filling the pool");
+
+	//A full pool gives up its least recently requested page
+	table.beginFrame();
+	table.request(0, 6, 6);
+	renders = table.update(16);
+	expect(table.evictions() == 1 && table.entries(0)[2 * 8 + 1] == 0, "evicting the least recently requested page");
+	expect(renders.size() == 1 && rendered(renders, 0, 6, 6) && table.entries(0)[6 * 8 + 6] == entry, "reusing the evicted physical page");
+
+	//Pages requested this frame are never evicted, so what doesn't fit waits
+	table.beginFrame();
+	table.request(0, 5, 5);
+	table.request(1, 3, 0);
+	table.request(0, 6, 6);
+	table.request(0, 7, 7);
+	renders = table.update(16);
+	expect(renders.empty() && table.evictions() == 1 && table.entries(0)[7 * 8 + 7] == 0, "keeping pages requested this frame");
+
+	//Invalidating a level 0 page also dirties the resident pages covering it on other levels, in place
+	uint32_t before = table.entries(0)[5 * 8 + 5];
+	table.invalidate(5, 5, 5, 5);
+	table.beginFrame();
+	table.request(0, 5, 5);
+	table.request(0, 6, 6);
+	renders = table.update(16);
+	expect(renders.size() == 2 && renders[0].level == coarsest && rendered(renders, 0, 5, 5), "rendering invalidated pages again");
+	expect(table.entries(0)[5 * 8 + 5] == before && table.evictions() == 1, "keeping invalidated pages' physical pages");
+
+	//The render budget holds back the finer pages until the next frame
+	table.invalidateAll();
+	table.beginFrame();
+	table.request(0, 5, 5);
+	table.request(1, 3, 0);
+	table.request(0, 6, 6);
+	renders = table.update(2);
+	expect(renders.size() == 2 && rendered(renders, coarsest, 0, 0) && rendered(renders, 1, 3, 0), "render budget keeping the coarsest pages");
+	table.beginFrame();
+	table.request(0, 5, 5);
+	table.request(1, 3, 0);
+	table.request(0, 6, 6);
+	renders = table.update(2);
+	expect(renders.size() == 2 && rendered(renders, 0, 5, 5) && rendered(renders, 0, 6, 6), "rendering held back pages the next frame");
+	table.beginFrame();
+	renders = table.update(2);
+	expect(renders.empty(), "nothing left to render");
+
+	std::cout << "Virtual page table: " << (failures == 0 ? "passed" : "FAILED") << std::endl;
+	return failures == 0;
+}
+
+bool testClusters()
+{
+	//Lights scattered over a flat stretch in front of the camera, so many overlap and some sit beside the frustum
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> spread(-30.0f, 30.0f);
+	std::vector<PointLightSource> lights;
+	for (int i = 0; i < 500; i++)
+	{
+		PointLightSource light;
+		light.position = glm::vec3(spread(random), spread(random) * 0.2f, spread(random));
+		light.radius = 3.0f;
+		lights.push_back(light);
+	}
+	glm::mat4 view = glm::lookAt(glm::vec3(0, 2, 10), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+
+	ClusterGrid grid;
+	grid.setProjection(glm::radians(45.0f), 1.5f, 0.1f, 100.0f, JobSystem::shared());
+	grid.assign(view, lights, JobSystem::shared());
+
+	//Reference: every light's sphere against every cluster's box, one at a time
+	uint32_t mismatched = 0;
+	std::vector<uint32_t> expected, assigned;
+	for (uint32_t cluster = 0; cluster < ClusterGrid::ClusterCount; cluster++)
+	{
+		AABB bounds = grid.clusterBounds(cluster);
+		expected.clear();
+		for (uint32_t i = 0; i < lights.size(); i++)
+		{
+			glm::vec3 center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+			glm::vec3 offset = glm::max(glm::max(bounds.min - center, glm::vec3(0.0f)), center - bounds.max);
+			if (glm::dot(offset, offset) <= lights[i].radius * lights[i].radius)
+				expected.push_back(i);
+		}
+		assigned.assign(grid.clusterLights(cluster), grid.clusterLights(cluster) + grid.clusterLightCount(cluster));
+		std::sort(assigned.begin(), assigned.end());
+		if (assigned != expected)
+			mismatched++;
+	}
+
+	bool passed = mismatched == 0 && grid.overflow() == 0 && grid.indexCount() > 0;
+	std::cout << "Light clusters against the reference: " << mismatched << " of " << ClusterGrid::ClusterCount << " clusters differ, "
+		<< grid.indexCount() << " light indices, " << grid.overflow() << " left out" << (passed ? ": passed" : ": FAILED") << std::endl;
+	return passed;
+}
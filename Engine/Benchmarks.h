@@ -0,0 +1,42 @@
+#pragma once
+
+/**
+ * @brief Times moving every one of 1k, 10k and 100k transforms and rebuilding their matrices one at a time with
+ * glm against the batched TransformSystem::update(), then an update() where nothing moved, printing the results.
+ * Run with the --benchmark-transforms flag; needs no window.
+ */
+void benchmarkTransforms();
+
+/**
+ * @brief Times a query moving every entity's transform over 10k, 50k and 100k entities spread across several
+ * archetypes, run on one thread and then across the job system. Run with the --benchmark-entities flag.
+ */
+void benchmarkEntities();
+
+/**
+ * @brief Times binning, rasterizing (on one thread and across the job system) and box testing in the occlusion
+ * buffer for a hilly terrain occluder and 10k boxes. Run with the --benchmark-occlusion flag.
+ */
+void benchmarkOcclusion();
+
+/**
+ * @brief Rasterizes the same terrain into the occlusion buffer and checks it against a plain per-pixel reference:
+ * no depth may be nearer than the reference, nearly all covered pixels must be filled, and one thread must match
+ * the job system. Prints the findings and returns whether they passed. Run with the --test-occlusion flag, which
+ * exits nonzero on failure.
+ */
+bool testOcclusion();
+
+/**
+ * @brief Drives a small VirtualPageTable by hand through requests, feedback, updates, least recently requested
+ * eviction, invalidation and the render budget, checking each step. Prints any failed step and returns whether all
+ * passed. Run with the --test-virtual-pages flag, which exits nonzero on failure.
+ */
+bool testVirtualPages();
+
+/**
+ * @brief Assigns 500 point lights to the light clusters and checks every cluster's list against testing each
+ * light's sphere against the cluster's box one at a time. Prints the findings and returns whether they passed. Run
+ * with the --test-clusters flag, which exits nonzero on failure.
+ */
+bool testClusters();
@@ -0,0 +1,85 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cfloat>
+
+/**
+ * @brief An axis-aligned bounding box. Starts out empty (min > max) and grows to fit what is added to it.
+ */
+struct AABB {
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	AABB() = default;
+	AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+	bool empty() const { return min.x > max.x; }
+	glm::vec3 center() const { return (min + max) * 0.5f; }
+	glm::vec3 extent() const { return (max - min) * 0.5f; }
+
+	bool contains(const AABB& box) const
+	{
+		return min.x <= box.min.x && min.y <= box.min.y && min.z <= box.min.z &&
+			max.x >= box.max.x && max.y >= box.max.y && max.z >= box.max.z;
+	}
+
+	bool overlaps(const AABB& box) const
+	{
+		return min.x <= box.max.x && min.y <= box.max.y && min.z <= box.max.z &&
+			max.x >= box.min.x && max.y >= box.min.y && max.z >= box.min.z;
+	}
+
+	void expand(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void expand(const AABB& box)
+	{
+		if (box.empty())
+			return;
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+
+	/**
+	 * @brief The box that encloses this box after transforming it by the given matrix.
+	 */
+	AABB transformed(const glm::mat4& m) const
+	{
+		if (empty())
+			return *this;
+		//Transform the center, and project the extent onto each world axis (Arvo's method)
+		glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.0f));
+		glm::vec3 e = extent();
+		glm::vec3 worldExtent;
+		for (int i = 0; i < 3; i++)
+			worldExtent[i] = glm::abs(m[0][i]) * e.x + glm::abs(m[1][i]) * e.y + glm::abs(m[2][i]) * e.z;
+		return AABB(c - worldExtent, c + worldExtent);
+	}
+};
+
+/**
+ * @brief A sphere enclosing some geometry.
+ */
+struct BoundingSphere {
+	glm::vec3 center = glm::vec3(0);
+	float radius = -1.0f;
+
+	bool empty() const { return radius < 0; }
+
+	/**
+	 * @brief The sphere enclosing this one after transforming it by the given matrix, scaled by its largest axis.
+	 */
+	BoundingSphere transformed(const glm::mat4& m) const
+	{
+		if (empty())
+			return *this;
+		float scale = glm::sqrt(glm::max(glm::max(glm::dot(glm::vec3(m[0]), glm::vec3(m[0])), glm::dot(glm::vec3(m[1]), glm::vec3(m[1]))),
+			glm::dot(glm::vec3(m[2]), glm::vec3(m[2]))));
+		BoundingSphere sphere;
+		sphere.center = glm::vec3(m * glm::vec4(center, 1.0f));
+		sphere.radius = radius * scale;
+		return sphere;
+	}
+};
@@ -0,0 +1,279 @@
+#include "CascadedShadowMap.h"
+#include "OcclusionBuffer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <string>
+#include <glm/ext.hpp>
+
+namespace {
+	//A depth texture array with a layer per cascade, and a frame buffer drawing into its first layer
+	void createDepthArray(uint32_t resolution, uint32_t layers, uint32_t& fbo, uint32_t& texture)
+	{
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		//Sampled through a comparison sampler, whose linear filtering blends the results of the 2x2 texels it reads
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+		//Clamp to a white border so that anything outside of a cascade is not in shadow
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		//Depth only frame buffer, the layer is attached per cascade
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+}
+
+CascadedShadowMap::CascadedShadowMap(const CascadeSettings& settings) : m_settings(settings), m_lightDirection(0.0f), m_invalidations(0)
+{
+	m_settings.cascadeCount = std::min(std::max(m_settings.cascadeCount, 1u), MaxCascades);
+	m_settings.minResolution = std::min(std::max(m_settings.minResolution, 1u), m_settings.resolution);
+	for (uint32_t i = 0; i < MaxCascades; i++)
+	{
+		m_splits[i] = 0.0f;
+		m_sizes[i] = m_settings.resolution;
+		m_cachedSizes[i] = 0;
+		m_lightSpace[i] = glm::mat4(1.0f);
+		m_cachedLightSpace[i] = glm::mat4(1.0f);
+		m_stale[i] = true;
+	}
+
+	createDepthArray(m_settings.resolution, m_settings.cascadeCount, m_fbo, m_texture);
+	createDepthArray(m_settings.resolution, m_settings.cascadeCount, m_cacheFbo, m_cacheTexture);
+}
+
+CascadedShadowMap::~CascadedShadowMap()
+{
+	glDeleteFramebuffers(1, &m_fbo);
+	glDeleteTextures(1, &m_texture);
+	glDeleteFramebuffers(1, &m_cacheFbo);
+	glDeleteTextures(1, &m_cacheTexture);
+}
+
+void CascadedShadowMap::computeSplits(CascadeSplit split, float lambda, float nearPlane, float farPlane, uint32_t count, float* splits)
+{
+	splits[0] = nearPlane;
+	for (uint32_t i = 1; i <= count; i++)
+	{
+		float p = static_cast<float>(i) / count;
+		float uniform = nearPlane + (farPlane - nearPlane) * p;
+		float logarithmic = nearPlane * std::pow(farPlane / nearPlane, p);
+		switch (split)
+		{
+		case CascadeSplit::Uniform:
+			splits[i] = uniform;
+			break;
+		case CascadeSplit::Logarithmic:
+			splits[i] = logarithmic;
+			break;
+		case CascadeSplit::Practical:
+			splits[i] = lambda * logarithmic + (1.0f - lambda) * uniform;
+			break;
+		}
+	}
+	splits[count] = farPlane;
+}
+
+float CascadedShadowMap::texelsWanted(float width, float distance, float fovy, uint32_t screenHeight)
+{
+	//Pixels the width spans on screen at that distance
+	if (distance <= 0.0f)
+		return FLT_MAX;
+	return width / (2.0f * distance * std::tan(fovy * 0.5f)) * screenHeight;
+}
+
+void CascadedShadowMap::update(const glm::mat4& view, float fovy, float aspect, float nearPlane, float farPlane, const glm::vec3& lightDirection,
+	uint32_t screenHeight, const OcclusionBuffer* visibleDepth, const std::vector<AABB>* visibleBounds)
+{
+	uint32_t count = m_settings.cascadeCount;
+	float shadowFar = std::min(farPlane, m_settings.shadowDistance);
+	float distances[MaxCascades + 1];
+	computeSplits(m_settings.split, m_settings.lambda, nearPlane, shadowFar, count, distances);
+
+	//The nearest distance seen in each slice, from the occlusion buffer's depths turned back into view distances.
+	//Pixels no occluder covers hold the far plane and see nothing that needs shadows
+	bool sampled = visibleDepth || visibleBounds;
+	float nearestVisible[MaxCascades];
+	for (uint32_t c = 0; c < count; c++)
+		nearestVisible[c] = sampled ? FLT_MAX : distances[c];
+	if (visibleDepth && m_settings.adaptiveResolution && screenHeight > 0)
+	{
+		for (uint32_t y = 0; y < OcclusionBuffer::Height; y++)
+		{
+			for (uint32_t x = 0; x < OcclusionBuffer::Width; x++)
+			{
+				float ndc = visibleDepth->depth(x, y) * 2.0f - 1.0f;
+				if (ndc >= 1.0f)
+					continue;
+				float distance = 2.0f * nearPlane * farPlane / (farPlane + nearPlane - ndc * (farPlane - nearPlane));
+				uint32_t c = 0;
+				while (c < count && distance > distances[c + 1])
+					c++;
+				if (c < count)
+					nearestVisible[c] = std::min(nearestVisible[c], std::max(distance, distances[c]));
+			}
+		}
+	}
+
+	//Occluders are only the large pieces of the scene, so also take each visible draw's range of view distances,
+	//which reaches from its nearest corner into every slice it spans
+	if (visibleBounds && m_settings.adaptiveResolution && screenHeight > 0)
+	{
+		for (const AABB& bounds : *visibleBounds)
+		{
+			float boxNear = FLT_MAX, boxFar = 0.0f;
+			for (uint32_t i = 0; i < 8; i++)
+			{
+				glm::vec3 corner(i & 1 ? bounds.max.x : bounds.min.x, i & 2 ? bounds.max.y : bounds.min.y, i & 4 ? bounds.max.z : bounds.min.z);
+				float distance = -(view * glm::vec4(corner, 1.0f)).z;
+				boxNear = std::min(boxNear, distance);
+				boxFar = std::max(boxFar, distance);
+			}
+			for (uint32_t c = 0; c < count; c++)
+			{
+				if (boxNear <= distances[c + 1] && boxFar >= distances[c])
+					nearestVisible[c] = std::min(nearestVisible[c], std::max(boxNear, distances[c]));
+			}
+		}
+	}
+
+	glm::mat4 inverseView = glm::inverse(view);
+	float tanY = std::tan(fovy * 0.5f);
+	float tanX = tanY * aspect;
+	glm::vec3 direction = glm::normalize(lightDirection);
+	glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+	if (direction != m_lightDirection)
+	{
+		m_lightDirection = direction;
+		invalidateStatic();
+	}
+
+	for (uint32_t c = 0; c < count; c++)
+	{
+		float sliceNear = distances[c], sliceFar = distances[c + 1];
+		m_splits[c] = sliceFar;
+
+		//World space corners of the camera's frustum between the split distances
+		glm::vec3 corners[8];
+		glm::vec3 center(0.0f);
+		for (uint32_t i = 0; i < 8; i++)
+		{
+			float d = (i & 4) ? sliceFar : sliceNear;
+			glm::vec4 corner = inverseView * glm::vec4((i & 1 ? 1.0f : -1.0f) * tanX * d, (i & 2 ? 1.0f : -1.0f) * tanY * d, -d, 1.0f);
+			corners[i] = glm::vec3(corner);
+			center += corners[i];
+		}
+		center /= 8.0f;
+
+		//Fit to a bounding sphere so the cascade keeps its size as the camera turns, rounding the radius so
+		//floating point noise does not change it either
+		float radius = 0.0f;
+		for (uint32_t i = 0; i < 8; i++)
+			radius = std::max(radius, glm::length(corners[i] - center));
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		//Size the cascade for the texels wanted where what is seen of its slice is nearest, which are the most. Grow
+		//as soon as more are wanted, but only shrink once half the size would still do with room to spare, so a
+		//cascade near the edge between two sizes does not keep switching and re-rendering its cache. A slice with
+		//no samples may still hold something that was missed, so it keeps the whole layer
+		uint32_t size = m_settings.resolution;
+		if (m_settings.adaptiveResolution && screenHeight > 0)
+		{
+			float wanted = nearestVisible[c] == FLT_MAX ? FLT_MAX : texelsWanted(2.0f * radius, nearestVisible[c], fovy, screenHeight) * m_settings.resolutionScale;
+			size = std::min(std::max(m_sizes[c], m_settings.minResolution), m_settings.resolution);
+			while (size < m_settings.resolution && wanted > size)
+				size <<= 1;
+			while (size > m_settings.minResolution && wanted < size * 0.4f)
+				size >>= 1;
+		}
+		m_sizes[c] = size;
+
+		//Cascades move in steps of a whole number of texels. A cascade is larger than its sphere by half a step on
+		//each side, so the sphere stays inside however the center is rounded
+		float resolution = static_cast<float>(size);
+		float stepTexels = std::max(std::round(resolution * m_settings.cacheStep), 1.0f);
+		stepTexels = std::min(stepTexels, resolution * 0.5f);
+		float extent = radius / (1.0f - stepTexels / resolution);
+
+		//Round the center in light space to whole steps, which also keeps the world origin on a whole texel so
+		//rasterized shadow edges stay put as the cascade moves
+		float step = stepTexels * 2.0f * extent / resolution;
+		glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+		lightCenter = glm::round(lightCenter / step) * step;
+		glm::mat4 lightProj = glm::ortho(lightCenter.x - extent, lightCenter.x + extent, lightCenter.y - extent, lightCenter.y + extent,
+			-lightCenter.z - extent, -lightCenter.z + extent);
+		m_lightSpace[c] = lightProj * lightRotation;
+		if (m_lightSpace[c] != m_cachedLightSpace[c] || m_sizes[c] != m_cachedSizes[c])
+		{
+			if (!m_stale[c])
+				m_invalidations++;
+			m_stale[c] = true;
+		}
+
+		//Casters up to casterDistance from what the camera sees of the slice, including those behind the light's
+		//near plane, whose depth is clamped by the shadow pass. Static casters are cached for the whole cascade
+		Frustum slice(glm::perspective(fovy, aspect, sliceNear, sliceFar) * view);
+		m_casters[c] = Frustum::shadowCasters(m_lightSpace[c], slice, direction, m_settings.casterDistance);
+		m_volumes[c] = Frustum::shadowCasters(m_lightSpace[c], Frustum(), direction, 0.0f);
+	}
+}
+
+void CascadedShadowMap::invalidateStatic()
+{
+	for (uint32_t c = 0; c < m_settings.cascadeCount; c++)
+	{
+		if (!m_stale[c])
+			m_invalidations++;
+		m_stale[c] = true;
+	}
+}
+
+void CascadedShadowMap::bindStaticCache(uint32_t cascade)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_cacheFbo);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_cacheTexture, 0, cascade);
+	glViewport(0, 0, m_sizes[cascade], m_sizes[cascade]);
+	m_cachedLightSpace[cascade] = m_lightSpace[cascade];
+	m_cachedSizes[cascade] = m_sizes[cascade];
+	m_stale[cascade] = false;
+}
+
+void CascadedShadowMap::bindCascade(uint32_t cascade)
+{
+	//Start from the cached static casters
+	int32_t size = static_cast<int32_t>(m_sizes[cascade]);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_cacheFbo);
+	glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_cacheTexture, 0, cascade);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_texture, 0, cascade);
+	glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glViewport(0, 0, size, size);
+}
+
+void CascadedShadowMap::setUniforms(Shader& shader) const
+{
+	shader.setUniform("cascadeCount", static_cast<int32_t>(m_settings.cascadeCount));
+	for (uint32_t c = 0; c < m_settings.cascadeCount; c++)
+	{
+		std::string index = "[" + std::to_string(c) + "]";
+		shader.setUniform("cascadeSplits" + index, m_splits[c]);
+		shader.setUniform("cascadeScales" + index, static_cast<float>(m_sizes[c]) / m_settings.resolution);
+		shader.setUniform("lightSpaceMatrices" + index, m_lightSpace[c]);
+	}
+}
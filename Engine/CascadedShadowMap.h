@@ -0,0 +1,158 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "Bounds.h"
+#include "Frustum.h"
+#include "Shader.h"
+
+class OcclusionBuffer;
+
+/**
+ * @brief How the camera's shadowed depth range is divided between cascades.
+ *
+ * Uniform splits spread the range evenly, wasting resolution in the distance; logarithmic splits match the
+ * perspective foreshortening but leave the nearest cascade very thin; practical splits blend the two by lambda.
+ */
+enum class CascadeSplit {
+	Uniform,
+	Logarithmic,
+	Practical
+};
+
+struct CascadeSettings {
+	uint32_t cascadeCount = 4;
+	// Width and height of each cascade's layer. Four cascades at 1024 hold as many texels as one 2048 map.
+	uint32_t resolution = 1024;
+	// Cascades render into as much of their layer as their texels cover on screen, down to minResolution, with
+	// the texels wanted scaled by resolutionScale so slower machines can trade sharpness for speed.
+	bool adaptiveResolution = true;
+	uint32_t minResolution = 128;
+	float resolutionScale = 1.0f;
+	CascadeSplit split = CascadeSplit::Practical;
+	// Weight of the logarithmic splits in the practical scheme.
+	float lambda = 0.75f;
+	// How far from the camera shadows are drawn; beyond the last cascade nothing is shadowed.
+	float shadowDistance = 60.0f;
+	// How far a caster may be from the region it shadows.
+	float casterDistance = 50.0f;
+	// Fraction of its width a cascade moves by at a time. Larger steps keep the cached static shadows valid for
+	// longer, at the cost of a cascade slightly larger than its slice.
+	float cacheStep = 0.125f;
+};
+
+/**
+ * @brief Directional light shadows rendered into the layers of a depth texture array, one orthographic cascade
+ * per slice of the camera's frustum.
+ *
+ * Each cascade is fitted to a sphere around its slice rather than the slice itself, so its size does not change
+ * as the camera turns, and its origin is snapped to whole texels, so shadow edges do not shimmer as the camera
+ * moves. Resolution follows the camera and stays the same however large the world is.
+ *
+ * Static casters are rendered into a second array that is kept while the cascade stays put, and only re-rendered
+ * when the cascade moves, the light turns or invalidateStatic() is called because static geometry changed. Each
+ * cascade moves in steps of a fraction of its width, so it only moves once the camera has gone some way. Every
+ * frame the cached layer is copied into the shadow map and only the dynamic casters are drawn over it.
+ *
+ * A cascade only renders into as many texels of its layer as it needs: about one texel per pixel at the nearest
+ * surface the camera sees in its slice, rounded to a power of two. What is seen comes from the occluders'
+ * depths and the bounds of the draws the camera kept, so props too small to be occluders still count. Slices
+ * with neither use the whole layer, as nothing says how little they could do with.
+ *
+ * Each frame: update() with the camera, render the static casters of every staticStale() cascade after
+ * bindStaticCache(), the dynamic casters of every cascade after bindCascade(), then setUniforms() on the shader
+ * sampling the shadows with the array bound.
+ */
+class CascadedShadowMap {
+public:
+	static const uint32_t MaxCascades = 4;
+
+private:
+	CascadeSettings m_settings;
+	uint32_t m_fbo;
+	uint32_t m_texture;
+	uint32_t m_cacheFbo;
+	uint32_t m_cacheTexture;
+	// View distance at which each cascade ends.
+	float m_splits[MaxCascades];
+	// Texels per side of the part of each layer the cascade renders into.
+	uint32_t m_sizes[MaxCascades];
+	glm::mat4 m_lightSpace[MaxCascades];
+	Frustum m_casters[MaxCascades];
+	// The whole of each cascade's volume extended towards the light, which the static casters are culled against.
+	Frustum m_volumes[MaxCascades];
+	// The light space each cached static layer was rendered with, and whether it still needs rendering.
+	glm::mat4 m_cachedLightSpace[MaxCascades];
+	uint32_t m_cachedSizes[MaxCascades];
+	bool m_stale[MaxCascades];
+	glm::vec3 m_lightDirection;
+	uint32_t m_invalidations;
+
+public:
+	explicit CascadedShadowMap(const CascadeSettings& settings = CascadeSettings());
+	CascadedShadowMap(const CascadedShadowMap&) = delete;
+	CascadedShadowMap& operator=(const CascadedShadowMap&) = delete;
+	~CascadedShadowMap();
+
+	/**
+	 * @brief Fills splits[0..count] with the view distances dividing near..far into count slices.
+	 */
+	static void computeSplits(CascadeSplit split, float lambda, float nearPlane, float farPlane, uint32_t count, float* splits);
+
+	/**
+	 * @brief Fits every cascade to its slice of the camera's frustum, for a light shining along lightDirection.
+	 * With adaptive resolution, sizes each cascade for a screen of the given height, at the nearest surface in its
+	 * slice of either the camera's rasterized occlusion buffer or the world-space bounds of draws the camera sees,
+	 * such as those it kept last frame. Without either a cascade is sized for its slice's start, and a slice
+	 * neither reaches gets the whole layer. Without a height every cascade uses its whole layer.
+	 */
+	void update(const glm::mat4& view, float fovy, float aspect, float nearPlane, float farPlane, const glm::vec3& lightDirection,
+		uint32_t screenHeight = 0, const OcclusionBuffer* visibleDepth = nullptr, const std::vector<AABB>* visibleBounds = nullptr);
+
+	/**
+	 * @brief The texels per side a cascade of the given width in world units wants when the nearest point of its
+	 * slice is distance away, on a screen of the given height.
+	 */
+	static float texelsWanted(float width, float distance, float fovy, uint32_t screenHeight);
+
+	/**
+	 * @brief Marks every cached static layer for re-rendering, such as when static geometry was added or removed.
+	 */
+	void invalidateStatic();
+
+	/**
+	 * @brief Binds the framebuffer with the cascade's cached static layer attached and sets the viewport to it,
+	 * marking the layer as rendered.
+	 */
+	void bindStaticCache(uint32_t cascade);
+
+	/**
+	 * @brief Copies the cascade's cached static layer into its shadow map layer and leaves the framebuffer with
+	 * that layer attached bound, for drawing the dynamic casters.
+	 */
+	void bindCascade(uint32_t cascade);
+
+	/**
+	 * @brief Sets cascadeCount, cascadeSplits[], cascadeScales[] and lightSpaceMatrices[] on a shader sampling the
+	 * shadows.
+	 */
+	void setUniforms(Shader& shader) const;
+
+	uint32_t cascadeCount() const { return m_settings.cascadeCount; }
+	uint32_t resolution() const { return m_settings.resolution; }
+	// Texels per side the cascade renders into this frame.
+	uint32_t resolution(uint32_t cascade) const { return m_sizes[cascade]; }
+	uint32_t texture() const { return m_texture; }
+	float split(uint32_t cascade) const { return m_splits[cascade]; }
+	const glm::mat4& lightSpace(uint32_t cascade) const { return m_lightSpace[cascade]; }
+	// The region holding every caster that can shadow what the camera sees of the cascade.
+	const Frustum& casters(uint32_t cascade) const { return m_casters[cascade]; }
+	// The region holding every caster that can shadow any part of the cascade.
+	const Frustum& volume(uint32_t cascade) const { return m_volumes[cascade]; }
+	// Whether the cascade's static casters must be rendered into its cached layer this frame.
+	bool staticStale(uint32_t cascade) const { return m_stale[cascade]; }
+	// Number of times a cached static layer was invalidated since creation.
+	uint32_t invalidations() const { return m_invalidations; }
+};
@@ -0,0 +1,163 @@
+#include "ClusterGrid.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <immintrin.h>
+
+static_assert((ClusterGrid::GridX * ClusterGrid::GridY) % 4 == 0, "Slices must hold whole SIMD steps of clusters");
+
+ClusterGrid::ClusterGrid() : m_fovy(0.0f), m_aspect(0.0f), m_nearPlane(0.0f), m_farPlane(0.0f), m_lightCount(0), m_indexCount(0),
+	m_maxClusterLights(0), m_overflow(0)
+{
+	m_minX.resize(ClusterCount);
+	m_minY.resize(ClusterCount);
+	m_minZ.resize(ClusterCount);
+	m_maxX.resize(ClusterCount);
+	m_maxY.resize(ClusterCount);
+	m_maxZ.resize(ClusterCount);
+	m_scratch.resize(ClusterCount * MaxLightsPerCluster);
+	m_counts.resize(ClusterCount, 0);
+	std::fill(m_sliceNear, m_sliceNear + GridZ, 0.0f);
+	std::fill(m_sliceFar, m_sliceFar + GridZ, 0.0f);
+	std::fill(m_sliceOverflow, m_sliceOverflow + GridZ, 0u);
+}
+
+void ClusterGrid::setProjection(float fovy, float aspect, float nearPlane, float farPlane, JobSystem& jobs)
+{
+	if (fovy == m_fovy && aspect == m_aspect && nearPlane == m_nearPlane && farPlane == m_farPlane)
+		return;
+	m_fovy = fovy;
+	m_aspect = aspect;
+	m_nearPlane = nearPlane;
+	m_farPlane = farPlane;
+	buildClusters(jobs);
+}
+
+void ClusterGrid::buildClusters(JobSystem& jobs)
+{
+	//Slices grow exponentially with depth, so clusters stay roughly as deep as they are wide
+	for (uint32_t z = 0; z < GridZ; z++)
+	{
+		m_sliceNear[z] = m_nearPlane * std::pow(m_farPlane / m_nearPlane, static_cast<float>(z) / GridZ);
+		m_sliceFar[z] = m_nearPlane * std::pow(m_farPlane / m_nearPlane, static_cast<float>(z + 1) / GridZ);
+	}
+
+	float tanY = std::tan(m_fovy * 0.5f);
+	float tanX = tanY * m_aspect;
+	jobs.parallelFor(GridZ, 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t z = begin; z < end; z++)
+		{
+			for (uint32_t y = 0; y < GridY; y++)
+			{
+				for (uint32_t x = 0; x < GridX; x++)
+				{
+					//The box around the tile's corners at the slice's near and far depths
+					glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+					for (uint32_t corner = 0; corner < 8; corner++)
+					{
+						float depth = (corner & 4) ? m_sliceFar[z] : m_sliceNear[z];
+						float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / GridX;
+						float ndcY = -1.0f + 2.0f * (y + ((corner >> 1) & 1)) / GridY;
+						glm::vec3 point(ndcX * tanX * depth, ndcY * tanY * depth, -depth);
+						low = glm::min(low, point);
+						high = glm::max(high, point);
+					}
+					uint32_t cluster = (z * GridY + y) * GridX + x;
+					m_minX[cluster] = low.x;
+					m_minY[cluster] = low.y;
+					m_minZ[cluster] = low.z;
+					m_maxX[cluster] = high.x;
+					m_maxY[cluster] = high.y;
+					m_maxZ[cluster] = high.z;
+				}
+			}
+		}
+	});
+}
+
+void ClusterGrid::assignSlice(uint32_t slice)
+{
+	const uint32_t sliceClusters = GridX * GridY;
+	uint32_t first = slice * sliceClusters;
+	std::fill(m_counts.begin() + first, m_counts.begin() + first + sliceClusters, 0u);
+	m_sliceOverflow[slice] = 0;
+
+	const __m128 zero = _mm_setzero_ps();
+	for (uint32_t light = 0; light < m_lightCount; light++)
+	{
+		//Skip lights whose sphere misses the slice's depth range entirely
+		const glm::vec4& sphere = m_viewLights[light];
+		float depth = -sphere.z;
+		if (depth + sphere.w < m_sliceNear[slice] || depth - sphere.w > m_sliceFar[slice])
+			continue;
+
+		//Distance from the sphere's center to four clusters' boxes at a time, compared against its radius
+		__m128 px = _mm_set1_ps(sphere.x), py = _mm_set1_ps(sphere.y), pz = _mm_set1_ps(sphere.z);
+		__m128 radius2 = _mm_set1_ps(sphere.w * sphere.w);
+		for (uint32_t c = first; c < first + sliceClusters; c += 4)
+		{
+			__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minX[c]), px), zero), _mm_sub_ps(px, _mm_loadu_ps(&m_maxX[c])));
+			__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minY[c]), py), zero), _mm_sub_ps(py, _mm_loadu_ps(&m_maxY[c])));
+			__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minZ[c]), pz), zero), _mm_sub_ps(pz, _mm_loadu_ps(&m_maxZ[c])));
+			__m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, radius2));
+			for (uint32_t b = 0; mask != 0; b++, mask >>= 1)
+			{
+				if (!(mask & 1))
+					continue;
+				uint32_t& count = m_counts[c + b];
+				if (count < MaxLightsPerCluster)
+					m_scratch[(c + b) * MaxLightsPerCluster + count++] = light;
+				else
+					m_sliceOverflow[slice]++;
+			}
+		}
+	}
+}
+
+void ClusterGrid::assign(const glm::mat4& view, const std::vector<PointLightSource>& lights, JobSystem& jobs)
+{
+	m_lightCount = static_cast<uint32_t>(lights.size());
+	m_viewLights.resize(m_lightCount);
+	for (uint32_t i = 0; i < m_lightCount; i++)
+		m_viewLights[i] = glm::vec4(glm::vec3(view * glm::vec4(lights[i].position, 1.0f)), lights[i].radius);
+
+	//Every slice fills its own clusters' lists
+	jobs.parallelFor(GridZ, 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t slice = begin; slice < end; slice++)
+			assignSlice(slice);
+	});
+
+	m_indexCount = 0;
+	m_maxClusterLights = 0;
+	m_overflow = 0;
+	for (uint32_t cluster = 0; cluster < ClusterCount; cluster++)
+	{
+		m_indexCount += m_counts[cluster];
+		m_maxClusterLights = std::max(m_maxClusterLights, m_counts[cluster]);
+	}
+	for (uint32_t slice = 0; slice < GridZ; slice++)
+		m_overflow += m_sliceOverflow[slice];
+}
+
+int32_t ClusterGrid::clusterAt(const glm::vec3& viewPosition) const
+{
+	float depth = -viewPosition.z;
+	if (depth < m_nearPlane || depth >= m_farPlane)
+		return -1;
+	float tanY = std::tan(m_fovy * 0.5f);
+	float tanX = tanY * m_aspect;
+	int32_t x = static_cast<int32_t>(std::floor((viewPosition.x / (depth * tanX) * 0.5f + 0.5f) * GridX));
+	int32_t y = static_cast<int32_t>(std::floor((viewPosition.y / (depth * tanY) * 0.5f + 0.5f) * GridY));
+	int32_t z = static_cast<int32_t>(std::floor(std::log(depth / m_nearPlane) / std::log(m_farPlane / m_nearPlane) * GridZ));
+	if (x < 0 || y < 0 || x >= static_cast<int32_t>(GridX) || y >= static_cast<int32_t>(GridY))
+		return -1;
+	z = std::min(z, static_cast<int32_t>(GridZ) - 1);
+	return (z * GridY + y) * GridX + x;
+}
+
+AABB ClusterGrid::clusterBounds(uint32_t cluster) const
+{
+	return AABB(glm::vec3(m_minX[cluster], m_minY[cluster], m_minZ[cluster]), glm::vec3(m_maxX[cluster], m_maxY[cluster], m_maxZ[cluster]));
+}
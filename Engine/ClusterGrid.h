@@ -0,0 +1,94 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "Bounds.h"
+#include "JobSystem.h"
+
+/**
+ * @brief A point light as the clustered shading sees it. The radius is where its attenuation has faded enough
+ * to be left out; shadow indexes the shader's pointShadows[], or -1 for none.
+ */
+struct PointLightSource {
+	glm::vec3 position = glm::vec3(0.0f);
+	float linear = 0.7f;
+	float quadratic = 1.8f;
+	float radius = 0.0f;
+	int32_t shadow = -1;
+};
+
+/**
+ * @brief The CPU side of clustered shading: the clusters' view space boxes and which point lights reach each.
+ * Uses no GL, so it can be driven by hand.
+ *
+ * The camera's frustum is divided into screen tiles split into exponentially deeper slices. The boxes are built
+ * once per projection; assign() moves the lights into view space and tests them against the clusters, one depth
+ * slice per job and four clusters per SIMD step.
+ */
+class ClusterGrid {
+public:
+	static const uint32_t GridX = 16;
+	static const uint32_t GridY = 9;
+	static const uint32_t GridZ = 24;
+	static const uint32_t ClusterCount = GridX * GridY * GridZ;
+	// Lights a single cluster can hold; any more are left out of it.
+	static const uint32_t MaxLightsPerCluster = 128;
+
+private:
+	float m_fovy, m_aspect, m_nearPlane, m_farPlane;
+
+	// View space bounds of the clusters, a component per array, so four clusters load into a register at a time.
+	// Clusters are ordered x fastest, then y, then the depth slice.
+	std::vector<float> m_minX, m_minY, m_minZ, m_maxX, m_maxY, m_maxZ;
+	// Each slice's view depth range, as distances in front of the camera.
+	float m_sliceNear[GridZ], m_sliceFar[GridZ];
+
+	// Light indices each cluster found, MaxLightsPerCluster per cluster, and how many.
+	std::vector<uint32_t> m_scratch;
+	std::vector<uint32_t> m_counts;
+	uint32_t m_sliceOverflow[GridZ];
+	std::vector<glm::vec4> m_viewLights;
+
+	uint32_t m_lightCount;
+	uint32_t m_indexCount;
+	uint32_t m_maxClusterLights;
+	uint32_t m_overflow;
+
+	void buildClusters(JobSystem& jobs);
+	void assignSlice(uint32_t slice);
+
+public:
+	ClusterGrid();
+
+	/**
+	 * @brief Fits the clusters to the camera's projection, rebuilding their boxes if it changed.
+	 */
+	void setProjection(float fovy, float aspect, float nearPlane, float farPlane, JobSystem& jobs);
+
+	/**
+	 * @brief Assigns the lights to the clusters they reach from the given view.
+	 */
+	void assign(const glm::mat4& view, const std::vector<PointLightSource>& lights, JobSystem& jobs);
+
+	/**
+	 * @brief The index of the cluster holding a view space point, or -1 outside of the grid.
+	 */
+	int32_t clusterAt(const glm::vec3& viewPosition) const;
+
+	// A cluster's view space box.
+	AABB clusterBounds(uint32_t cluster) const;
+
+	// The light indices a cluster was given by the last assign(), for inspection.
+	const uint32_t* clusterLights(uint32_t cluster) const { return &m_scratch[cluster * MaxLightsPerCluster]; }
+	uint32_t clusterLightCount(uint32_t cluster) const { return m_counts[cluster]; }
+
+	float nearPlane() const { return m_nearPlane; }
+	float farPlane() const { return m_farPlane; }
+	// Lights assigned, indices in all clusters' lists, the most lights in one cluster, and lights left out of
+	// full clusters.
+	uint32_t lightCount() const { return m_lightCount; }
+	uint32_t indexCount() const { return m_indexCount; }
+	uint32_t maxClusterLights() const { return m_maxClusterLights; }
+	uint32_t overflow() const { return m_overflow; }
+};
@@ -0,0 +1,89 @@
+#include "ClusteredLights.h"
+
+#include <algorithm>
+#include <cmath>
+
+ClusteredLights::ClusteredLights(StreamBuffer& stream) : m_stream(stream), m_lightBuffer(0), m_clusterBuffer(0)
+{
+	glGenTextures(1, &m_lightTexture);
+	glGenTextures(1, &m_clusterTexture);
+}
+
+ClusteredLights::~ClusteredLights()
+{
+	glDeleteTextures(1, &m_lightTexture);
+	glDeleteTextures(1, &m_clusterTexture);
+}
+
+void ClusteredLights::setProjection(float fovy, float aspect, float nearPlane, float farPlane, JobSystem& jobs)
+{
+	m_grid.setProjection(fovy, aspect, nearPlane, farPlane, jobs);
+}
+
+void ClusteredLights::update(const glm::mat4& view, const std::vector<PointLightSource>& lights, JobSystem& jobs)
+{
+	m_grid.assign(view, lights, jobs);
+	uint32_t indexCount = m_grid.indexCount();
+	uint32_t lightCount = m_grid.lightCount();
+
+	//Pack an offset and count per cluster, then every cluster's indices one after another
+	m_clusterData = m_stream.allocate((ClusterCount * 2 + std::max(indexCount, 1u)) * sizeof(uint32_t), sizeof(uint32_t));
+	uint32_t* clusterData = static_cast<uint32_t*>(m_clusterData.data);
+	uint32_t* indices = clusterData + ClusterCount * 2;
+	uint32_t offset = 0;
+	for (uint32_t cluster = 0; cluster < ClusterCount; cluster++)
+	{
+		uint32_t count = m_grid.clusterLightCount(cluster);
+		clusterData[cluster * 2] = offset;
+		clusterData[cluster * 2 + 1] = count;
+		std::copy(m_grid.clusterLights(cluster), m_grid.clusterLights(cluster) + count, indices + offset);
+		offset += count;
+	}
+
+	m_lightData = m_stream.allocate(std::max(lightCount, 1u) * LightTexels * sizeof(glm::vec4), sizeof(glm::vec4));
+	glm::vec4* lightData = static_cast<glm::vec4*>(m_lightData.data);
+	for (uint32_t i = 0; i < lightCount; i++)
+	{
+		const PointLightSource& light = lights[i];
+		lightData[i * LightTexels] = glm::vec4(light.position, light.radius);
+		lightData[i * LightTexels + 1] = glm::vec4(light.linear, light.quadratic, static_cast<float>(light.shadow), 0.0f);
+	}
+	m_stream.commit();
+
+	//The stream buffer is replaced when it grows, so point the buffer textures at whichever one holds the data
+	if (m_lightBuffer != m_lightData.buffer)
+	{
+		glBindTexture(GL_TEXTURE_BUFFER, m_lightTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_lightData.buffer);
+		m_lightBuffer = m_lightData.buffer;
+	}
+	if (m_clusterBuffer != m_clusterData.buffer)
+	{
+		glBindTexture(GL_TEXTURE_BUFFER, m_clusterTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, m_clusterData.buffer);
+		m_clusterBuffer = m_clusterData.buffer;
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLights::setUniforms(Shader& shader, uint32_t screenWidth, uint32_t screenHeight) const
+{
+	//A fragment's slice is log(depth) * scale + bias
+	float logRatio = std::log(m_grid.farPlane() / m_grid.nearPlane());
+	shader.setUniform("lightData", LightUnit);
+	shader.setUniform("clusterData", ClusterUnit);
+	shader.setUniform("lightBase", static_cast<int32_t>(m_lightData.offset / sizeof(glm::vec4)));
+	shader.setUniform("clusterBase", static_cast<int32_t>(m_clusterData.offset / sizeof(uint32_t)));
+	shader.setUniform("clusterGrid", glm::vec3(GridX, GridY, GridZ));
+	shader.setUniform("clusterDepth", glm::vec2(GridZ / logRatio, -GridZ * std::log(m_grid.nearPlane()) / logRatio));
+	shader.setUniform("screenSize", glm::vec2(screenWidth, screenHeight));
+}
+
+void ClusteredLights::bind() const
+{
+	glActiveTexture(GL_TEXTURE0 + LightUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, m_lightTexture);
+	glActiveTexture(GL_TEXTURE0 + ClusterUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, m_clusterTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
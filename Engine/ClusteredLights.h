@@ -0,0 +1,84 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "ClusterGrid.h"
+#include "JobSystem.h"
+#include "Shader.h"
+#include "StreamBuffer.h"
+
+/**
+ * @brief Clustered forward shading: the camera's frustum is divided into a grid of clusters, screen tiles split
+ * into exponentially deeper slices, and each cluster gets the list of the point lights reaching it, so a fragment
+ * only shades the lights of its own cluster however many there are in the scene.
+ *
+ * The clusters' view space boxes are built once per projection. Each frame the ClusterGrid assigns the lights to
+ * the clusters, then the lists are packed one after another and streamed to the GPU with the lights. Shaders read them from two buffer textures:
+ * lightData with LightTexels texels per light, and clusterData with an offset and count per cluster followed by
+ * the light indices.
+ *
+ * Each frame: update() with the camera's view and the lights, then setUniforms() and bind() on the shader.
+ */
+class ClusteredLights {
+public:
+	static const uint32_t GridX = ClusterGrid::GridX;
+	static const uint32_t GridY = ClusterGrid::GridY;
+	static const uint32_t GridZ = ClusterGrid::GridZ;
+	static const uint32_t ClusterCount = ClusterGrid::ClusterCount;
+	static const uint32_t MaxLightsPerCluster = ClusterGrid::MaxLightsPerCluster;
+	// (position, radius), (linear, quadratic, shadow, 0).
+	static const uint32_t LightTexels = 2;
+	// Texture units the lights and clusters are bound to.
+	static const int32_t LightUnit = 6;
+	static const int32_t ClusterUnit = 7;
+
+private:
+	StreamBuffer& m_stream;
+	ClusterGrid m_grid;
+
+	uint32_t m_lightTexture;
+	uint32_t m_clusterTexture;
+	uint32_t m_lightBuffer;
+	uint32_t m_clusterBuffer;
+	StreamAllocation m_lightData;
+	StreamAllocation m_clusterData;
+
+public:
+	explicit ClusteredLights(StreamBuffer& stream);
+	ClusteredLights(const ClusteredLights&) = delete;
+	ClusteredLights& operator=(const ClusteredLights&) = delete;
+	~ClusteredLights();
+
+	/**
+	 * @brief Fits the clusters to the camera's projection, rebuilding their boxes if it changed.
+	 */
+	void setProjection(float fovy, float aspect, float nearPlane, float farPlane, JobSystem& jobs);
+
+	/**
+	 * @brief Assigns the lights to the clusters they reach from the given view, and streams both to the GPU.
+	 */
+	void update(const glm::mat4& view, const std::vector<PointLightSource>& lights, JobSystem& jobs);
+
+	/**
+	 * @brief Sets the grid and where this frame's data starts on a shader shading with the clusters.
+	 */
+	void setUniforms(Shader& shader, uint32_t screenWidth, uint32_t screenHeight) const;
+
+	/**
+	 * @brief Binds the light and cluster buffer textures to their units.
+	 */
+	void bind() const;
+
+	/**
+	 * @brief The clusters and the lights the last update() assigned to them.
+	 */
+	const ClusterGrid& grid() const { return m_grid; }
+
+	int32_t clusterAt(const glm::vec3& viewPosition) const { return m_grid.clusterAt(viewPosition); }
+	uint32_t lightCount() const { return m_grid.lightCount(); }
+	uint32_t indexCount() const { return m_grid.indexCount(); }
+	uint32_t maxClusterLights() const { return m_grid.maxClusterLights(); }
+	uint32_t overflow() const { return m_grid.overflow(); }
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "Animator.h"
+#include "DynamicBVH.h"
+#include "EntityWorld.h"
+#include "Prefab.h"
+#include "SceneGraph.h"
+#include "TransformSystem.h"
+
+/**
+ * @brief The entity's transform, stored in the shared TransformSystem.
+ */
+struct TransformComponent {
+	TransformHandle handle;
+};
+
+/**
+ * @brief The scene graph node holding the entity's meshes, and whether they are drawn through the static batches.
+ */
+struct MeshRefComponent {
+	SceneHandle node;
+	bool isStatic = false;
+};
+
+/**
+ * @brief A placement of a shared prefab, and whether it is drawn through the static batches.
+ */
+struct PrefabComponent {
+	PrefabInstance instance;
+	bool isStatic = false;
+};
+
+/**
+ * @brief The entity's leaf in the spatial index, inserted once its bounds are first known.
+ */
+struct SpatialComponent {
+	int32_t proxy = DynamicBVH::Null;
+	// The exact bounds the leaf was last placed around.
+	AABB bounds;
+};
+
+/**
+ * @brief Marks the entity's meshes as occluders, rasterized into the occlusion buffer as they are. Simplified
+ * proxies such as the shadow ones may reach past the mesh and hide things that are in sight, so none are used.
+ */
+struct OccluderComponent {
+};
+
+/**
+ * @brief Marks an expensive entity whose camera draws wait on a GPU occlusion query of its bounding box.
+ */
+struct OcclusionQueryComponent {
+};
+
+/**
+ * @brief An animation sequence, ticked only while playing.
+ */
+struct AnimatorComponent {
+	Animator animator;
+	bool playing = false;
+};
+
+/**
+ * @brief Whether the entity is drawn at all.
+ */
+struct VisibilityComponent {
+	bool visible = true;
+};
+
+/**
+ * @brief Something the player can use from within a radius, which then starts the animation of another entity.
+ */
+struct InteractableComponent {
+	float radius = 0;
+	Entity reveals;
+};
@@ -0,0 +1,229 @@
+#include <algorithm>
+
+#include "DynamicBVH.h"
+
+const int32_t DynamicBVH::Null;
+
+DynamicBVH::DynamicBVH(float margin) : m_root(Null), m_free(Null), m_leafCount(0), m_margin(margin)
+{
+}
+
+float DynamicBVH::surfaceArea(const AABB& box)
+{
+	glm::vec3 size = box.max - box.min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+AABB DynamicBVH::merge(const AABB& a, const AABB& b)
+{
+	return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+}
+
+int32_t DynamicBVH::allocateNode()
+{
+	int32_t index;
+	if (m_free != Null)
+	{
+		index = m_free;
+		m_free = m_nodes[index].parent;
+	}
+	else
+	{
+		index = static_cast<int32_t>(m_nodes.size());
+		m_nodes.emplace_back();
+	}
+
+	Node& node = m_nodes[index];
+	node = Node();
+	node.height = 0;
+	return index;
+}
+
+void DynamicBVH::freeNode(int32_t index)
+{
+	m_nodes[index].height = -1;
+	m_nodes[index].parent = m_free;
+	m_free = index;
+}
+
+void DynamicBVH::refresh(int32_t index)
+{
+	Node& node = m_nodes[index];
+	const Node& child1 = m_nodes[node.child1];
+	const Node& child2 = m_nodes[node.child2];
+	node.box = merge(child1.box, child2.box);
+	node.height = 1 + std::max(child1.height, child2.height);
+	node.leaves = child1.leaves + child2.leaves;
+}
+
+int32_t DynamicBVH::balance(int32_t iA)
+{
+	Node& A = m_nodes[iA];
+	if (A.isLeaf() || A.height < 2)
+		return iA;
+
+	int32_t iB = A.child1;
+	int32_t iC = A.child2;
+	int32_t difference = m_nodes[iC].height - m_nodes[iB].height;
+	if (difference >= -1 && difference <= 1)
+		return iA;
+
+	//Rotate the taller child (up) into A's place; A takes over the up child's shorter grandchild
+	int32_t iUp = difference > 1 ? iC : iB;
+	Node& up = m_nodes[iUp];
+	int32_t iTall = up.child1, iShort = up.child2;
+	if (m_nodes[iTall].height < m_nodes[iShort].height)
+		std::swap(iTall, iShort);
+
+	up.parent = A.parent;
+	A.parent = iUp;
+	if (up.parent == Null)
+		m_root = iUp;
+	else if (m_nodes[up.parent].child1 == iA)
+		m_nodes[up.parent].child1 = iUp;
+	else
+		m_nodes[up.parent].child2 = iUp;
+
+	up.child1 = iA;
+	up.child2 = iTall;
+	if (iUp == iC)
+		A.child2 = iShort;
+	else
+		A.child1 = iShort;
+	m_nodes[iShort].parent = iA;
+
+	refresh(iA);
+	refresh(iUp);
+	return iUp;
+}
+
+void DynamicBVH::refitUpwards(int32_t index)
+{
+	while (index != Null)
+	{
+		index = balance(index);
+		refresh(index);
+		index = m_nodes[index].parent;
+	}
+}
+
+void DynamicBVH::insertLeaf(int32_t leaf)
+{
+	if (m_root == Null)
+	{
+		m_root = leaf;
+		m_nodes[leaf].parent = Null;
+		return;
+	}
+
+	//Descend towards the sibling whose pairing with the leaf adds the least surface area to the tree
+	AABB leafBox = m_nodes[leaf].box;
+	int32_t index = m_root;
+	while (!m_nodes[index].isLeaf())
+	{
+		const Node& node = m_nodes[index];
+		float area = surfaceArea(node.box);
+		float combinedArea = surfaceArea(merge(node.box, leafBox));
+
+		//Cost of pairing the leaf with this node, and the extra area every ancestor would take on descending further
+		float cost = 2.0f * combinedArea;
+		float inheritance = 2.0f * (combinedArea - area);
+
+		auto childCost = [&](int32_t child) {
+			const Node& c = m_nodes[child];
+			float merged = surfaceArea(merge(leafBox, c.box));
+			return (c.isLeaf() ? merged : merged - surfaceArea(c.box)) + inheritance;
+		};
+		float cost1 = childCost(node.child1);
+		float cost2 = childCost(node.child2);
+
+		if (cost < cost1 && cost < cost2)
+			break;
+		index = cost1 < cost2 ? node.child1 : node.child2;
+	}
+
+	//Pair the leaf with the chosen sibling under a new parent
+	int32_t sibling = index;
+	int32_t oldParent = m_nodes[sibling].parent;
+	int32_t newParent = allocateNode();
+	m_nodes[newParent].parent = oldParent;
+	m_nodes[newParent].child1 = sibling;
+	m_nodes[newParent].child2 = leaf;
+	m_nodes[sibling].parent = newParent;
+	m_nodes[leaf].parent = newParent;
+	refresh(newParent);
+
+	if (oldParent == Null)
+		m_root = newParent;
+	else if (m_nodes[oldParent].child1 == sibling)
+		m_nodes[oldParent].child1 = newParent;
+	else
+		m_nodes[oldParent].child2 = newParent;
+
+	refitUpwards(oldParent);
+}
+
+void DynamicBVH::removeLeaf(int32_t leaf)
+{
+	if (leaf == m_root)
+	{
+		m_root = Null;
+		return;
+	}
+
+	//The leaf's sibling takes its parent's place
+	int32_t parent = m_nodes[leaf].parent;
+	int32_t grandParent = m_nodes[parent].parent;
+	int32_t sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+	m_nodes[sibling].parent = grandParent;
+	if (grandParent == Null)
+		m_root = sibling;
+	else if (m_nodes[grandParent].child1 == parent)
+		m_nodes[grandParent].child1 = sibling;
+	else
+		m_nodes[grandParent].child2 = sibling;
+	freeNode(parent);
+
+	refitUpwards(grandParent);
+}
+
+int32_t DynamicBVH::insert(const AABB& box, uint32_t userData)
+{
+	int32_t proxy = allocateNode();
+	Node& node = m_nodes[proxy];
+	node.box = AABB(box.min - glm::vec3(m_margin), box.max + glm::vec3(m_margin));
+	node.userData = userData;
+	node.leaves = 1;
+	insertLeaf(proxy);
+	m_leafCount++;
+	return proxy;
+}
+
+void DynamicBVH::remove(int32_t proxy)
+{
+	removeLeaf(proxy);
+	freeNode(proxy);
+	m_leafCount--;
+}
+
+bool DynamicBVH::update(int32_t proxy, const AABB& box)
+{
+	Node& node = m_nodes[proxy];
+	if (node.box.contains(box))
+		return false;
+
+	AABB fat(box.min - glm::vec3(m_margin), box.max + glm::vec3(m_margin));
+
+	//Refit in place while the parent still encloses the leaf; its ancestors then need no change either
+	if (node.parent != Null && m_nodes[node.parent].box.contains(fat))
+	{
+		node.box = fat;
+		return true;
+	}
+
+	removeLeaf(proxy);
+	m_nodes[proxy].box = fat;
+	insertLeaf(proxy);
+	return true;
+}
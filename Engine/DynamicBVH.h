@@ -0,0 +1,279 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Bounds.h"
+#include "Frustum.h"
+
+/**
+ * @brief A dynamic bounding volume hierarchy: a balanced binary tree of boxes over objects that can be added,
+ * moved and removed at any time, answering box, sphere, frustum and ray queries in logarithmic time.
+ *
+ * Leaves store "fat" boxes, the object's bounds grown by a margin, so small movements need no change to the tree
+ * at all. A leaf whose object leaves its fat box is refitted in place when the new box still fits inside its
+ * parent, and otherwise removed and reinserted where it adds the least surface area. Every change is followed by
+ * AVL-style rotations that keep the tree balanced.
+ */
+class DynamicBVH {
+public:
+	static const int32_t Null = -1;
+
+private:
+	struct Node {
+		AABB box;
+		// The parent, or for free nodes the next free node.
+		int32_t parent = Null;
+		int32_t child1 = Null;
+		int32_t child2 = Null;
+		// Leaves are height 0; free nodes are -1.
+		int32_t height = -1;
+		// Leaves under this node.
+		uint32_t leaves = 0;
+		uint32_t userData = 0;
+
+		bool isLeaf() const { return child1 == Null; }
+	};
+
+	std::vector<Node> m_nodes;
+	int32_t m_root;
+	int32_t m_free;
+	uint32_t m_leafCount;
+	float m_margin;
+
+	// Queries walk the tree with a fixed stack; balancing keeps the height far below this.
+	static const int MaxStack = 256;
+
+	int32_t allocateNode();
+	void freeNode(int32_t index);
+	void insertLeaf(int32_t leaf);
+	void removeLeaf(int32_t leaf);
+	// Recomputes a node's box, height and leaf count from its children.
+	void refresh(int32_t index);
+	// Rotates the taller grandchild up if the node is unbalanced, returning whichever node is now in its place.
+	int32_t balance(int32_t index);
+	// Refreshes every node from the given one up to the root, balancing on the way.
+	void refitUpwards(int32_t index);
+
+	static float surfaceArea(const AABB& box);
+	static AABB merge(const AABB& a, const AABB& b);
+
+public:
+	/**
+	 * @brief Creates an empty tree whose leaves are grown by the given margin.
+	 */
+	explicit DynamicBVH(float margin = 0.25f);
+
+	/**
+	 * @brief Adds an object's bounds, returning the proxy that refers to it.
+	 */
+	int32_t insert(const AABB& box, uint32_t userData);
+	void remove(int32_t proxy);
+
+	/**
+	 * @brief Moves an object to new bounds. Returns true if the tree had to change.
+	 */
+	bool update(int32_t proxy, const AABB& box);
+
+	uint32_t userData(int32_t proxy) const { return m_nodes[proxy].userData; }
+	const AABB& fatBounds(int32_t proxy) const { return m_nodes[proxy].box; }
+	uint32_t size() const { return m_leafCount; }
+	int32_t height() const { return m_root == Null ? 0 : m_nodes[m_root].height; }
+	// The box around every object's fat bounds, empty while the tree is.
+	AABB bounds() const { return m_root == Null ? AABB() : m_nodes[m_root].box; }
+
+	/**
+	 * @brief Calls f(userData) for every object whose fat bounds overlap the box or sphere.
+	 */
+	template <typename F>
+	void query(const AABB& box, F&& f) const;
+	template <typename F>
+	void query(const BoundingSphere& sphere, F&& f) const;
+
+	/**
+	 * @brief Calls f(userData) for every object whose fat bounds may be inside the frustum. Subtrees entirely
+	 * inside are reported without testing their children.
+	 */
+	template <typename F>
+	void query(const Frustum& frustum, F&& f) const;
+
+	/**
+	 * @brief Calls f(userData, distance) for every object whose fat bounds the ray enters within maxDistance,
+	 * nearest boxes first along each branch. f returns the new maximum distance, so returning distance finds the
+	 * closest hit and returning a negative value stops the query.
+	 */
+	template <typename F>
+	void raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, F&& f) const;
+
+	/**
+	 * @brief Culls against several views at once. frusta is indexed by view and views selects which to test.
+	 * Calls visible(userData, viewMask) for objects at least one of them may see, with a bit set for each, and
+	 * culled(leafCount) for subtrees no view sees. When reportAll is set nothing is skipped, and objects no view
+	 * sees are passed to visible() with an empty mask.
+	 */
+	template <typename Visible, typename Culled>
+	void cull(const Frustum* frusta, uint32_t views, bool reportAll, Visible&& visible, Culled&& culled) const;
+};
+
+template <typename F>
+void DynamicBVH::query(const AABB& box, F&& f) const
+{
+	int32_t stack[MaxStack];
+	int count = 0;
+	if (m_root != Null)
+		stack[count++] = m_root;
+	while (count > 0)
+	{
+		const Node& node = m_nodes[stack[--count]];
+		if (!node.box.overlaps(box))
+			continue;
+		if (node.isLeaf())
+			f(node.userData);
+		else
+		{
+			stack[count++] = node.child1;
+			stack[count++] = node.child2;
+		}
+	}
+}
+
+template <typename F>
+void DynamicBVH::query(const BoundingSphere& sphere, F&& f) const
+{
+	int32_t stack[MaxStack];
+	int count = 0;
+	if (m_root != Null)
+		stack[count++] = m_root;
+	while (count > 0)
+	{
+		const Node& node = m_nodes[stack[--count]];
+		glm::vec3 closest = glm::clamp(sphere.center, node.box.min, node.box.max);
+		glm::vec3 offset = closest - sphere.center;
+		if (glm::dot(offset, offset) > sphere.radius * sphere.radius)
+			continue;
+		if (node.isLeaf())
+			f(node.userData);
+		else
+		{
+			stack[count++] = node.child1;
+			stack[count++] = node.child2;
+		}
+	}
+}
+
+template <typename F>
+void DynamicBVH::query(const Frustum& frustum, F&& f) const
+{
+	//Entries are (node, whether it is already known to be entirely inside)
+	int32_t stack[MaxStack];
+	bool inside[MaxStack];
+	int count = 0;
+	if (m_root != Null)
+	{
+		stack[count] = m_root;
+		inside[count++] = false;
+	}
+	while (count > 0)
+	{
+		count--;
+		const Node& node = m_nodes[stack[count]];
+		bool nodeInside = inside[count];
+		if (!nodeInside)
+		{
+			Frustum::Containment containment = frustum.classify(node.box);
+			if (containment == Frustum::Outside)
+				continue;
+			nodeInside = containment == Frustum::Inside;
+		}
+		if (node.isLeaf())
+			f(node.userData);
+		else
+		{
+			stack[count] = node.child1;
+			inside[count++] = nodeInside;
+			stack[count] = node.child2;
+			inside[count++] = nodeInside;
+		}
+	}
+}
+
+template <typename F>
+void DynamicBVH::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, F&& f) const
+{
+	glm::vec3 inverse = 1.0f / direction;
+
+	//Distance at which the ray enters a box, or a negative value if it misses within maxDistance
+	auto enter = [&](const AABB& box) {
+		glm::vec3 t1 = (box.min - origin) * inverse, t2 = (box.max - origin) * inverse;
+		glm::vec3 near = glm::min(t1, t2), far = glm::max(t1, t2);
+		float tNear = glm::max(glm::max(near.x, near.y), glm::max(near.z, 0.0f));
+		float tFar = glm::min(glm::min(far.x, far.y), glm::min(far.z, maxDistance));
+		return tNear <= tFar ? tNear : -1.0f;
+	};
+
+	int32_t stack[MaxStack];
+	int count = 0;
+	if (m_root != Null)
+		stack[count++] = m_root;
+	while (count > 0)
+	{
+		const Node& node = m_nodes[stack[--count]];
+		float distance = enter(node.box);
+		if (distance < 0)
+			continue;
+		if (node.isLeaf())
+		{
+			maxDistance = f(node.userData, distance);
+			if (maxDistance < 0)
+				return;
+		}
+		else
+		{
+			//Push the further child first so the nearer one is visited first
+			float d1 = enter(m_nodes[node.child1].box), d2 = enter(m_nodes[node.child2].box);
+			bool firstIsNear = d1 >= 0 && (d2 < 0 || d1 <= d2);
+			stack[count++] = firstIsNear ? node.child2 : node.child1;
+			stack[count++] = firstIsNear ? node.child1 : node.child2;
+		}
+	}
+}
+
+template <typename Visible, typename Culled>
+void DynamicBVH::cull(const Frustum* frusta, uint32_t views, bool reportAll, Visible&& visible, Culled&& culled) const
+{
+	//Entries are (node, views that may still see it, views known to see all of it)
+	struct Entry {
+		int32_t node;
+		uint32_t candidates;
+		uint32_t inside;
+	};
+	Entry stack[MaxStack];
+	int count = 0;
+	if (m_root != Null)
+		stack[count++] = { m_root, views, 0 };
+	while (count > 0)
+	{
+		Entry entry = stack[--count];
+		const Node& node = m_nodes[entry.node];
+		for (uint32_t test = entry.candidates & ~entry.inside; test != 0; test &= test - 1)
+		{
+			uint32_t view = glm::findLSB(test);
+			Frustum::Containment containment = frusta[view].classify(node.box);
+			if (containment == Frustum::Outside)
+				entry.candidates &= ~(1u << view);
+			else if (containment == Frustum::Inside)
+				entry.inside |= 1u << view;
+		}
+		if (entry.candidates == 0 && !reportAll)
+		{
+			culled(node.leaves);
+			continue;
+		}
+		if (node.isLeaf())
+			visible(node.userData, entry.candidates);
+		else
+		{
+			stack[count++] = { node.child1, entry.candidates, entry.inside };
+			stack[count++] = { node.child2, entry.candidates, entry.inside };
+		}
+	}
+}
@@ -0,0 +1,100 @@
+#include <atomic>
+#include <stdexcept>
+#include "EntityWorld.h"
+
+EntityWorld::EntityWorld() : m_count(0)
+{
+}
+
+uint32_t EntityWorld::nextComponentType()
+{
+	//A type's first query can come from any thread running a parallelEach(). Signatures are 32-bit masks, so a
+	//33rd type would shift past the end of one
+	static std::atomic<uint32_t> next(0);
+	uint32_t type = next++;
+	if (type >= MaxComponentTypes)
+		throw std::length_error("Too many component types for a 32-bit signature");
+	return type;
+}
+
+Entity EntityWorld::allocateEntity()
+{
+	Entity entity;
+	if (!m_free.empty())
+	{
+		entity.index = m_free.back();
+		m_free.pop_back();
+	}
+	else
+	{
+		entity.index = static_cast<uint32_t>(m_records.size());
+		m_records.emplace_back();
+	}
+
+	EntityRecord& record = m_records[entity.index];
+	record.alive = true;
+	entity.generation = record.generation;
+	m_count++;
+	return entity;
+}
+
+void EntityWorld::removeRow(uint32_t archetypeIndex, uint32_t row)
+{
+	Archetype& archetype = m_archetypes[archetypeIndex];
+	for (auto& column : archetype.columns)
+	{
+		if (column)
+			column->swapRemove(row);
+	}
+
+	Entity moved = archetype.entities.back();
+	archetype.entities[row] = moved;
+	archetype.entities.pop_back();
+	if (row < archetype.entities.size())
+		m_records[moved.index].row = row;
+}
+
+void EntityWorld::moveEntity(Entity entity, uint32_t target)
+{
+	EntityRecord& record = m_records[entity.index];
+	Archetype& from = m_archetypes[record.archetype];
+	Archetype& to = m_archetypes[target];
+	for (uint32_t type = 0; type < MaxComponentTypes; type++)
+	{
+		if (from.columns[type] && to.columns[type])
+			to.columns[type]->pushFrom(*from.columns[type], record.row);
+	}
+	removeRow(record.archetype, record.row);
+
+	record.archetype = target;
+	record.row = static_cast<uint32_t>(to.entities.size());
+	to.entities.push_back(entity);
+}
+
+void EntityWorld::destroy(Entity entity)
+{
+	if (!alive(entity))
+		return;
+	EntityRecord& record = m_records[entity.index];
+	removeRow(record.archetype, record.row);
+	record.alive = false;
+	record.generation++;
+	m_free.push_back(entity.index);
+	m_count--;
+}
+
+Entity EntityWorld::entityAt(uint32_t index) const
+{
+	Entity entity;
+	if (index < m_records.size() && m_records[index].alive)
+	{
+		entity.index = index;
+		entity.generation = m_records[index].generation;
+	}
+	return entity;
+}
+
+bool EntityWorld::alive(Entity entity) const
+{
+	return entity.index < m_records.size() && m_records[entity.index].alive && m_records[entity.index].generation == entity.generation;
+}
@@ -0,0 +1,285 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "JobSystem.h"
+
+/**
+ * @brief Refers to an entity in an EntityWorld. The generation is bumped when the entity is destroyed, so stale
+ * references can be told apart from whatever later reuses the slot.
+ */
+struct Entity {
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+
+	bool valid() const { return index != UINT32_MAX; }
+	bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+/**
+ * @brief Stores entities' components grouped by archetype, the exact set of component types an entity has.
+ *
+ * Each archetype keeps one tightly packed array per component type, with an entity's components at the same row in
+ * every array, so a query walks memory linearly and never looks at entities lacking a component it asked for.
+ * Adding or removing a component moves the entity's row to another archetype; doing so, or creating or destroying
+ * entities, is not allowed while a query is running.
+ */
+class EntityWorld {
+public:
+	// Component types one world can hold; each gets a bit in an archetype's signature. Using one more throws
+	// std::length_error.
+	static const uint32_t MaxComponentTypes = 32;
+
+private:
+	// One archetype's array of one component type, with the operations that move rows between archetypes.
+	struct ColumnBase {
+		virtual ~ColumnBase() {}
+		virtual std::unique_ptr<ColumnBase> emptyCopy() const = 0;
+		// Moves row from another column of the same type onto the end of this one.
+		virtual void pushFrom(ColumnBase& other, uint32_t row) = 0;
+		// Removes a row by moving the last row into its place.
+		virtual void swapRemove(uint32_t row) = 0;
+	};
+
+	template <typename T>
+	struct Column : ColumnBase {
+		std::vector<T> data;
+
+		std::unique_ptr<ColumnBase> emptyCopy() const override { return std::make_unique<Column<T>>(); }
+		void pushFrom(ColumnBase& other, uint32_t row) override { data.push_back(std::move(static_cast<Column<T>&>(other).data[row])); }
+		void swapRemove(uint32_t row) override
+		{
+			if (row + 1 != data.size())
+				data[row] = std::move(data.back());
+			data.pop_back();
+		}
+	};
+
+	struct Archetype {
+		uint32_t signature = 0;
+		std::vector<Entity> entities;
+		// Indexed by component type id; empty for types the archetype does not have.
+		std::unique_ptr<ColumnBase> columns[MaxComponentTypes];
+	};
+
+	struct EntityRecord {
+		uint32_t archetype = 0;
+		uint32_t row = 0;
+		uint32_t generation = 0;
+		bool alive = false;
+	};
+
+	std::vector<Archetype> m_archetypes;
+	std::unordered_map<uint32_t, uint32_t> m_archetypeBySignature;
+	std::vector<EntityRecord> m_records;
+	std::vector<uint32_t> m_free;
+	uint32_t m_count;
+
+	static uint32_t nextComponentType();
+
+	template <typename T>
+	static uint32_t componentType()
+	{
+		static const uint32_t type = nextComponentType();
+		return type;
+	}
+
+	template <typename T>
+	static std::vector<T>& column(Archetype& archetype) { return static_cast<Column<T>*>(archetype.columns[componentType<T>()].get())->data; }
+
+	template <typename... Ts>
+	static uint32_t signatureOf() { return (0u | ... | (1u << componentType<Ts>())); }
+
+	// Finds the archetype with the given signature, or creates it with columns copied from a prototype archetype
+	// (minus any types not in the signature) plus those made by makeColumns.
+	template <typename MakeColumns>
+	uint32_t findOrCreateArchetype(uint32_t signature, const Archetype* prototype, MakeColumns&& makeColumns);
+
+	Entity allocateEntity();
+	// Moves an entity's row into another archetype, dropping components the target lacks.
+	void moveEntity(Entity entity, uint32_t target);
+	// Removes a row from an archetype, fixing the record of the entity moved into its place.
+	void removeRow(uint32_t archetype, uint32_t row);
+
+public:
+	EntityWorld();
+	EntityWorld(const EntityWorld&) = delete;
+	EntityWorld& operator=(const EntityWorld&) = delete;
+
+	/**
+	 * @brief Creates an entity with the given components, placed straight into its archetype.
+	 */
+	template <typename... Ts>
+	Entity create(Ts&&... components);
+
+	void destroy(Entity entity);
+	bool alive(Entity entity) const;
+
+	/**
+	 * @brief The live entity at an index, for indices stored outside the world, or an invalid entity.
+	 */
+	Entity entityAt(uint32_t index) const;
+
+	/**
+	 * @brief Gives an entity another component, or replaces the one it has. Throws std::out_of_range if the entity
+	 * is stale.
+	 */
+	template <typename T>
+	T& add(Entity entity, T&& component);
+
+	template <typename T>
+	void remove(Entity entity);
+
+	/**
+	 * @brief An entity's component, or nullptr if it is stale or has no such component.
+	 */
+	template <typename T>
+	T* get(Entity entity);
+
+	template <typename T>
+	bool has(Entity entity) const;
+
+	/**
+	 * @brief Calls f(entity, components...) for every entity having all the given component types.
+	 */
+	template <typename... Ts, typename F>
+	void each(F&& f);
+
+	/**
+	 * @brief Like each(), but rows are split across the job system's threads. f must only touch the entity it is
+	 * given.
+	 */
+	template <typename... Ts, typename F>
+	void parallelEach(JobSystem& jobs, F&& f, uint32_t grain = 256);
+
+	uint32_t size() const { return m_count; }
+	uint32_t archetypeCount() const { return static_cast<uint32_t>(m_archetypes.size()); }
+};
+
+template <typename MakeColumns>
+uint32_t EntityWorld::findOrCreateArchetype(uint32_t signature, const Archetype* prototype, MakeColumns&& makeColumns)
+{
+	auto found = m_archetypeBySignature.find(signature);
+	if (found != m_archetypeBySignature.end())
+		return found->second;
+
+	Archetype archetype;
+	archetype.signature = signature;
+	if (prototype)
+	{
+		for (uint32_t type = 0; type < MaxComponentTypes; type++)
+		{
+			if (prototype->columns[type] && (signature & (1u << type)))
+				archetype.columns[type] = prototype->columns[type]->emptyCopy();
+		}
+	}
+	makeColumns(archetype);
+
+	uint32_t index = static_cast<uint32_t>(m_archetypes.size());
+	m_archetypes.push_back(std::move(archetype));
+	m_archetypeBySignature[signature] = index;
+	return index;
+}
+
+template <typename... Ts>
+Entity EntityWorld::create(Ts&&... components)
+{
+	uint32_t archetypeIndex = findOrCreateArchetype(signatureOf<std::decay_t<Ts>...>(), nullptr, [](Archetype& archetype) {
+		((archetype.columns[componentType<std::decay_t<Ts>>()] = std::make_unique<Column<std::decay_t<Ts>>>()), ...);
+	});
+
+	Entity entity = allocateEntity();
+	Archetype& archetype = m_archetypes[archetypeIndex];
+	(column<std::decay_t<Ts>>(archetype).push_back(std::forward<Ts>(components)), ...);
+
+	EntityRecord& record = m_records[entity.index];
+	record.archetype = archetypeIndex;
+	record.row = static_cast<uint32_t>(archetype.entities.size());
+	archetype.entities.push_back(entity);
+	return entity;
+}
+
+template <typename T>
+T& EntityWorld::add(Entity entity, T&& component)
+{
+	typedef std::decay_t<T> C;
+	if (!alive(entity))
+		throw std::out_of_range("Stale entity");
+	if (C* existing = get<C>(entity))
+		return *existing = std::forward<T>(component);
+
+	const EntityRecord& record = m_records[entity.index];
+	uint32_t signature = m_archetypes[record.archetype].signature | signatureOf<C>();
+	uint32_t target = findOrCreateArchetype(signature, &m_archetypes[record.archetype], [](Archetype& archetype) {
+		archetype.columns[componentType<C>()] = std::make_unique<Column<C>>();
+	});
+	moveEntity(entity, target);
+
+	std::vector<C>& components = column<C>(m_archetypes[target]);
+	components.push_back(std::forward<T>(component));
+	return components.back();
+}
+
+template <typename T>
+void EntityWorld::remove(Entity entity)
+{
+	//has() is false for stale entities, so their records are never read
+	if (!has<T>(entity))
+		return;
+	const EntityRecord& record = m_records[entity.index];
+	uint32_t signature = m_archetypes[record.archetype].signature & ~signatureOf<T>();
+	moveEntity(entity, findOrCreateArchetype(signature, &m_archetypes[record.archetype], [](Archetype&) {}));
+}
+
+template <typename T>
+T* EntityWorld::get(Entity entity)
+{
+	if (!has<T>(entity))
+		return nullptr;
+	const EntityRecord& record = m_records[entity.index];
+	return &column<T>(m_archetypes[record.archetype])[record.row];
+}
+
+template <typename T>
+bool EntityWorld::has(Entity entity) const
+{
+	return alive(entity) && (m_archetypes[m_records[entity.index].archetype].signature & signatureOf<T>()) != 0;
+}
+
+template <typename... Ts, typename F>
+void EntityWorld::each(F&& f)
+{
+	uint32_t signature = signatureOf<Ts...>();
+	for (auto& archetype : m_archetypes)
+	{
+		if ((archetype.signature & signature) != signature)
+			continue;
+		const Entity* entities = archetype.entities.data();
+		auto arrays = std::make_tuple(column<Ts>(archetype).data()...);
+		uint32_t rows = static_cast<uint32_t>(archetype.entities.size());
+		for (uint32_t row = 0; row < rows; row++)
+			f(entities[row], std::get<Ts*>(arrays)[row]...);
+	}
+}
+
+template <typename... Ts, typename F>
+void EntityWorld::parallelEach(JobSystem& jobs, F&& f, uint32_t grain)
+{
+	uint32_t signature = signatureOf<Ts...>();
+	for (auto& archetype : m_archetypes)
+	{
+		if ((archetype.signature & signature) != signature)
+			continue;
+		const Entity* entities = archetype.entities.data();
+		auto arrays = std::make_tuple(column<Ts>(archetype).data()...);
+		jobs.parallelFor(static_cast<uint32_t>(archetype.entities.size()), grain, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t row = begin; row < end; row++)
+				f(entities[row], std::get<Ts*>(arrays)[row]...);
+		});
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+/**
+ * @brief Counters gathered while rendering a frame, shown in the window title.
+ */
+struct FrameStats {
+	// Meshes queued for drawing and the GL draw calls they were submitted with, over all passes.
+	uint32_t meshesDrawn = 0;
+	uint32_t drawCalls = 0;
+
+	// Draws the camera kept and culled, of which some were hidden by occluders, and the occluder triangles.
+	uint32_t visibleMeshes = 0;
+	uint32_t culledMeshes = 0;
+	uint32_t occludedMeshes = 0;
+	uint32_t occluderTriangles = 0;
+
+	// GPU occlusion queries issued, and queried objects the latest results found hidden.
+	uint32_t occlusionQueries = 0;
+	uint32_t queryHidden = 0;
+
+	// World matrices recomputed because their transform or a parent's changed.
+	uint32_t matricesRebuilt = 0;
+
+	// Draws the shadow caster volume kept and culled, and the triangles rendered into the shadow map.
+	uint32_t shadowCasters = 0;
+	uint32_t shadowCastersCulled = 0;
+	uint32_t shadowTriangles = 0;
+
+	// Cascades whose cached static shadows were rendered this frame, and how often any was invalidated in total.
+	uint32_t shadowCacheRefreshes = 0;
+	uint32_t shadowCacheInvalidations = 0;
+	// Texels the cascades rendered into, as each is sized for how much of the screen its texels cover.
+	uint32_t cascadeTexels = 0;
+	// Point light cube faces rendered again because a caster moved through them, and the share of the shadow atlas
+	// allocated.
+	uint32_t pointShadowFaces = 0;
+	float shadowAtlasUsage = 0;
+	// Virtual shadow map pages rendered this frame, pages visible pixels asked for, and pages in the physical pool.
+	uint32_t virtualPagesRendered = 0;
+	uint32_t virtualPagesRequested = 0;
+	uint32_t virtualPagesResident = 0;
+
+	// Point lights, the light indices over all clusters, and the most lights any one cluster shades.
+	uint32_t pointLights = 0;
+	uint32_t clusterLightIndices = 0;
+	uint32_t maxClusterLights = 0;
+
+	// Camera draws the depth prepass laid down depth for, and the triangles it drew.
+	uint32_t prepassDraws = 0;
+	uint32_t prepassTriangles = 0;
+
+	// GPU time of the shaded pass, from a few frames ago. With deferred shading that pass only fills the G-buffer,
+	// and the lighting pass over the screen is timed apart.
+	float shadedMs = 0;
+	float lightingMs = 0;
+
+	// Per-frame data written to the stream buffer, the room a frame has in it, and time spent waiting on its fences.
+	size_t bytesStreamed = 0;
+	size_t streamFrameSize = 0;
+	float fenceWaitMs = 0;
+
+	std::string summary() const
+	{
+		std::ostringstream out;
+		out.setf(std::ios::fixed);
+		out.precision(2);
+		out << meshesDrawn << " meshes in " << drawCalls << " draw calls | "
+			<< visibleMeshes << " visible, " << culledMeshes << " culled (" << occludedMeshes << " occluded by "
+			<< occluderTriangles << " triangles) | "
+			<< occlusionQueries << " queries, " << queryHidden << " hidden | "
+			<< matricesRebuilt << " matrices rebuilt | "
+			<< shadowCasters << " shadow casters, " << shadowCastersCulled << " culled, "
+			<< shadowTriangles / 1000.0f << "k shadow triangles, " << shadowCacheRefreshes << " cached cascades redrawn ("
+			<< shadowCacheInvalidations << " invalidations), " << cascadeTexels / 1048576.0f << "M cascade texels, " << pointShadowFaces << " point shadow faces, "
+			<< shadowAtlasUsage * 100.0f << "% of atlas, " << virtualPagesRendered << " virtual pages rendered ("
+			<< virtualPagesRequested << " requested, " << virtualPagesResident << " resident) | "
+			<< pointLights << " point lights, " << clusterLightIndices << " cluster indices, " << maxClusterLights << " most per cluster | "
+			<< prepassDraws << " prepassed draws, " << prepassTriangles / 1000.0f << "k prepass triangles | "
+			<< shadedMs << " ms shaded, " << lightingMs << " ms lighting | "
+			<< bytesStreamed / 1024.0f << " KB streamed of " << streamFrameSize / 1024 << " KB, " << fenceWaitMs << " ms fence wait";
+		return out.str();
+	}
+};
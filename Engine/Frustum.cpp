@@ -0,0 +1,135 @@
+#include <immintrin.h>
+
+#include "Frustum.h"
+
+Frustum::Frustum() : planeCount(0)
+{
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection) : planeCount(PlaneCount)
+{
+	//Rows of the matrix; glm stores columns
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	planes[Left] = row[3] + row[0];
+	planes[Right] = row[3] - row[0];
+	planes[Bottom] = row[3] + row[1];
+	planes[Top] = row[3] - row[1];
+	planes[Near] = row[3] + row[2];
+	planes[Far] = row[3] - row[2];
+	for (uint32_t i = 0; i < planeCount; i++)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+Frustum Frustum::shadowCasters(const glm::mat4& lightSpace, const Frustum& camera, const glm::vec3& lightDirection, float reach)
+{
+	Frustum light(lightSpace);
+	Frustum result;
+	for (uint32_t i = 0; i < light.planeCount; i++)
+	{
+		if (i != Near)
+			result.planes[result.planeCount++] = light.planes[i];
+	}
+
+	//A box swept along the light is behind a plane only if both its start and end are. The end is further along
+	//the normal by dot(normal, sweep) when that is positive, so moving the plane back by as much tests the sweep
+	glm::vec3 sweep = glm::normalize(lightDirection) * reach;
+	for (uint32_t i = 0; i < camera.planeCount; i++)
+	{
+		glm::vec4 plane = camera.planes[i];
+		plane.w += glm::max(glm::dot(glm::vec3(plane), sweep), 0.0f);
+		result.planes[result.planeCount++] = plane;
+	}
+	return result;
+}
+
+bool Frustum::intersects(const AABB& box) const
+{
+	if (box.empty())
+		return false;
+	glm::vec3 center = box.center(), extent = box.extent();
+	for (uint32_t i = 0; i < planeCount; i++)
+	{
+		const glm::vec4& plane = planes[i];
+		//The box is outside if even its corner furthest along the plane normal is behind the plane
+		glm::vec3 normal = glm::vec3(plane);
+		if (glm::dot(normal, center) + glm::dot(glm::abs(normal), extent) + plane.w < 0)
+			return false;
+	}
+	return true;
+}
+
+Frustum::Containment Frustum::classify(const AABB& box) const
+{
+	if (box.empty())
+		return Outside;
+	glm::vec3 center = box.center(), extent = box.extent();
+	Containment result = Inside;
+	for (uint32_t i = 0; i < planeCount; i++)
+	{
+		const glm::vec4& plane = planes[i];
+		glm::vec3 normal = glm::vec3(plane);
+		float distance = glm::dot(normal, center) + plane.w;
+		float radius = glm::dot(glm::abs(normal), extent);
+		if (distance + radius < 0)
+			return Outside;
+		if (distance - radius < 0)
+			result = Intersecting;
+	}
+	return result;
+}
+
+bool Frustum::intersects(const BoundingSphere& sphere) const
+{
+	if (sphere.empty())
+		return false;
+	for (uint32_t i = 0; i < planeCount; i++)
+	{
+		const glm::vec4& plane = planes[i];
+		if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+			return false;
+	}
+	return true;
+}
+
+void Frustum::cull(const AABB* boxes, uint32_t count, uint8_t* visible) const
+{
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		//Centers and extents of four boxes, one component per register
+		alignas(16) float c[3][4], e[3][4];
+		for (int b = 0; b < 4; b++)
+		{
+			const AABB& box = boxes[i + b];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				c[axis][b] = (box.min[axis] + box.max[axis]) * 0.5f;
+				e[axis][b] = (box.max[axis] - box.min[axis]) * 0.5f;
+			}
+		}
+		__m128 cx = _mm_load_ps(c[0]), cy = _mm_load_ps(c[1]), cz = _mm_load_ps(c[2]);
+		__m128 ex = _mm_load_ps(e[0]), ey = _mm_load_ps(e[1]), ez = _mm_load_ps(e[2]);
+
+		//Empty boxes have negative extents, which the plane test alone would not catch
+		__m128 inside = _mm_cmpge_ps(ex, _mm_setzero_ps());
+		for (uint32_t p = 0; p < planeCount; p++)
+		{
+			const glm::vec4& plane = planes[p];
+			__m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+			__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(glm::abs(plane.x)), ex), _mm_mul_ps(_mm_set1_ps(glm::abs(plane.y)), ey)),
+				_mm_mul_ps(_mm_set1_ps(glm::abs(plane.z)), ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int b = 0; b < 4; b++)
+			visible[i + b] = (mask >> b) & 1;
+	}
+
+	for (; i < count; i++)
+		visible[i] = intersects(boxes[i]) ? 1 : 0;
+}
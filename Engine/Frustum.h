@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+
+/**
+ * @brief The planes bounding what a camera (or light) projection can see.
+ *
+ * Planes are extracted from a view-projection matrix (Gribb and Hartmann) and normalized, with normals facing
+ * inwards, so a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0. A frustum from a matrix has the
+ * six planes in Plane order; other convex volumes, such as the region shadow casters must lie in, may have up to
+ * MaxPlanes.
+ */
+struct Frustum {
+	enum Plane { Left, Right, Bottom, Top, Near, Far, PlaneCount };
+	enum Containment { Outside, Intersecting, Inside };
+	static const uint32_t MaxPlanes = 12;
+
+	glm::vec4 planes[MaxPlanes];
+	uint32_t planeCount;
+
+	// An unbounded frustum, without planes.
+	Frustum();
+	explicit Frustum(const glm::mat4& viewProjection);
+
+	/**
+	 * @brief The region holding every object that can cast a shadow onto what the camera sees, for a directional
+	 * light shining along lightDirection whose shadows reach at most reach units.
+	 *
+	 * It is the light's frustum without its near plane, since casters between the light and the near plane still
+	 * shadow the volume (the shadow pass clamps their depth), intersected with the camera's frustum pushed back
+	 * against the light so that it holds every box whose sweep along the light direction enters the camera's view.
+	 */
+	static Frustum shadowCasters(const glm::mat4& lightSpace, const Frustum& camera, const glm::vec3& lightDirection, float reach);
+
+	/**
+	 * @brief Whether any part of the box or sphere may be inside. Boxes straddling a corner outside the frustum
+	 * can pass; they are never wrongly rejected.
+	 */
+	bool intersects(const AABB& box) const;
+	bool intersects(const BoundingSphere& sphere) const;
+
+	/**
+	 * @brief Whether a box is outside, partly inside or entirely inside, so hierarchies can stop testing below
+	 * boxes that are entirely inside.
+	 */
+	Containment classify(const AABB& box) const;
+
+	/**
+	 * @brief Tests many boxes at once, four per SSE batch, setting visible[i] to 1 for boxes that intersect and 0
+	 * for those that do not. Empty boxes are never visible.
+	 */
+	void cull(const AABB* boxes, uint32_t count, uint8_t* visible) const;
+};
@@ -0,0 +1,98 @@
+#include "GBuffer.h"
+
+namespace {
+	uint32_t createTarget(GLenum internalFormat, GLenum format, GLenum type, uint32_t width, uint32_t height)
+	{
+		//Read texel by texel, so never filtered
+		uint32_t texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+}
+
+GBuffer::GBuffer(uint32_t width, uint32_t height) : m_width(width), m_height(height)
+{
+	m_albedoTexture = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, m_width, m_height);
+	m_normalTexture = createTarget(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, m_width, m_height);
+	m_materialTexture = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, m_width, m_height);
+	m_depthTexture = createTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT, m_width, m_height);
+
+	glGenFramebuffers(1, &m_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_albedoTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_normalTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_materialTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, drawBuffers);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenVertexArrays(1, &m_vao);
+}
+
+GBuffer::~GBuffer()
+{
+	glDeleteVertexArrays(1, &m_vao);
+	glDeleteFramebuffers(1, &m_fbo);
+	glDeleteTextures(1, &m_albedoTexture);
+	glDeleteTextures(1, &m_normalTexture);
+	glDeleteTextures(1, &m_materialTexture);
+	glDeleteTextures(1, &m_depthTexture);
+}
+
+void GBuffer::bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glViewport(0, 0, m_width, m_height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void GBuffer::setUniforms(Shader& shader, const glm::mat4& viewProjection) const
+{
+	shader.setUniform("gAlbedo", AlbedoUnit);
+	shader.setUniform("gNormal", NormalUnit);
+	shader.setUniform("gMaterial", MaterialUnit);
+	shader.setUniform("gDepth", DepthUnit);
+	shader.setUniform("inverseViewProjection", glm::inverse(viewProjection));
+}
+
+void GBuffer::bindTextures() const
+{
+	glActiveTexture(GL_TEXTURE0 + AlbedoUnit);
+	glBindTexture(GL_TEXTURE_2D, m_albedoTexture);
+	glActiveTexture(GL_TEXTURE0 + NormalUnit);
+	glBindTexture(GL_TEXTURE_2D, m_normalTexture);
+	glActiveTexture(GL_TEXTURE0 + MaterialUnit);
+	glBindTexture(GL_TEXTURE_2D, m_materialTexture);
+	glActiveTexture(GL_TEXTURE0 + DepthUnit);
+	glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void GBuffer::unbindTextures() const
+{
+	for (int32_t unit : { AlbedoUnit, NormalUnit, MaterialUnit, DepthUnit })
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void GBuffer::draw() const
+{
+	//The vertex shader places one triangle covering the screen from gl_VertexID
+	glDepthFunc(GL_ALWAYS);
+	glBindVertexArray(m_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glDepthFunc(GL_LESS);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+
+#include "Shader.h"
+
+/**
+ * @brief The surfaces the camera sees, for deferred shading: the geometry pass writes every pixel's albedo, normal
+ * and material into a compact G-buffer, and lighting is then evaluated once per pixel over the screen, however many
+ * surfaces were drawn over each other there.
+ *
+ * Each pixel takes 16 bytes. Albedo is RGBA8. The normal is RG16, folded onto an octahedron. The material is RGBA8
+ * holding ambient, diffuse and specular in [0, 1] and log2(shininess) / 8. Positions are not stored but rebuilt
+ * from the depth texture.
+ *
+ * Each frame: bind() and draw the scene with the G-buffer shaders, then with the default frame buffer bound, on the
+ * lighting shader setUniforms() and bindTextures(), and draw() the lighting over the screen.
+ */
+class GBuffer {
+public:
+	// Texture units the lighting pass reads the G-buffer from, after those of the forward shading.
+	static const int32_t AlbedoUnit = 8;
+	static const int32_t NormalUnit = 9;
+	static const int32_t MaterialUnit = 10;
+	static const int32_t DepthUnit = 11;
+	static const uint32_t BytesPerPixel = 16;
+
+private:
+	uint32_t m_width, m_height;
+	uint32_t m_fbo;
+	uint32_t m_albedoTexture;
+	uint32_t m_normalTexture;
+	uint32_t m_materialTexture;
+	uint32_t m_depthTexture;
+	// Core profiles draw nothing without a vertex array, even a triangle made up in the vertex shader.
+	uint32_t m_vao;
+
+public:
+	GBuffer(uint32_t width, uint32_t height);
+	GBuffer(const GBuffer&) = delete;
+	GBuffer& operator=(const GBuffer&) = delete;
+	~GBuffer();
+
+	/**
+	 * @brief Binds the G-buffer with the viewport over it and clears it.
+	 */
+	void bind();
+
+	/**
+	 * @brief Sets the G-buffer's units and how to rebuild positions from depth on the lighting shader.
+	 */
+	void setUniforms(Shader& shader, const glm::mat4& viewProjection) const;
+
+	/**
+	 * @brief Binds the G-buffer's textures to their units, or unbinds them.
+	 */
+	void bindTextures() const;
+	void unbindTextures() const;
+
+	/**
+	 * @brief Draws one triangle over the screen with the active lighting shader. Every pixel passes the depth test,
+	 * so the shader's depth replaces the bound frame buffer's.
+	 */
+	void draw() const;
+
+	uint32_t width() const { return m_width; }
+	uint32_t height() const { return m_height; }
+};
@@ -0,0 +1,45 @@
+#include "GLExtensions.h"
+#include <SDL2/SDL.h>
+#include <cstring>
+#include <iostream>
+
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glad_glMultiDrawElementsIndirect = nullptr;
+PFNGLBUFFERSTORAGEPROC glad_glBufferStorage = nullptr;
+
+GLCapabilities glCaps;
+
+static bool hasVersion(int major, int minor)
+{
+	return GLVersion.major > major || (GLVersion.major == major && GLVersion.minor >= minor);
+}
+
+bool hasGLExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (extension != nullptr && std::strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+void loadGLExtensions()
+{
+	//Multi-draw indirect is only useful to us if baseInstance is honoured, since that is how the draw ID reaches the shader
+	bool multiDraw = hasVersion(4, 3) || hasGLExtension("GL_ARB_multi_draw_indirect");
+	bool baseInstance = hasVersion(4, 2) || hasGLExtension("GL_ARB_base_instance");
+	if (multiDraw && baseInstance)
+		glad_glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)SDL_GL_GetProcAddress("glMultiDrawElementsIndirect");
+	glCaps.multiDrawIndirect = glad_glMultiDrawElementsIndirect != nullptr;
+
+	if (hasVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage"))
+		glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)SDL_GL_GetProcAddress("glBufferStorage");
+	glCaps.bufferStorage = glad_glBufferStorage != nullptr;
+
+	std::cout << "OpenGL " << GLVersion.major << "." << GLVersion.minor
+		<< ", multi-draw indirect: " << (glCaps.multiDrawIndirect ? "yes" : "no (base vertex fallback)")
+		<< ", persistent mapping: " << (glCaps.bufferStorage ? "yes" : "no (unsynchronized map fallback)") << "\n";
+}
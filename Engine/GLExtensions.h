@@ -0,0 +1,46 @@
+#pragma once
+#include <glad/glad.h>
+
+/*
+ * glad was generated for the OpenGL 3.3 core profile only. The entry points and enums below are newer
+ * than that and are loaded by hand in loadGLExtensions(); they stay null when the driver lacks them,
+ * so always check glCaps before calling one.
+ */
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+extern PFNGLMULTIDRAWELEMENTSINDIRECTPROC glad_glMultiDrawElementsIndirect;
+#define glMultiDrawElementsIndirect glad_glMultiDrawElementsIndirect
+
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+extern PFNGLBUFFERSTORAGEPROC glad_glBufferStorage;
+#define glBufferStorage glad_glBufferStorage
+
+struct GLCapabilities {
+	// glMultiDrawElementsIndirect with a usable baseInstance (GL 4.3, or ARB_multi_draw_indirect + ARB_base_instance)
+	bool multiDrawIndirect = false;
+	// glBufferStorage, for persistently mapped buffers (GL 4.4 or ARB_buffer_storage)
+	bool bufferStorage = false;
+};
+
+extern GLCapabilities glCaps;
+
+/**
+ * @brief Returns true if the current context advertises the named extension.
+ */
+bool hasGLExtension(const char* name);
+
+/**
+ * @brief Loads the post-3.3 entry points above and fills in glCaps. Call once after gladLoadGLLoader.
+ */
+void loadGLExtensions();
@@ -0,0 +1,43 @@
+#include "GpuTimer.h"
+
+GpuTimer::GpuTimer() : m_next(0), m_lastMs(0.0f), m_samples(0)
+{
+	glGenQueries(Latency, m_queries);
+	for (uint32_t i = 0; i < Latency; i++)
+		m_pending[i] = false;
+}
+
+GpuTimer::~GpuTimer()
+{
+	glDeleteQueries(Latency, m_queries);
+}
+
+void GpuTimer::begin()
+{
+	//Read back finished queries, oldest first, without waiting on any
+	for (uint32_t i = 0; i < Latency; i++)
+	{
+		uint32_t index = (m_next + i) % Latency;
+		if (!m_pending[index])
+			continue;
+		GLint available = 0;
+		glGetQueryObjectiv(m_queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(m_queries[index], GL_QUERY_RESULT, &nanoseconds);
+		m_lastMs = nanoseconds / 1000000.0f;
+		m_samples++;
+		m_pending[index] = false;
+	}
+
+	//If the oldest query is still in flight its result is dropped rather than waited for
+	glBeginQuery(GL_TIME_ELAPSED, m_queries[m_next]);
+	m_pending[m_next] = true;
+}
+
+void GpuTimer::end()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	m_next = (m_next + 1) % Latency;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+
+/**
+ * @brief Measures the GPU time of a span of commands with GL_TIME_ELAPSED queries.
+ *
+ * Each begin()/end() pair uses the next of a ring of queries, and a result is only read once the GPU has
+ * finished with it, a few frames later, so timing never stalls the pipeline. Only one timer may be running at
+ * a time.
+ */
+class GpuTimer {
+public:
+	static const uint32_t Latency = 4;
+
+private:
+	uint32_t m_queries[Latency];
+	bool m_pending[Latency];
+	uint32_t m_next;
+	float m_lastMs;
+	uint32_t m_samples;
+
+public:
+	GpuTimer();
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+	~GpuTimer();
+
+	/**
+	 * @brief Starts timing, first reading back any results that have arrived.
+	 */
+	void begin();
+	void end();
+
+	// The latest time read back, in milliseconds, and how many have been read since creation.
+	float lastMs() const { return m_lastMs; }
+	uint32_t samples() const { return m_samples; }
+};
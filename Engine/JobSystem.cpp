@@ -0,0 +1,103 @@
+#include <algorithm>
+
+#include "JobSystem.h"
+
+JobSystem::JobSystem(uint32_t workerCount) : m_body(nullptr), m_count(0), m_grain(1), m_nextChunk(0), m_pendingChunks(0),
+	m_generation(0), m_activeWorkers(0), m_quit(false)
+{
+	for (uint32_t i = 0; i < workerCount; i++)
+		m_workers.emplace_back(&JobSystem::workerLoop, this);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (auto& worker : m_workers)
+		worker.join();
+}
+
+void JobSystem::runChunks(const std::function<void(uint32_t, uint32_t)>& body, uint32_t count, uint32_t grain)
+{
+	uint32_t chunks = (count + grain - 1) / grain;
+	for (uint32_t chunk = m_nextChunk++; chunk < chunks; chunk = m_nextChunk++)
+	{
+		uint32_t begin = chunk * grain;
+		body(begin, std::min(begin + grain, count));
+		if (--m_pendingChunks == 0)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_done.notify_all();
+		}
+	}
+}
+
+void JobSystem::workerLoop()
+{
+	uint64_t seen = 0;
+	while (true)
+	{
+		const std::function<void(uint32_t, uint32_t)>* body;
+		uint32_t count, grain;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&]() { return m_quit || m_generation != seen; });
+			if (m_quit)
+				return;
+			seen = m_generation;
+
+			//A worker waking late may find the loop already over and the next one not yet started; it must not
+			//touch the loop's state, which the next parallelFor() is free to reset
+			if (m_body == nullptr)
+				continue;
+			body = m_body;
+			count = m_count;
+			grain = m_grain;
+			m_activeWorkers++;
+		}
+
+		runChunks(*body, count, grain);
+
+		//The caller may only return, and start another loop, once no worker can still touch this one
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_activeWorkers == 0)
+			m_done.notify_all();
+	}
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t begin, uint32_t end)>& body)
+{
+	grain = std::max(grain, 1u);
+	if (count <= grain || m_workers.empty())
+	{
+		if (count > 0)
+			body(0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_body = &body;
+		m_count = count;
+		m_grain = grain;
+		m_nextChunk = 0;
+		m_pendingChunks = (count + grain - 1) / grain;
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	runChunks(body, count, grain);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [&]() { return m_pendingChunks == 0 && m_activeWorkers == 0; });
+	m_body = nullptr;
+}
+
+JobSystem& JobSystem::shared()
+{
+	static JobSystem jobs;
+	return jobs;
+}
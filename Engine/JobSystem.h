@@ -0,0 +1,64 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed pool of worker threads that split loops into chunks and run them in parallel.
+ *
+ * parallelFor() hands out chunks of the index range to the workers and the calling thread alike, and returns once
+ * every chunk has run. Only one loop runs at a time, and a loop body must not start another.
+ */
+class JobSystem {
+private:
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	// The loop being run: its body, size, chunk size, the next chunk to hand out and the chunks still running.
+	const std::function<void(uint32_t, uint32_t)>* m_body;
+	uint32_t m_count;
+	uint32_t m_grain;
+	std::atomic<uint32_t> m_nextChunk;
+	std::atomic<uint32_t> m_pendingChunks;
+
+	// Bumped for every loop, so sleeping workers know there is new work.
+	uint64_t m_generation;
+	// Workers that joined the current loop and have not yet left it.
+	uint32_t m_activeWorkers;
+	bool m_quit;
+
+	void workerLoop();
+	// Claims and runs chunks of the current loop until none are left. The loop's body and size are passed in, as
+	// read under the lock when joining it.
+	void runChunks(const std::function<void(uint32_t, uint32_t)>& body, uint32_t count, uint32_t grain);
+
+public:
+	/**
+	 * @brief Starts the given number of workers; by default one fewer than the hardware threads, since the caller
+	 * works too.
+	 */
+	explicit JobSystem(uint32_t workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1);
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+	~JobSystem();
+
+	/**
+	 * @brief Calls body(begin, end) over [0, count) in chunks of at most grain indices, spread across the workers.
+	 * Loops no bigger than one chunk run directly on the calling thread.
+	 */
+	void parallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t begin, uint32_t end)>& body);
+
+	// Threads a loop can run on, the caller included.
+	uint32_t threadCount() const { return static_cast<uint32_t>(m_workers.size()) + 1; }
+
+	/**
+	 * @brief The pool the engine's systems share.
+	 */
+	static JobSystem& shared();
+};
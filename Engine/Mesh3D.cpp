@@ -1,5 +1,6 @@
-#include <iostream>
+#include <cmath>
 #include "Mesh3D.h"
+#include "MeshSimplifier.h"
 #include <glad/glad.h>
 #include <GL/GL.h>
 
@@ -13,86 +14,46 @@ Mesh3D::Mesh3D(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t
 	this->m_faces = faces;
 	this->m_maps = maps;
 
-	// Generate a vertex array object on the GPU.
-	glGenVertexArrays(1, &m_vao);
-	// "Bind" the newly-generated vao, which makes future functions operate on that specific object.
-	glBindVertexArray(m_vao);
-
-	// Generate a vertex buffer object on the GPU.
-	glGenBuffers(1, &m_vbo);
-
-	// "Bind" the newly-generated vbo, which makes future functions operate on that specific object.
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-
-	// This vbo is now associated with m_vao.
-	// Copy the contents of the vertices list to the buffer that lives on the GPU.
-	glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(Vertex3D), &m_vertices[0], GL_STATIC_DRAW);
-	
-	// Inform OpenGL how to interpret the buffer. Each vertex now has 3 attributes; a position, a normal, and a texture.
-	// Atrribute 0 is position: 3 contiguous floats (x/y/z)...
-	glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex3D), 0);
-	glEnableVertexAttribArray(0);
-
-	//Attribute 1 is a normal: 3 contiguous floats
-	glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex3D), (void*)12);
-	glEnableVertexAttribArray(1);
-
-	// Attribute 2 is texture (u,v): 2 contiguous floats, starting 12 bytes after the beginning of the vertex.
-	glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex3D), (void*)24);
-	glEnableVertexAttribArray(2);
-
-	// Generate a second buffer, to store the indices of each triangle in the mesh.
-	glGenBuffers(1, &m_ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_faces.size() * sizeof(uint32_t), &m_faces[0], GL_STATIC_DRAW);
-
-	// Unbind the vertex array, so no one else can accidentally mess with it.
-	glBindVertexArray(0);
-
-	// Generate a texture on the GPU.
+	// Bound the mesh by a box, and by a sphere around the box's center reaching the furthest vertex.
+	for (auto& vertex : m_vertices)
+		m_bounds.expand(vertex.position);
+	if (!m_bounds.empty())
+	{
+		m_sphere.center = m_bounds.center();
+		m_sphere.radius = 0.0f;
+		for (auto& vertex : m_vertices)
+			m_sphere.radius = glm::max(m_sphere.radius, glm::length(vertex.position - m_sphere.center));
+	}
+
+	// Copy the vertices and faces into the shared buffer, so this mesh can be drawn alongside every other mesh
+	// without binding its own vertex array.
+	m_buffer = &MeshBuffer::shared();
+	m_range = m_buffer->allocate(m_vertices, m_faces);
+
+	// Generate a texture on the GPU, unless another mesh sharing this texture already did.
 	Map diffuse = m_maps[0];
 	glBindTexture(GL_TEXTURE_2D, diffuse.id);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	int mode = GL_RGB;
-	if (diffuse.texture->format->BytesPerPixel == 4)
-		mode = GL_RGBA;
-
-	glTexImage2D(GL_TEXTURE_2D, 0, mode, diffuse.texture->w, diffuse.texture->h, 0, mode, GL_UNSIGNED_BYTE, diffuse.texture->pixels);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	int uploadedWidth = 0;
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &uploadedWidth);
+	if (uploadedWidth == 0)
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		int mode = GL_RGB;
+		if (diffuse.texture->format->BytesPerPixel == 4)
+			mode = GL_RGBA;
+
+		glTexImage2D(GL_TEXTURE_2D, 0, mode, diffuse.texture->w, diffuse.texture->h, 0, mode, GL_UNSIGNED_BYTE, diffuse.texture->pixels);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
 	glBindTexture(GL_TEXTURE_2D, 0);
 	m_textureIndex = 0;
 	m_activeTexture = diffuse.id;
 }
 
-void Mesh3D::render(Shader& shader, uint32_t shadowMapID) {
-	// Activate the mesh's vertex array.
-	glBindVertexArray(m_vao);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, m_activeTexture);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, shadowMapID);
-
-	//Activate the mesh's shader
-	shader.activate();
-
-	// Draw the vertex array, using its "element buffer" to identify the faces.
-	glDrawElements(GL_TRIANGLES, m_faces.size(), GL_UNSIGNED_INT, nullptr);
-
-	//Disable the mesh's shader
-	shader.disable();
-
-	// Deactivate the mesh's vertex array and texture.
-	glBindVertexArray(0);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, 0);
-}
-
 void Mesh3D::addTexture(std::string path, std::string name)
 {
 	uint32_t textureID;
@@ -132,3 +93,53 @@ void Mesh3D::cycleTexture()
 		m_textureIndex++;
 	m_activeTexture = m_maps[m_textureIndex].id;
 }
+
+
+const ShadowProxy& Mesh3D::shadowProxy(float maxError, const glm::mat4& model) const
+{
+	//Convert the error bound into the mesh's own units using the largest scale in the model matrix
+	float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	float localError = maxError / scale;
+
+	//A vertex can move up to a cell diagonal, so size cells to keep that within the bound
+	float cellSize = std::exp2(std::floor(std::log2(localError / std::sqrt(3.0f))));
+
+	for (auto& proxy : m_shadowProxies)
+	{
+		if (proxy.cellSize == cellSize)
+			return proxy;
+	}
+
+	//The cache is full: settle for the coarsest proxy still within the bound, else the finest there is
+	if (m_shadowProxies.size() >= MaxShadowProxies)
+	{
+		const ShadowProxy* best = nullptr;
+		const ShadowProxy* finest = &m_shadowProxies.front();
+		for (auto& proxy : m_shadowProxies)
+		{
+			if (proxy.cellSize <= cellSize && (best == nullptr || proxy.cellSize > best->cellSize))
+				best = &proxy;
+			if (proxy.cellSize < finest->cellSize)
+				finest = &proxy;
+		}
+		return best != nullptr ? *best : *finest;
+	}
+
+	ShadowProxy proxy;
+	proxy.cellSize = cellSize;
+	vector<glm::vec3> positions;
+	positions.reserve(m_vertices.size());
+	for (auto& vertex : m_vertices)
+		positions.push_back(vertex.position);
+	simplifyByClustering(positions, m_faces, cellSize, proxy.positions, proxy.faces);
+
+	//Store the proxy next to the full mesh, so shadow draws of both can still share one call
+	vector<Vertex3D> vertices;
+	vertices.reserve(proxy.positions.size());
+	for (auto& position : proxy.positions)
+		vertices.emplace_back(position, glm::vec3(0.0f), glm::vec2(0.0f));
+	proxy.range = m_buffer->allocate(vertices, proxy.faces);
+
+	m_shadowProxies.push_back(std::move(proxy));
+	return m_shadowProxies.back();
+}
\ No newline at end of file
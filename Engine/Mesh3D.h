@@ -3,9 +3,12 @@
 #include <SDL2/SDL_image.h>
 #include <glm/glm.hpp>
 #include <glad/glad.h>
+#include <deque>
 #include <vector>
 
 #include "Shader.h"
+#include "MeshBuffer.h"
+#include "Bounds.h"
 
 struct Vertex3D {
 	glm::vec3 position;
@@ -23,14 +26,37 @@ struct Map {
 	std::string path;
 };
 
+/**
+ * @brief A simplified, position-only stand-in for a mesh, drawn in its place by the shadow pass.
+ */
+struct ShadowProxy {
+	// The grid cell size the proxy was clustered with, in the mesh's own coordinates.
+	float cellSize;
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> faces;
+	MeshRange range;
+};
+
 class Mesh3D {
+public:
+	// Most shadow proxies one mesh keeps. Their geometry lives in the shared mesh buffer, which never frees, so
+	// past this the closest existing proxy is reused instead of another being generated.
+	static const size_t MaxShadowProxies = 4;
+
 private:
-	uint32_t m_vao;
-	uint32_t m_vbo;
-	uint32_t m_ebo;
+	MeshBuffer* m_buffer;
+	MeshRange m_range;
 	uint32_t m_activeTexture;
 	int m_textureIndex;
 
+	// Bounds of the vertices in the mesh's own coordinates, computed once at import.
+	AABB m_bounds;
+	BoundingSphere m_sphere;
+
+	// Shadow proxies generated so far, one per cell size requested. A cache, so it can be filled from const methods;
+	// a deque so the references shadowProxy() hands out survive later proxies being added.
+	mutable std::deque<ShadowProxy> m_shadowProxies;
+
 public:
 	std::vector<Vertex3D> m_vertices;
 	std::vector<uint32_t> m_faces;
@@ -44,9 +70,30 @@ public:
 	Mesh3D(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces, const std::vector<Map>& maps);
 
 	/**
-	 * @brief Renders the mesh to the given context.
+	 * @brief The shared buffer holding this mesh's geometry, and where in it the mesh lives.
+	 */
+	const MeshBuffer& buffer() const { return *m_buffer; }
+	const MeshRange& range() const { return m_range; }
+
+	/**
+	 * @brief The texture currently selected by cycleTexture().
+	 */
+	uint32_t activeTexture() const { return m_activeTexture; }
+
+	/**
+	 * @brief The box and sphere enclosing the mesh, in its own coordinates.
+	 */
+	const AABB& bounds() const { return m_bounds; }
+	const BoundingSphere& sphere() const { return m_sphere; }
+
+	/**
+	 * @brief Returns a simplified version of this mesh for shadow casting whose outline stays within maxError
+	 * world units of the original when drawn with the given model matrix. Proxies are generated on first use and
+	 * cached; error bounds are rounded down to a power of two so nearby values share one proxy. Once
+	 * MaxShadowProxies exist, the coarsest one within the bound is returned, or the finest if none is. The reference
+	 * stays valid for the mesh's lifetime.
 	 */
-	void render(Shader& shader, uint32_t shadowMapID);
+	const ShadowProxy& shadowProxy(float maxError, const glm::mat4& model) const;
 
 	void addTexture(std::string path, std::string name);
 	void cycleTexture();
@@ -0,0 +1,186 @@
+#include "MeshBuffer.h"
+#include "Mesh3D.h"
+
+//A buffer holding 0, 1, 2, ... that every MeshBuffer reads its per-instance draw ID from
+static uint32_t drawIDBuffer()
+{
+	static uint32_t buffer = 0;
+	if (buffer == 0)
+	{
+		std::vector<uint32_t> ids(MeshBuffer::MaxDrawIDs);
+		for (uint32_t i = 0; i < MeshBuffer::MaxDrawIDs; i++)
+			ids[i] = i;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(uint32_t), ids.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	return buffer;
+}
+
+MeshBuffer::MeshBuffer(uint32_t vertexCapacity, uint32_t indexCapacity) : m_vertexCapacity(vertexCapacity), m_indexCapacity(indexCapacity), m_vertexCount(0), m_indexCount(0)
+{
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, m_vertexCapacity * sizeof(Vertex3D), nullptr, GL_STATIC_DRAW);
+	bindAttributes();
+
+	//The draw ID advances once per instance, so a multi-draw command's baseInstance selects its per-draw data
+	glBindBuffer(GL_ARRAY_BUFFER, drawIDBuffer());
+	glVertexAttribIPointer(DrawIDAttribute, 1, GL_UNSIGNED_INT, sizeof(uint32_t), 0);
+	glVertexAttribDivisor(DrawIDAttribute, 1);
+	glEnableVertexAttribArray(DrawIDAttribute);
+
+	glGenBuffers(1, &m_ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indexCapacity * sizeof(uint32_t), nullptr, GL_STATIC_DRAW);
+
+	//The depth-only vertex array reads packed positions but shares the element buffer and draw IDs
+	glGenVertexArrays(1, &m_depthVao);
+	glBindVertexArray(m_depthVao);
+
+	glGenBuffers(1, &m_positionVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_positionVbo);
+	glBufferData(GL_ARRAY_BUFFER, m_vertexCapacity * sizeof(glm::vec3), nullptr, GL_STATIC_DRAW);
+	bindPositionAttributes();
+
+	glBindBuffer(GL_ARRAY_BUFFER, drawIDBuffer());
+	glVertexAttribIPointer(DrawIDAttribute, 1, GL_UNSIGNED_INT, sizeof(uint32_t), 0);
+	glVertexAttribDivisor(DrawIDAttribute, 1);
+	glEnableVertexAttribArray(DrawIDAttribute);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshBuffer::bindAttributes()
+{
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+
+	//Same layout as Vertex3D: position, normal, texture coordinates
+	glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex3D), 0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex3D), (void*)12);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex3D), (void*)24);
+	glEnableVertexAttribArray(2);
+}
+
+void MeshBuffer::bindPositionAttributes()
+{
+	glBindBuffer(GL_ARRAY_BUFFER, m_positionVbo);
+
+	//Attribute 0 is the position, 12 bytes per vertex with nothing in between
+	glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(glm::vec3), 0);
+	glEnableVertexAttribArray(0);
+}
+
+void MeshBuffer::grow(uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+	glBindVertexArray(m_vao);
+
+	if (vertexCapacity > m_vertexCapacity)
+	{
+		//Copy the existing vertices into a larger buffer on the GPU
+		uint32_t vbo;
+		glGenBuffers(1, &vbo);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+		glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * sizeof(Vertex3D), nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_READ_BUFFER, m_vbo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_vertexCount * sizeof(Vertex3D));
+		glDeleteBuffers(1, &m_vbo);
+		m_vbo = vbo;
+		bindAttributes();
+
+		uint32_t positionVbo;
+		glGenBuffers(1, &positionVbo);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, positionVbo);
+		glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * sizeof(glm::vec3), nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_READ_BUFFER, m_positionVbo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_vertexCount * sizeof(glm::vec3));
+		glDeleteBuffers(1, &m_positionVbo);
+		m_positionVbo = positionVbo;
+		glBindVertexArray(m_depthVao);
+		bindPositionAttributes();
+		glBindVertexArray(m_vao);
+
+		m_vertexCapacity = vertexCapacity;
+	}
+
+	if (indexCapacity > m_indexCapacity)
+	{
+		uint32_t ebo;
+		glGenBuffers(1, &ebo);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+		glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity * sizeof(uint32_t), nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_READ_BUFFER, m_ebo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_indexCount * sizeof(uint32_t));
+		glDeleteBuffers(1, &m_ebo);
+		m_ebo = ebo;
+		m_indexCapacity = indexCapacity;
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+		glBindVertexArray(m_depthVao);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+MeshRange MeshBuffer::allocate(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces)
+{
+	uint32_t vertexCapacity = m_vertexCapacity;
+	uint32_t indexCapacity = m_indexCapacity;
+	while (m_vertexCount + vertices.size() > vertexCapacity)
+		vertexCapacity *= 2;
+	while (m_indexCount + faces.size() > indexCapacity)
+		indexCapacity *= 2;
+	if (vertexCapacity != m_vertexCapacity || indexCapacity != m_indexCapacity)
+		grow(vertexCapacity, indexCapacity);
+
+	MeshRange range;
+	range.firstIndex = m_indexCount;
+	range.indexCount = static_cast<uint32_t>(faces.size());
+	range.baseVertex = static_cast<int32_t>(m_vertexCount);
+	range.vertexCount = static_cast<uint32_t>(vertices.size());
+
+	//Indices stay relative to the mesh; the draw call adds baseVertex back on
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, m_vertexCount * sizeof(Vertex3D), vertices.size() * sizeof(Vertex3D), vertices.data());
+
+	std::vector<glm::vec3> positions;
+	positions.reserve(vertices.size());
+	for (auto& vertex : vertices)
+		positions.push_back(vertex.position);
+	glBindBuffer(GL_ARRAY_BUFFER, m_positionVbo);
+	glBufferSubData(GL_ARRAY_BUFFER, m_vertexCount * sizeof(glm::vec3), positions.size() * sizeof(glm::vec3), positions.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//The element buffer is part of the vertex array's state, so bind the vertex array before touching it
+	glBindVertexArray(m_vao);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, m_indexCount * sizeof(uint32_t), faces.size() * sizeof(uint32_t), faces.data());
+	glBindVertexArray(0);
+
+	m_vertexCount += range.vertexCount;
+	m_indexCount += range.indexCount;
+	return range;
+}
+
+void MeshBuffer::reset()
+{
+	m_vertexCount = 0;
+	m_indexCount = 0;
+}
+
+MeshBuffer& MeshBuffer::shared()
+{
+	//Created on first use, which is after the OpenGL context exists
+	static MeshBuffer buffer(1 << 18, 1 << 20);
+	return buffer;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+struct Vertex3D;
+
+/**
+ * @brief The location of one mesh's vertices and indices inside a MeshBuffer.
+ */
+struct MeshRange {
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	int32_t baseVertex = 0;
+	uint32_t vertexCount = 0;
+};
+
+/**
+ * @brief A vertex and index buffer shared by many meshes, so that they can all be drawn from a single
+ * vertex array with base-vertex or multi-draw-indirect calls instead of one VAO bind per mesh.
+ *
+ * Alongside the interleaved Vertex3D stream the buffer keeps a tightly packed copy of just the positions,
+ * with its own vertex array sharing the same indices. Depth-only passes draw from that one so they do not
+ * pull normals and texture coordinates through the vertex cache.
+ */
+class MeshBuffer {
+private:
+	uint32_t m_vao;
+	uint32_t m_vbo;
+	uint32_t m_ebo;
+
+	// Position-only stream and the vertex array that reads it.
+	uint32_t m_depthVao;
+	uint32_t m_positionVbo;
+
+	uint32_t m_vertexCapacity;
+	uint32_t m_indexCapacity;
+	uint32_t m_vertexCount;
+	uint32_t m_indexCount;
+
+	// Reallocates the buffers with at least the given capacities, keeping their current contents.
+	void grow(uint32_t vertexCapacity, uint32_t indexCapacity);
+	// Points the vertex arrays' attributes at the current vertex buffers.
+	void bindAttributes();
+	void bindPositionAttributes();
+
+public:
+	/**
+	 * @brief The vertex attribute that carries the draw ID (see RenderQueue).
+	 */
+	static const uint32_t DrawIDAttribute = 3;
+	/**
+	 * @brief Draw IDs the shared ID buffer holds, and so the most draws one indirect submission can index.
+	 */
+	static const uint32_t MaxDrawIDs = 65536;
+
+	MeshBuffer(uint32_t vertexCapacity, uint32_t indexCapacity);
+	MeshBuffer(const MeshBuffer&) = delete;
+	MeshBuffer& operator=(const MeshBuffer&) = delete;
+
+	/**
+	 * @brief Appends a mesh to the buffer, growing it if needed, and returns where it was placed.
+	 */
+	MeshRange allocate(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces);
+
+	/**
+	 * @brief Forgets every allocation, keeping the buffers' capacity for reuse.
+	 */
+	void reset();
+
+	uint32_t vao() const { return m_vao; }
+	uint32_t depthVao() const { return m_depthVao; }
+	uint32_t vertexCount() const { return m_vertexCount; }
+	uint32_t indexCount() const { return m_indexCount; }
+
+	/**
+	 * @brief The buffer every imported Mesh3D is placed in.
+	 */
+	static MeshBuffer& shared();
+};
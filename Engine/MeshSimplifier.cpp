@@ -0,0 +1,90 @@
+#include "MeshSimplifier.h"
+#include <unordered_map>
+#include <unordered_set>
+
+void simplifyByClustering(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& faces, float cellSize,
+	std::vector<glm::vec3>& outPositions, std::vector<uint32_t>& outFaces)
+{
+	outPositions.clear();
+	outFaces.clear();
+	if (positions.empty())
+		return;
+
+	glm::vec3 origin = positions[0];
+	glm::vec3 extent = positions[0];
+	for (auto& position : positions)
+	{
+		origin = glm::min(origin, position);
+		extent = glm::max(extent, position);
+	}
+	extent -= origin;
+
+	//Cell coordinates are packed into 21 bits each
+	float largest = glm::max(extent.x, glm::max(extent.y, extent.z));
+	cellSize = glm::max(cellSize, largest / 2000000.0f);
+	if (cellSize <= 0.0f)
+		return;
+
+	//Assign every vertex to the cluster of the grid cell it falls in
+	std::unordered_map<uint64_t, uint32_t> cells;
+	std::vector<uint32_t> clusterOf(positions.size());
+	std::vector<glm::vec3> sums;
+	std::vector<uint32_t> counts;
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		glm::vec3 cell = glm::floor((positions[i] - origin) / cellSize);
+		uint64_t key = (static_cast<uint64_t>(cell.x) << 42) | (static_cast<uint64_t>(cell.y) << 21) | static_cast<uint64_t>(cell.z);
+
+		auto found = cells.find(key);
+		uint32_t cluster;
+		if (found == cells.end())
+		{
+			cluster = static_cast<uint32_t>(sums.size());
+			cells.emplace(key, cluster);
+			sums.push_back(glm::vec3(0.0f));
+			counts.push_back(0);
+		}
+		else
+			cluster = found->second;
+
+		clusterOf[i] = cluster;
+		sums[cluster] += positions[i];
+		counts[cluster]++;
+	}
+
+	//Keep the triangles whose corners still land in three different clusters, once each
+	std::vector<uint32_t> remap(sums.size(), UINT32_MAX);
+	std::unordered_set<uint64_t> seen;
+	for (size_t i = 0; i + 2 < faces.size(); i += 3)
+	{
+		uint32_t a = clusterOf[faces[i]];
+		uint32_t b = clusterOf[faces[i + 1]];
+		uint32_t c = clusterOf[faces[i + 2]];
+		if (a == b || b == c || a == c)
+			continue;
+
+		//Rotate the smallest index to the front so the same triangle always gets the same key, keeping its winding
+		uint32_t first = a, second = b, third = c;
+		if (b < first && b < c)
+		{
+			first = b; second = c; third = a;
+		}
+		else if (c < first && c < b)
+		{
+			first = c; second = a; third = b;
+		}
+		uint64_t key = (static_cast<uint64_t>(first) << 42) | (static_cast<uint64_t>(second) << 21) | static_cast<uint64_t>(third);
+		if (!seen.insert(key).second)
+			continue;
+
+		for (uint32_t cluster : { a, b, c })
+		{
+			if (remap[cluster] == UINT32_MAX)
+			{
+				remap[cluster] = static_cast<uint32_t>(outPositions.size());
+				outPositions.push_back(sums[cluster] / static_cast<float>(counts[cluster]));
+			}
+			outFaces.push_back(remap[cluster]);
+		}
+	}
+}
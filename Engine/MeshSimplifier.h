@@ -0,0 +1,14 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+/**
+ * @brief Simplifies a triangle mesh by vertex clustering: every vertex is snapped to the average of the vertices
+ * sharing its cell in a uniform grid, and triangles that collapse or become duplicates are dropped.
+ *
+ * No vertex moves further than one cell diagonal, so the outline of the mesh is kept to within cellSize, while
+ * anything smaller than a cell (fine surface detail, small holes) disappears. Only positions are considered,
+ * which makes the result suitable for depth and shadow passes regardless of the original material.
+ */
+void simplifyByClustering(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& faces, float cellSize,
+	std::vector<glm::vec3>& outPositions, std::vector<uint32_t>& outFaces);
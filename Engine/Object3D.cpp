@@ -4,66 +4,117 @@
 #include "Object3D.h"
 #include "Shader.h"
 
-void Object3D::rebuildModelMatrix() 
+Object3D::Object3D(std::shared_ptr<Mesh3D>&& mesh, const glm::mat4 baseTransform) : m_mesh(mesh), m_transform(TransformSystem::shared().create(baseTransform))
 {
-	auto m = glm::translate(glm::mat4(1), m_position);
-	m = glm::translate(m, m_center * m_scale);
-	m = glm::rotate(m, m_orientation[2], glm::vec3(0, 0, 1));
-	m = glm::rotate(m, m_orientation[0], glm::vec3(1, 0, 0));
-	m = glm::rotate(m, m_orientation[1], glm::vec3(0, 1, 0));
-	m = glm::scale(m, m_scale);
-	m = glm::translate(m, -m_center);
-	m = m * m_baseTransform;
-	m_modelMatrix = m;
+	numChildren = m_children.size();
 }
 
-Object3D::Object3D(std::shared_ptr<Mesh3D>&& mesh, const glm::mat4 baseTransform) : m_mesh(mesh), m_position(), m_orientation(), m_scale(1.0), m_center(), m_baseTransform(baseTransform)
+Object3D::Object3D(Object3D&& other) noexcept : m_mesh(std::move(other.m_mesh)), m_transform(other.m_transform), m_children(std::move(other.m_children)),
+	m_material(other.m_material), m_static(other.m_static), m_shadowProxyError(other.m_shadowProxyError), numChildren(other.numChildren)
 {
-	rebuildModelMatrix();
-	numChildren = m_children.size();
+	other.m_transform = TransformHandle();
+}
+
+Object3D& Object3D::operator=(Object3D&& other) noexcept
+{
+	if (this != &other)
+	{
+		TransformSystem::shared().destroy(m_transform);
+		m_mesh = std::move(other.m_mesh);
+		m_transform = other.m_transform;
+		other.m_transform = TransformHandle();
+		m_children = std::move(other.m_children);
+		m_material = other.m_material;
+		m_static = other.m_static;
+		m_shadowProxyError = other.m_shadowProxyError;
+		numChildren = other.numChildren;
+	}
+	return *this;
+}
+
+Object3D::~Object3D()
+{
+	TransformSystem::shared().destroy(m_transform);
+}
+
+glm::vec3 Object3D::getPosition() const 
+{
+	return TransformSystem::shared().position(m_transform);
+}
+
+glm::vec3 Object3D::getOrientation() const 
+{
+	return TransformSystem::shared().orientation(m_transform);
+}
+
+glm::vec3 Object3D::getScale() const 
+{
+	return TransformSystem::shared().scale(m_transform);
+}
+
+glm::vec3 Object3D::getCenter() const 
+{
+	return TransformSystem::shared().center(m_transform);
+}
+
+const glm::vec4& Object3D::getMaterial() const
+{
+	return m_material;
+}
+
+const glm::mat4& Object3D::getModelMatrix() const
+{
+	return TransformSystem::shared().local(m_transform);
+}
+
+const glm::mat4& Object3D::getWorldMatrix() const
+{
+	return TransformSystem::shared().world(m_transform);
+}
+
+const Mesh3D& Object3D::getMesh() const
+{
+	return *m_mesh;
 }
 
-const glm::vec3& Object3D::getPosition() const 
+std::shared_ptr<Mesh3D> Object3D::getSharedMesh() const
 {
-	return m_position;
+	return m_mesh;
 }
 
-const glm::vec3& Object3D::getOrientation() const 
+TransformHandle Object3D::getTransform() const
 {
-	return m_orientation;
+	return m_transform;
 }
 
-const glm::vec3& Object3D::getScale() const 
+bool Object3D::isStatic() const
 {
-	return m_scale;
+	return m_static;
 }
 
-const glm::vec3& Object3D::getCenter() const 
+float Object3D::getShadowProxyError() const
 {
-	return m_center;
+	return m_shadowProxyError;
 }
 
 void Object3D::setPosition(const glm::vec3& position) 
 {
-	m_position = position;
-	rebuildModelMatrix();
+	TransformSystem::shared().setPosition(m_transform, position);
 }
 
 void Object3D::setOrientation(const glm::vec3& orientation) 
 {
-	m_orientation = orientation;
-	rebuildModelMatrix();
+	TransformSystem::shared().setOrientation(m_transform, orientation);
 }
 
 void Object3D::setScale(const glm::vec3& scale) 
 {
-	m_scale = scale;
-	rebuildModelMatrix();
+	TransformSystem::shared().setScale(m_transform, scale);
 }
 
 void Object3D::setCenter(const glm::vec3& center)
 {
-	m_center = center;
+	TransformSystem::shared().setCenter(m_transform, center);
 }
 
 void Object3D::setMaterial(const glm::vec4& material)
@@ -73,30 +124,53 @@ void Object3D::setMaterial(const glm::vec4& material)
 		child.setMaterial(material);
 }
 
+void Object3D::setStatic(bool isStatic)
+{
+	m_static = isStatic;
+}
+
+void Object3D::setShadowProxyError(float maxError)
+{
+	m_shadowProxyError = maxError;
+	for (auto& child : m_children)
+		child.setShadowProxyError(maxError);
+}
+
 void Object3D::move(const glm::vec3& offset) 
 {
-	m_position = m_position + offset;
-	rebuildModelMatrix();
+	setPosition(getPosition() + offset);
 }
 
 void Object3D::rotate(const glm::vec3& rotation) 
 {
-	m_orientation = m_orientation + rotation;
-	rebuildModelMatrix();
+	setOrientation(getOrientation() + rotation);
 }
 
 void Object3D::grow(const glm::vec3& growth) 
 {
-	m_scale = m_scale * growth;
-	rebuildModelMatrix();
+	setScale(getScale() * growth);
 }
 
 void Object3D::addChild(Object3D&& child)
 {
-	m_children.emplace_back(child);
+	m_children.emplace_back(std::move(child));
+	m_children.back().setParent(*this);
 	numChildren = m_children.size();
 }
 
+std::vector<Object3D> Object3D::releaseChildren()
+{
+	std::vector<Object3D> children = std::move(m_children);
+	m_children.clear();
+	numChildren = 0;
+	return children;
+}
+
+void Object3D::setParent(const Object3D& parent)
+{
+	TransformSystem::shared().setParent(m_transform, parent.m_transform);
+}
+
 const Object3D& Object3D::getChild(int index) const
 {
 	return m_children[index];
@@ -107,20 +181,21 @@ Object3D& Object3D::getChild(int index)
 	return m_children[index];
 }
 
-void Object3D::render(Shader& shader, uint32_t shadowMapID) const
+AABB Object3D::getWorldBounds() const
 {
-	renderRecursive(shader, glm::mat4(1), shadowMapID);
+	return m_mesh->bounds().transformed(getWorldMatrix());
 }
 
-void Object3D::renderRecursive(Shader& shader, const glm::mat4& parentMatrix, uint32_t shadowMapID) const
+void Object3D::enqueue(RenderQueue& queue, uint32_t viewMask) const
 {
-	glm::mat4 trueModel = parentMatrix * m_modelMatrix;
-	shader.setUniform("model", trueModel);
-	shader.setUniform("material", m_material);
-	m_mesh->render(shader, shadowMapID);
+	const glm::mat4& trueModel = getWorldMatrix();
+	if (m_shadowProxyError > 0.0f)
+		queue.add(*m_mesh, trueModel, m_material, m_mesh->shadowProxy(m_shadowProxyError, trueModel).range, viewMask);
+	else
+		queue.add(*m_mesh, trueModel, m_material, viewMask);
 
 	for (auto& child : m_children) {
-		child.renderRecursive(shader, trueModel, shadowMapID);
+		child.enqueue(queue, viewMask);
 	}
 }
 
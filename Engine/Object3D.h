@@ -5,44 +5,58 @@
 
 #include "Shader.h"
 #include "Mesh3D.h"
+#include "RenderQueue.h"
+#include "TransformSystem.h"
 
 class Object3D {
 private:
 	// The object's mesh.
 	std::shared_ptr<Mesh3D> m_mesh;
 
-	// The object's position, orientation, and scale in world space.
-	glm::vec3 m_position;
-	glm::vec3 m_orientation;
-	glm::vec3 m_scale;
-	glm::vec3 m_center;
+	// The object's position, orientation, scale, center and base transform, stored in the shared TransformSystem,
+	// which also rebuilds the local->world transformation matrix.
+	TransformHandle m_transform;
 
-	// The object's cached local->world transformation matrix.
-	glm::mat4 m_modelMatrix;
-	glm::mat4 m_baseTransform;
-
-	// Recomputes the local->world transformation matrix.
-	void rebuildModelMatrix();
-
-	//Other meshes in the object if any
+	//Other meshes in the object if any. A SceneGraph takes these over as nodes of their own when the object is added.
 	std::vector<Object3D> m_children;
 
 	//This object's material
 	glm::vec4 m_material = glm::vec4(0, 0, 0, 0);
 
+	//Whether this object never moves, so it can be merged into a static batch
+	bool m_static = false;
+
+	//World-space error allowed for this object's shadow proxy, or 0 to cast shadows with the full mesh
+	float m_shadowProxyError = 0.0f;
+
 public:
 	// No default constructor; you must have a mesh to initialize an object.
 	Object3D() = delete;
 
 	Object3D(std::shared_ptr<Mesh3D> &&mesh, const glm::mat4 baseTransform);
 
+	// Objects own their transform slot and children, so they can be moved but never copied.
+	Object3D(const Object3D& other) = delete;
+	Object3D(Object3D&& other) noexcept;
+	Object3D& operator=(const Object3D& other) = delete;
+	Object3D& operator=(Object3D&& other) noexcept;
+	~Object3D();
+
 	int numChildren;
 
 	// Simple accessors.
-	const glm::vec3& getPosition() const;
-	const glm::vec3& getOrientation() const;
-	const glm::vec3& getScale() const;
-	const glm::vec3& getCenter() const;
+	glm::vec3 getPosition() const;
+	glm::vec3 getOrientation() const;
+	glm::vec3 getScale() const;
+	glm::vec3 getCenter() const;
+	const glm::vec4& getMaterial() const;
+	const glm::mat4& getModelMatrix() const;
+	const glm::mat4& getWorldMatrix() const;
+	const Mesh3D& getMesh() const;
+	std::shared_ptr<Mesh3D> getSharedMesh() const;
+	TransformHandle getTransform() const;
+	bool isStatic() const;
+	float getShadowProxyError() const;
 
 	// Simple mutators.
 	void setPosition(const glm::vec3& position);
@@ -50,6 +64,8 @@ public:
 	void setScale(const glm::vec3& scale);
 	void setCenter(const glm::vec3& center);
 	void setMaterial(const glm::vec4& material);
+	void setStatic(bool isStatic);
+	void setShadowProxyError(float maxError);
 	
 	// Transformations.
 	void move(const glm::vec3& offset);
@@ -57,12 +73,19 @@ public:
 	void grow(const glm::vec3& growth);
 
 	void addChild(Object3D&& child);
+	// Hands the children over to the caller, leaving the object without any.
+	std::vector<Object3D> releaseChildren();
+	// Makes this object's transform relative to another object's.
+	void setParent(const Object3D& parent);
 	const Object3D& getChild(int index) const;
 	Object3D& getChild(int index);
 
-	// Rendering.
-	void render(Shader& shader, uint32_t shadowMapID) const;
-	void renderRecursive(Shader& shader, const glm::mat4& parentMatrix, uint32_t shadowMapID) const;
+	// The object's mesh bounds in world space, without its children.
+	AABB getWorldBounds() const;
+
+	// Rendering. Queues this object and its children with their cached world matrices, for the given views of the
+	// queue; the queue culls each draw and issues the actual draws.
+	void enqueue(RenderQueue& queue, uint32_t viewMask = RenderQueue::AllViews) const;
 
 	void addTex(std::string path, std::string name);
 	void cycleTex();
@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+
+#include "OcclusionBuffer.h"
+#include "Mesh3D.h"
+
+namespace {
+	//Four floats in an SSE register, plus the handful of operations the rasterizer needs
+	struct Float4 {
+		__m128 v;
+
+		static const int Width = 4;
+
+		static Float4 load(const float* p) { return { _mm_loadu_ps(p) }; }
+		static Float4 splat(float f) { return { _mm_set1_ps(f) }; }
+		static Float4 ramp() { return { _mm_setr_ps(0, 1, 2, 3) }; }
+		void store(float* p) const { _mm_storeu_ps(p, v); }
+
+		friend Float4 operator+(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+		friend Float4 operator*(Float4 a, Float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+		friend Float4 operator&(Float4 a, Float4 b) { return { _mm_and_ps(a.v, b.v) }; }
+
+		static Float4 min(Float4 a, Float4 b) { return { _mm_min_ps(a.v, b.v) }; }
+		static Float4 nonNegative(Float4 a) { return { _mm_cmpge_ps(a.v, _mm_setzero_ps()) }; }
+		//Lanes of b where the mask is set, lanes of a elsewhere
+		static Float4 select(Float4 mask, Float4 a, Float4 b) { return { _mm_or_ps(_mm_and_ps(mask.v, b.v), _mm_andnot_ps(mask.v, a.v)) }; }
+		static bool any(Float4 mask) { return _mm_movemask_ps(mask.v) != 0; }
+	};
+
+#ifdef __AVX__
+	//Eight floats in an AVX register. Rasterizing only needs float arithmetic, so AVX2 builds use this too
+	struct Float8 {
+		__m256 v;
+
+		static const int Width = 8;
+
+		static Float8 load(const float* p) { return { _mm256_loadu_ps(p) }; }
+		static Float8 splat(float f) { return { _mm256_set1_ps(f) }; }
+		static Float8 ramp() { return { _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7) }; }
+		void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+		friend Float8 operator+(Float8 a, Float8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+		friend Float8 operator*(Float8 a, Float8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+		friend Float8 operator&(Float8 a, Float8 b) { return { _mm256_and_ps(a.v, b.v) }; }
+
+		static Float8 min(Float8 a, Float8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+		static Float8 nonNegative(Float8 a) { return { _mm256_cmp_ps(a.v, _mm256_setzero_ps(), _CMP_GE_OQ) }; }
+		static Float8 select(Float8 mask, Float8 a, Float8 b) { return { _mm256_blendv_ps(a.v, b.v, mask.v) }; }
+		static bool any(Float8 mask) { return _mm256_movemask_ps(mask.v) != 0; }
+	};
+	typedef Float8 FloatN;
+#else
+	typedef Float4 FloatN;
+#endif
+
+	static_assert(OcclusionBuffer::TileSize % FloatN::Width == 0, "Tile rows must hold whole SIMD steps");
+
+	//Window coordinates of a clip-space position: pixels for x and y, [0, 1] for depth
+	glm::vec3 toWindow(const glm::vec4& clip)
+	{
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		return glm::vec3((ndc.x * 0.5f + 0.5f) * OcclusionBuffer::Width, (ndc.y * 0.5f + 0.5f) * OcclusionBuffer::Height, ndc.z * 0.5f + 0.5f);
+	}
+}
+
+OcclusionBuffer::OcclusionBuffer() : m_viewProjection(1.0f), m_depth(Width * Height, 1.0f), m_blockDepth(BlocksX * BlocksY, 1.0f)
+{
+}
+
+void OcclusionBuffer::begin(const glm::mat4& viewProjection)
+{
+	m_viewProjection = viewProjection;
+	std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+	std::fill(m_blockDepth.begin(), m_blockDepth.end(), 1.0f);
+	m_triangles.clear();
+	for (auto& bin : m_bins)
+		bin.clear();
+}
+
+void OcclusionBuffer::addOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& faces, const glm::mat4& model)
+{
+	glm::mat4 mvp = m_viewProjection * model;
+	m_clip.resize(positions.size());
+	for (size_t i = 0; i < positions.size(); i++)
+		m_clip[i] = mvp * glm::vec4(positions[i], 1.0f);
+	addFaces(faces);
+}
+
+void OcclusionBuffer::addOccluder(const Mesh3D& mesh, const glm::mat4& model)
+{
+	glm::mat4 mvp = m_viewProjection * model;
+	m_clip.resize(mesh.m_vertices.size());
+	for (size_t i = 0; i < mesh.m_vertices.size(); i++)
+		m_clip[i] = mvp * glm::vec4(mesh.m_vertices[i].position, 1.0f);
+	addFaces(mesh.m_faces);
+}
+
+void OcclusionBuffer::addFaces(const std::vector<uint32_t>& faces)
+{
+	for (size_t i = 0; i + 2 < faces.size(); i += 3)
+		addTriangle(m_clip[faces[i]], m_clip[faces[i + 1]], m_clip[faces[i + 2]]);
+}
+
+void OcclusionBuffer::addTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+{
+	//Distances in front of the near plane (z = -w in clip space)
+	const glm::vec4 in[3] = { a, b, c };
+	float d[3] = { a.z + a.w, b.z + b.w, c.z + c.w };
+	if (d[0] >= 0 && d[1] >= 0 && d[2] >= 0)
+	{
+		setupTriangle(toWindow(a), toWindow(b), toWindow(c));
+		return;
+	}
+
+	//Clip against the near plane, leaving a polygon of up to four vertices to fan into triangles
+	glm::vec3 out[4];
+	int count = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		int j = (i + 1) % 3;
+		if (d[i] >= 0)
+			out[count++] = toWindow(in[i]);
+		if ((d[i] >= 0) != (d[j] >= 0))
+			out[count++] = toWindow(glm::mix(in[i], in[j], d[i] / (d[i] - d[j])));
+	}
+	for (int i = 1; i + 1 < count; i++)
+		setupTriangle(out[0], out[i], out[i + 1]);
+}
+
+void OcclusionBuffer::setupTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	//Twice the signed area; counter-clockwise front faces are positive
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (area <= 0)
+		return;
+
+	//Pixels whose centers lie in the triangle's bounds, clamped to the screen
+	int minX = std::max(static_cast<int>(std::ceil(std::min({ a.x, b.x, c.x }) - 0.5f)), 0);
+	int maxX = std::min(static_cast<int>(std::floor(std::max({ a.x, b.x, c.x }) - 0.5f)), static_cast<int>(Width) - 1);
+	int minY = std::max(static_cast<int>(std::ceil(std::min({ a.y, b.y, c.y }) - 0.5f)), 0);
+	int maxY = std::min(static_cast<int>(std::floor(std::max({ a.y, b.y, c.y }) - 0.5f)), static_cast<int>(Height) - 1);
+	if (minX > maxX || minY > maxY)
+		return;
+
+	Triangle triangle;
+	triangle.minX = minX;
+	triangle.minY = minY;
+	triangle.maxX = maxX;
+	triangle.maxY = maxY;
+
+	//Edge i runs between the two vertices other than vertex i, and is zero there and area at vertex i
+	const glm::vec3* v[3] = { &a, &b, &c };
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec3& p = *v[(i + 1) % 3];
+		const glm::vec3& q = *v[(i + 2) % 3];
+		float edgeA = p.y - q.y, edgeB = q.x - p.x;
+		triangle.edgeA[i] = edgeA;
+		triangle.edgeB[i] = edgeB;
+		triangle.edgeC[i] = p.x * q.y - p.y * q.x;
+	}
+
+	//Depth plane through the vertices, raised to its furthest over the pixel. Solved in double precision, as the
+	//depths are close together near 1 and the constant term cancels out most of its parts
+	double dx1 = b.x - a.x, dy1 = b.y - a.y, dz1 = b.z - a.z;
+	double dx2 = c.x - a.x, dy2 = c.y - a.y, dz2 = c.z - a.z;
+	double inverseArea = 1.0 / (dx1 * dy2 - dy1 * dx2);
+	double depthA = (dz1 * dy2 - dy1 * dz2) * inverseArea;
+	double depthB = (dx1 * dz2 - dz1 * dx2) * inverseArea;
+	triangle.depthA = static_cast<float>(depthA);
+	triangle.depthB = static_cast<float>(depthB);
+	triangle.depthC = static_cast<float>(a.z - depthA * a.x - depthB * a.y + 0.5 * (std::abs(depthA) + std::abs(depthB)));
+
+	uint32_t index = static_cast<uint32_t>(m_triangles.size());
+	m_triangles.push_back(triangle);
+	for (int tileY = minY / static_cast<int>(TileSize); tileY <= maxY / static_cast<int>(TileSize); tileY++)
+	{
+		for (int tileX = minX / static_cast<int>(TileSize); tileX <= maxX / static_cast<int>(TileSize); tileX++)
+			m_bins[tileY * TilesX + tileX].push_back(index);
+	}
+}
+
+void OcclusionBuffer::rasterize(JobSystem& jobs)
+{
+	jobs.parallelFor(TilesX * TilesY, 1, [this](uint32_t begin, uint32_t end) {
+		for (uint32_t tile = begin; tile < end; tile++)
+			rasterizeTile(tile);
+	});
+}
+
+void OcclusionBuffer::rasterizeTile(uint32_t tile)
+{
+	int tileX = static_cast<int>(tile % TilesX * TileSize);
+	int tileY = static_cast<int>(tile / TilesX * TileSize);
+
+	for (uint32_t index : m_bins[tile])
+	{
+		const Triangle& t = m_triangles[index];
+
+		//Start on a whole SIMD step; the lanes before the triangle's bounds fail the edge tests
+		int x0 = std::max(t.minX, tileX) & ~(FloatN::Width - 1);
+		int x1 = std::min(t.maxX, tileX + static_cast<int>(TileSize) - 1);
+		int y0 = std::max(t.minY, tileY);
+		int y1 = std::min(t.maxY, tileY + static_cast<int>(TileSize) - 1);
+
+		FloatN edgeA[3], depthA = FloatN::splat(t.depthA);
+		for (int i = 0; i < 3; i++)
+			edgeA[i] = FloatN::splat(t.edgeA[i]);
+
+		for (int y = y0; y <= y1; y++)
+		{
+			float py = y + 0.5f;
+			FloatN rowEdge[3];
+			for (int i = 0; i < 3; i++)
+				rowEdge[i] = FloatN::splat(t.edgeB[i] * py + t.edgeC[i]);
+			FloatN rowDepth = FloatN::splat(t.depthB * py + t.depthC);
+
+			float* row = &m_depth[y * Width];
+			FloatN px = FloatN::splat(x0 + 0.5f) + FloatN::ramp();
+			const FloatN step = FloatN::splat(static_cast<float>(FloatN::Width));
+			for (int x = x0; x <= x1; x += FloatN::Width, px = px + step)
+			{
+				FloatN inside = FloatN::nonNegative(edgeA[0] * px + rowEdge[0]) & FloatN::nonNegative(edgeA[1] * px + rowEdge[1]) &
+					FloatN::nonNegative(edgeA[2] * px + rowEdge[2]);
+				if (!FloatN::any(inside))
+					continue;
+				FloatN depth = FloatN::load(row + x);
+				FloatN::select(inside, depth, FloatN::min(depth, depthA * px + rowDepth)).store(row + x);
+			}
+		}
+	}
+
+	//Keep each block's furthest depth for the coarse test
+	for (uint32_t blockY = tileY / BlockSize; blockY < (tileY + TileSize) / BlockSize; blockY++)
+	{
+		for (uint32_t blockX = tileX / BlockSize; blockX < (tileX + TileSize) / BlockSize; blockX++)
+		{
+			float furthest = 0.0f;
+			for (uint32_t y = blockY * BlockSize; y < (blockY + 1) * BlockSize; y++)
+			{
+				const float* row = &m_depth[y * Width + blockX * BlockSize];
+				furthest = std::max(furthest, *std::max_element(row, row + BlockSize));
+			}
+			m_blockDepth[blockY * BlocksX + blockX] = furthest;
+		}
+	}
+}
+
+bool OcclusionBuffer::visible(const AABB& box) const
+{
+	if (box.empty())
+		return false;
+
+	//Screen rectangle and nearest depth of the box's corners
+	glm::vec3 minWindow(FLT_MAX), maxWindow(-FLT_MAX);
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+		glm::vec4 clip = m_viewProjection * glm::vec4(corner, 1.0f);
+		if (clip.z + clip.w < 0)
+			return true;
+		glm::vec3 window = toWindow(clip);
+		minWindow = glm::min(minWindow, window);
+		maxWindow = glm::max(maxWindow, window);
+	}
+	if (maxWindow.x < 0 || maxWindow.y < 0 || minWindow.x >= Width || minWindow.y >= Height)
+		return true;
+
+	//Every pixel the rectangle touches
+	int x0 = std::max(static_cast<int>(std::floor(minWindow.x)), 0);
+	int x1 = std::min(static_cast<int>(std::floor(maxWindow.x)), static_cast<int>(Width) - 1);
+	int y0 = std::max(static_cast<int>(std::floor(minWindow.y)), 0);
+	int y1 = std::min(static_cast<int>(std::floor(maxWindow.y)), static_cast<int>(Height) - 1);
+	float nearest = minWindow.z;
+
+	for (int blockY = y0 / static_cast<int>(BlockSize); blockY <= y1 / static_cast<int>(BlockSize); blockY++)
+	{
+		for (int blockX = x0 / static_cast<int>(BlockSize); blockX <= x1 / static_cast<int>(BlockSize); blockX++)
+		{
+			//A block entirely in front of the box hides its part of it
+			if (m_blockDepth[blockY * BlocksX + blockX] < nearest)
+				continue;
+
+			int bx0 = std::max(x0, blockX * static_cast<int>(BlockSize)), bx1 = std::min(x1, (blockX + 1) * static_cast<int>(BlockSize) - 1);
+			int by0 = std::max(y0, blockY * static_cast<int>(BlockSize)), by1 = std::min(y1, (blockY + 1) * static_cast<int>(BlockSize) - 1);
+			for (int y = by0; y <= by1; y++)
+			{
+				for (int x = bx0; x <= bx1; x++)
+				{
+					if (m_depth[y * Width + x] >= nearest)
+						return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+void OcclusionBuffer::test(const AABB* boxes, uint32_t count, uint8_t* visible) const
+{
+	for (uint32_t i = 0; i < count; i++)
+		visible[i] = this->visible(boxes[i]) ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Bounds.h"
+#include "JobSystem.h"
+
+class Mesh3D;
+
+/**
+ * @brief A small software depth buffer of the camera's view, rasterized on the CPU from a few large occluders so
+ * that anything hidden behind them can be skipped before its draws reach the GPU.
+ *
+ * Each frame, begin() it with the camera's view-projection, add the occluders' simplified triangles, and
+ * rasterize(). Triangles are clipped to the near plane, projected and binned into tiles as they are added; the
+ * tiles are then rasterized in parallel, eight pixels per AVX step (four with SSE), each keeping the nearest depth.
+ * A pixel is covered when its center is inside a triangle, and takes the triangle's furthest depth over the whole
+ * pixel, so occluders never come nearer than they are. Every block of 8x8 pixels also keeps its furthest depth, so testing a
+ * box can usually skip whole blocks.
+ *
+ * A box is hidden when its nearest point is behind every pixel its screen rectangle touches. Depths are window
+ * depths in [0, 1], nearer is smaller.
+ */
+class OcclusionBuffer {
+public:
+	static const uint32_t Width = 256;
+	static const uint32_t Height = 128;
+	static const uint32_t TileSize = 32;
+	static const uint32_t TilesX = Width / TileSize;
+	static const uint32_t TilesY = Height / TileSize;
+	static const uint32_t BlockSize = 8;
+	static const uint32_t BlocksX = Width / BlockSize;
+	static const uint32_t BlocksY = Height / BlockSize;
+
+private:
+	// A screen-space triangle set up for rasterizing: three edge functions A * x + B * y + C, positive inside, and
+	// its depth plane raised to the furthest depth over a pixel. The bounds are the pixels it may cover.
+	struct Triangle {
+		float edgeA[3], edgeB[3], edgeC[3];
+		float depthA, depthB, depthC;
+		int minX, minY, maxX, maxY;
+	};
+
+	glm::mat4 m_viewProjection;
+	std::vector<float> m_depth;
+	std::vector<float> m_blockDepth;
+	std::vector<Triangle> m_triangles;
+	std::vector<uint32_t> m_bins[TilesX * TilesY];
+	// Clip-space positions of the occluder being added.
+	std::vector<glm::vec4> m_clip;
+
+	void addTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+	// Adds the faces indexing into m_clip, once the vertices have been transformed into it.
+	void addFaces(const std::vector<uint32_t>& faces);
+	void setupTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+	void rasterizeTile(uint32_t tile);
+
+public:
+	OcclusionBuffer();
+
+	/**
+	 * @brief Clears the buffer and its occluders, ready to draw the view seen through the given matrix.
+	 */
+	void begin(const glm::mat4& viewProjection);
+
+	/**
+	 * @brief Clips, projects and bins the triangles of an occluder drawn with the given model matrix. Faces
+	 * pointing away from the camera are skipped.
+	 */
+	void addOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& faces, const glm::mat4& model);
+	void addOccluder(const Mesh3D& mesh, const glm::mat4& model);
+
+	/**
+	 * @brief Rasterizes the binned triangles, one tile per job.
+	 */
+	void rasterize(JobSystem& jobs);
+
+	/**
+	 * @brief Whether any part of a world-space box may be visible past the occluders. Boxes reaching behind the
+	 * near plane or off the screen are always visible.
+	 */
+	bool visible(const AABB& box) const;
+
+	/**
+	 * @brief Sets visible[i] to whether boxes[i] may be visible.
+	 */
+	void test(const AABB* boxes, uint32_t count, uint8_t* visible) const;
+
+	float depth(uint32_t x, uint32_t y) const { return m_depth[y * Width + x]; }
+	uint32_t triangleCount() const { return static_cast<uint32_t>(m_triangles.size()); }
+};
@@ -0,0 +1,129 @@
+#include "OcclusionQueries.h"
+
+OcclusionQueries::OcclusionQueries(uint32_t visibleInterval) : m_visibleInterval(visibleInterval), m_frame(0), m_hidden(0)
+{
+	//A unit cube centered on the origin
+	const float vertices[] = {
+		-0.5f, -0.5f, -0.5f,   0.5f, -0.5f, -0.5f,   0.5f, 0.5f, -0.5f,   -0.5f, 0.5f, -0.5f,
+		-0.5f, -0.5f, 0.5f,    0.5f, -0.5f, 0.5f,    0.5f, 0.5f, 0.5f,    -0.5f, 0.5f, 0.5f
+	};
+	const uint32_t indices[] = {
+		0, 2, 1, 0, 3, 2,   4, 5, 6, 4, 6, 7,   0, 1, 5, 0, 5, 4,
+		3, 6, 2, 3, 7, 6,   0, 4, 7, 0, 7, 3,   1, 2, 6, 1, 6, 5
+	};
+
+	glGenVertexArrays(1, &m_vao);
+	glGenBuffers(1, &m_vbo);
+	glGenBuffers(1, &m_ebo);
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, false, 3 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+
+	m_shader.load("Shaders/occlusionQuery.vert", "Shaders/occlusionQuery.frag");
+}
+
+OcclusionQueries::~OcclusionQueries()
+{
+	for (auto& object : m_objects)
+	{
+		if (!object.pending.empty())
+			glDeleteQueries(static_cast<GLsizei>(object.pending.size()), object.pending.data());
+	}
+	if (!m_freeQueries.empty())
+		glDeleteQueries(static_cast<GLsizei>(m_freeQueries.size()), m_freeQueries.data());
+	glDeleteBuffers(1, &m_ebo);
+	glDeleteBuffers(1, &m_vbo);
+	glDeleteVertexArrays(1, &m_vao);
+}
+
+void OcclusionQueries::beginFrame()
+{
+	//Results arrive in the order queries were issued, so stop at an object's first one still in flight
+	m_hidden = 0;
+	for (auto& object : m_objects)
+	{
+		size_t read = 0;
+		for (; read < object.pending.size(); read++)
+		{
+			GLuint available = 0;
+			glGetQueryObjectuiv(object.pending[read], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+			GLuint passed = 0;
+			glGetQueryObjectuiv(object.pending[read], GL_QUERY_RESULT, &passed);
+			object.visible = passed != 0;
+			m_freeQueries.push_back(object.pending[read]);
+		}
+		object.pending.erase(object.pending.begin(), object.pending.begin() + read);
+		if (!object.visible)
+			m_hidden++;
+	}
+
+	m_requests.clear();
+	m_frame++;
+}
+
+uint32_t OcclusionQueries::request(uint32_t id, const AABB& bounds, const glm::vec3& eye)
+{
+	if (id >= m_objects.size())
+		m_objects.resize(id + 1);
+	Object& object = m_objects[id];
+
+	//Keep the box clear of the near plane with room to spare
+	AABB reach(bounds.min - glm::vec3(0.5f), bounds.max + glm::vec3(0.5f));
+	if (bounds.empty() || reach.contains(AABB(eye, eye)))
+	{
+		object.visible = true;
+		return 0;
+	}
+
+	if (object.visible && (m_frame + id) % m_visibleInterval != 0)
+		return 0;
+
+	uint32_t query;
+	if (!m_freeQueries.empty())
+	{
+		query = m_freeQueries.back();
+		m_freeQueries.pop_back();
+	}
+	else
+		glGenQueries(1, &query);
+	object.pending.push_back(query);
+	m_requests.push_back({ query, bounds });
+	return query;
+}
+
+void OcclusionQueries::issue(const glm::mat4& viewProjection)
+{
+	if (m_requests.empty())
+		return;
+
+	//Only depth testing matters; boxes are tested from both sides and leave no trace
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	GLboolean culling = glIsEnabled(GL_CULL_FACE);
+	glDisable(GL_CULL_FACE);
+
+	m_shader.activate();
+	glBindVertexArray(m_vao);
+	for (const Request& request : m_requests)
+	{
+		glm::mat4 box = glm::translate(glm::mat4(1.0f), request.bounds.center()) * glm::scale(glm::mat4(1.0f), request.bounds.max - request.bounds.min);
+		m_shader.setUniform("boxTransform", viewProjection * box);
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, request.query);
+		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void*)0);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+	}
+	glBindVertexArray(0);
+	m_shader.disable();
+
+	if (culling)
+		glEnable(GL_CULL_FACE);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
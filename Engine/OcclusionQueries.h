@@ -0,0 +1,79 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Bounds.h"
+#include "Shader.h"
+
+/**
+ * @brief GPU occlusion queries for expensive objects: each object's bounding box is drawn against the depth of
+ * what has been drawn so far, and the object's own draws are made conditional on whether any sample passed.
+ *
+ * Draws are skipped on the GPU with glBeginConditionalRender in GL_QUERY_NO_WAIT mode, so if a result is not ready
+ * in time the object is simply drawn. Results are also read back on the CPU, but only once they are available, to
+ * decide which objects need querying: objects last found hidden are queried every frame, while visible ones are
+ * drawn unconditionally and only checked again every few frames, staggered so the queries spread out. Nothing
+ * ever waits for a result.
+ *
+ * Each frame: beginFrame(), request() a query for every expensive object the camera may see while queuing its
+ * draws, then issue() the queries between the draws that occlude and the draws that depend on them.
+ */
+class OcclusionQueries {
+private:
+	struct Object {
+		// The latest result read back; objects start out visible.
+		bool visible = true;
+		// Queries issued for the object whose results have not been read yet, oldest first.
+		std::vector<uint32_t> pending;
+	};
+
+	struct Request {
+		uint32_t query;
+		AABB bounds;
+	};
+
+	// Objects by id, such as an entity index.
+	std::vector<Object> m_objects;
+	std::vector<Request> m_requests;
+	std::vector<uint32_t> m_freeQueries;
+	uint32_t m_visibleInterval;
+	uint64_t m_frame;
+	uint32_t m_hidden;
+
+	uint32_t m_vao;
+	uint32_t m_vbo;
+	uint32_t m_ebo;
+	Shader m_shader;
+
+public:
+	/**
+	 * @brief Creates the box geometry and shader. Visible objects are queried once every visibleInterval frames.
+	 */
+	explicit OcclusionQueries(uint32_t visibleInterval = 8);
+	OcclusionQueries(const OcclusionQueries&) = delete;
+	OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+	~OcclusionQueries();
+
+	/**
+	 * @brief Reads back whichever results have arrived, without waiting, and starts a new frame of requests.
+	 */
+	void beginFrame();
+
+	/**
+	 * @brief Decides whether an object is queried this frame. Returns the query its camera draws should depend
+	 * on, or 0 to draw them unconditionally. Objects whose bounds reach the camera's near plane are never queried,
+	 * as their box would be clipped.
+	 */
+	uint32_t request(uint32_t id, const AABB& bounds, const glm::vec3& eye);
+
+	/**
+	 * @brief Draws the bounding box of every object requested this frame into its query, without writing color or
+	 * depth. Changes the active shader.
+	 */
+	void issue(const glm::mat4& viewProjection);
+
+	// Queries issued this frame, and objects whose latest result found them hidden.
+	uint32_t issued() const { return static_cast<uint32_t>(m_requests.size()); }
+	uint32_t hidden() const { return m_hidden; }
+};
@@ -0,0 +1,151 @@
+#include "PointShadowMap.h"
+
+#include <cmath>
+#include <string>
+#include <glm/ext.hpp>
+
+namespace {
+	//Near plane of the face projections
+	const float FaceNear = 0.05f;
+}
+
+PointShadowMap::PointShadowMap(ShadowAtlas& atlas) : m_atlas(atlas), m_position(0.0f), m_radius(0.0f), m_stale(AllFaces)
+{
+}
+
+PointShadowMap::~PointShadowMap()
+{
+	for (AtlasTile& tile : m_tiles)
+		m_atlas.release(tile);
+}
+
+float PointShadowMap::radiusFor(float linear, float quadratic, float cutoff)
+{
+	//Solve 1 / (1 + linear * d + quadratic * d^2) = cutoff for d
+	float c = 1.0f - 1.0f / cutoff;
+	if (quadratic <= 0.0f)
+		return linear > 0.0f ? -c / linear : 0.0f;
+	return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+}
+
+void PointShadowMap::setLight(const glm::vec3& position, float radius)
+{
+	if (position == m_position && radius == m_radius)
+		return;
+	m_position = position;
+	m_radius = radius;
+	m_stale = AllFaces;
+
+	//The cube map faces in GL order, looking down +X, -X, +Y, -Y, +Z and -Z
+	const glm::vec3 directions[FaceCount] = {
+		glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+	};
+	const glm::vec3 ups[FaceCount] = {
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+		glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+	};
+	glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, FaceNear, m_radius);
+	for (uint32_t face = 0; face < FaceCount; face++)
+	{
+		m_faces[face] = projection * glm::lookAt(m_position, m_position + directions[face], ups[face]);
+		m_faceFrusta[face] = Frustum(m_faces[face]);
+	}
+}
+
+uint32_t PointShadowMap::resolutionFor(const glm::vec3& eye, float fovy, uint32_t screenHeight, uint32_t minSize, uint32_t maxSize) const
+{
+	//Radius in pixels of the light's reach seen from the eye, or the largest size from inside it
+	float distance = glm::length(eye - m_position);
+	if (distance <= m_radius)
+		return maxSize;
+	float pixels = m_radius / (distance * std::tan(fovy * 0.5f)) * screenHeight * 0.5f;
+
+	uint32_t size = minSize;
+	while (size < pixels && size < maxSize)
+		size <<= 1;
+	return size;
+}
+
+void PointShadowMap::setResolution(uint32_t size)
+{
+	//Grow as soon as more texels are wanted, but only shrink once half as many would do, so that a light at the
+	//edge between two sizes does not keep moving
+	uint32_t current = m_tiles[0].size;
+	if (size == current || (size < current && size * 2 > current))
+		return;
+
+	for (AtlasTile& tile : m_tiles)
+		m_atlas.release(tile);
+	for (; size > 0; size /= 2)
+	{
+		bool allocated = true;
+		for (AtlasTile& tile : m_tiles)
+		{
+			tile = m_atlas.allocate(size);
+			allocated = allocated && tile.valid();
+		}
+		if (allocated)
+			break;
+		for (AtlasTile& tile : m_tiles)
+			m_atlas.release(tile);
+	}
+	m_stale = AllFaces;
+}
+
+void PointShadowMap::invalidate(const AABB& box)
+{
+	if (box.empty())
+		return;
+	for (uint32_t face = 0; face < FaceCount; face++)
+	{
+		if (!(m_stale & (1u << face)) && m_faceFrusta[face].intersects(box))
+			m_stale |= 1u << face;
+	}
+}
+
+void PointShadowMap::begin(Shader& shader)
+{
+	m_atlas.bind();
+	for (uint32_t face = 0; face < FaceCount; face++)
+	{
+		std::string index = "[" + std::to_string(face) + "]";
+		if (m_stale & (1u << face))
+			m_atlas.clear(m_tiles[face]);
+		shader.setUniform("faceMatrices" + index, m_faces[face]);
+		shader.setUniform("faceRects" + index, m_atlas.clipRect(m_tiles[face]));
+	}
+	shader.setUniform("faceMask", static_cast<int32_t>(m_stale));
+	shader.setUniform("lightPosition", m_position);
+	shader.setUniform("farPlane", m_radius);
+
+	//Keep each face's triangles inside its tile
+	for (uint32_t plane = 0; plane < 4; plane++)
+		glEnable(GL_CLIP_DISTANCE0 + plane);
+}
+
+uint32_t PointShadowMap::end()
+{
+	for (uint32_t plane = 0; plane < 4; plane++)
+		glDisable(GL_CLIP_DISTANCE0 + plane);
+
+	uint32_t rendered = 0;
+	for (uint32_t face = 0; face < FaceCount; face++)
+		rendered += (m_stale >> face) & 1u;
+	m_stale = 0;
+	return rendered;
+}
+
+void PointShadowMap::setUniforms(Shader& shader, const std::string& name, uint32_t index) const
+{
+	//A far distance of 0 turns the light's shadows off while it has no tiles
+	std::string light = name + "[" + std::to_string(index) + "].";
+	shader.setUniform(light + "far", m_tiles[0].valid() ? m_radius : 0.0f);
+	for (uint32_t face = 0; face < FaceCount; face++)
+		shader.setUniform(light + "rects[" + std::to_string(face) + "]", m_atlas.uvRect(m_tiles[face]));
+}
+
+Frustum PointShadowMap::bounds() const
+{
+	return Frustum(glm::ortho(-m_radius, m_radius, -m_radius, m_radius, -m_radius, m_radius) * glm::translate(glm::mat4(1.0f), -m_position));
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+
+#include "Bounds.h"
+#include "Frustum.h"
+#include "Shader.h"
+#include "ShadowAtlas.h"
+
+/**
+ * @brief Omnidirectional shadows of a point light, as six cube faces in tiles of a ShadowAtlas, each holding
+ * the distance to the nearest caster divided by the light's radius.
+ *
+ * The faces are cached: a face is only rendered again when a caster moves through it, when the light moves or
+ * when its tiles change size. All stale faces are rendered in a single pass, with a geometry shader sending
+ * each triangle to the stale faces it touches and clip distances keeping it inside each face's tile. The tile
+ * size follows how large the light's reach appears on screen.
+ *
+ * Each frame: setLight(), setResolution(), invalidate() the old and new bounds of everything that moved, and if
+ * staleFaces() is not 0, render every caster within bounds() between begin() and end() with a shader built from
+ * the pointShadow shaders. Shaders sampling the atlas get setUniforms() for the light's rectangles.
+ */
+class PointShadowMap {
+public:
+	static const uint32_t FaceCount = 6;
+	static const uint32_t AllFaces = (1u << FaceCount) - 1;
+
+private:
+	ShadowAtlas& m_atlas;
+	AtlasTile m_tiles[FaceCount];
+	glm::vec3 m_position;
+	float m_radius;
+	glm::mat4 m_faces[FaceCount];
+	Frustum m_faceFrusta[FaceCount];
+	uint32_t m_stale;
+
+public:
+	explicit PointShadowMap(ShadowAtlas& atlas);
+	PointShadowMap(const PointShadowMap&) = delete;
+	PointShadowMap& operator=(const PointShadowMap&) = delete;
+	~PointShadowMap();
+
+	/**
+	 * @brief The distance at which a light with the given attenuation falls to cutoff of its intensity.
+	 */
+	static float radiusFor(float linear, float quadratic, float cutoff = 1.0f / 64.0f);
+
+	/**
+	 * @brief Places the light, marking every face stale if it moved or its radius changed.
+	 */
+	void setLight(const glm::vec3& position, float radius);
+
+	/**
+	 * @brief The face size in texels matching how many pixels the light's reach covers on a screen of the given
+	 * height, rounded to a power of two between minSize and maxSize.
+	 */
+	uint32_t resolutionFor(const glm::vec3& eye, float fovy, uint32_t screenHeight, uint32_t minSize, uint32_t maxSize) const;
+
+	/**
+	 * @brief Moves the faces to tiles of the given size, if it differs enough from the current one, marking them
+	 * stale. Falls back to smaller tiles while the atlas is full; without any the light casts no shadows.
+	 */
+	void setResolution(uint32_t size);
+
+	/**
+	 * @brief Marks the faces a box can be seen through as stale.
+	 */
+	void invalidate(const AABB& box);
+	void invalidateAll() { m_stale = AllFaces; }
+
+	/**
+	 * @brief Binds the atlas, clears the stale faces' tiles and sets the face matrices and tiles on the active
+	 * shader, which then only draws into the stale faces.
+	 */
+	void begin(Shader& shader);
+
+	/**
+	 * @brief Marks the faces rendered since begin() as up to date, returning how many there were.
+	 */
+	uint32_t end();
+
+	/**
+	 * @brief Sets the light's far distance and face rectangles on a shader sampling the atlas, as element index
+	 * of the array uniform name.
+	 */
+	void setUniforms(Shader& shader, const std::string& name, uint32_t index) const;
+
+	// Bit per face that must be rendered again, 0 while the light has no tiles.
+	uint32_t staleFaces() const { return m_tiles[0].valid() ? m_stale : 0; }
+	// Texels per face edge, 0 without tiles.
+	uint32_t resolution() const { return m_tiles[0].size; }
+	float radius() const { return m_radius; }
+	// The box around the light holding every caster it can see.
+	Frustum bounds() const;
+};
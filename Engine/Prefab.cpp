@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include "Prefab.h"
+#include "AssimpImport.h"
+
+const uint32_t Prefab::NoParent;
+
+Prefab::Prefab(const Object3D& root)
+{
+	flatten(root, NoParent);
+}
+
+void Prefab::flatten(const Object3D& object, uint32_t parent)
+{
+	Node node;
+	node.mesh = object.getSharedMesh();
+	node.parent = parent;
+	node.local = object.getModelMatrix();
+	node.prefabMatrix = parent == NoParent ? node.local : m_nodes[parent].prefabMatrix * node.local;
+	node.material = object.getMaterial();
+	m_bounds.expand(node.mesh->bounds().transformed(node.prefabMatrix));
+
+	uint32_t index = static_cast<uint32_t>(m_nodes.size());
+	m_nodes.push_back(std::move(node));
+	for (int i = 0; i < object.numChildren; i++)
+		flatten(object.getChild(i), index);
+}
+
+std::shared_ptr<const Prefab> Prefab::load(const std::string& path, bool flipTextureCoords, bool genNormals, bool genUV)
+{
+	//Prefabs still in use, by path and import options
+	static std::unordered_map<std::string, std::weak_ptr<const Prefab>> loaded;
+
+	std::string key = path + (flipTextureCoords ? "|f" : "|") + (genNormals ? "n" : "") + (genUV ? "u" : "");
+	if (auto prefab = loaded[key].lock())
+		return prefab;
+
+	auto prefab = std::make_shared<const Prefab>(assimpLoad(path, flipTextureCoords, genNormals, genUV));
+	loaded[key] = prefab;
+	return prefab;
+}
+
+PrefabInstance::PrefabInstance(std::shared_ptr<const Prefab> prefab) : m_prefab(std::move(prefab)), m_transform(TransformSystem::shared().create(glm::mat4(1))),
+	m_material(0), m_hasMaterial(false), m_shadowProxyError(0), m_hasTransformOverrides(false)
+{
+}
+
+PrefabInstance::PrefabInstance(PrefabInstance&& other) noexcept : m_prefab(std::move(other.m_prefab)), m_transform(other.m_transform), m_material(other.m_material),
+	m_hasMaterial(other.m_hasMaterial), m_shadowProxyError(other.m_shadowProxyError), m_overrides(std::move(other.m_overrides)),
+	m_hasTransformOverrides(other.m_hasTransformOverrides)
+{
+	other.m_transform = TransformHandle();
+}
+
+PrefabInstance& PrefabInstance::operator=(PrefabInstance&& other) noexcept
+{
+	if (this != &other)
+	{
+		TransformSystem::shared().destroy(m_transform);
+		m_prefab = std::move(other.m_prefab);
+		m_transform = other.m_transform;
+		other.m_transform = TransformHandle();
+		m_material = other.m_material;
+		m_hasMaterial = other.m_hasMaterial;
+		m_shadowProxyError = other.m_shadowProxyError;
+		m_overrides = std::move(other.m_overrides);
+		m_hasTransformOverrides = other.m_hasTransformOverrides;
+	}
+	return *this;
+}
+
+PrefabInstance::~PrefabInstance()
+{
+	TransformSystem::shared().destroy(m_transform);
+}
+
+void PrefabInstance::setMaterial(const glm::vec4& material)
+{
+	m_material = material;
+	m_hasMaterial = true;
+}
+
+void PrefabInstance::setShadowProxyError(float maxError)
+{
+	m_shadowProxyError = maxError;
+}
+
+PrefabInstance::NodeOverride& PrefabInstance::overrideFor(uint32_t node)
+{
+	auto found = std::lower_bound(m_overrides.begin(), m_overrides.end(), node, [](const NodeOverride& o, uint32_t n) { return o.node < n; });
+	if (found == m_overrides.end() || found->node != node)
+	{
+		NodeOverride added;
+		added.node = node;
+		added.flags = 0;
+		found = m_overrides.insert(found, added);
+	}
+	return *found;
+}
+
+void PrefabInstance::setNodeHidden(uint32_t node, bool hidden)
+{
+	NodeOverride& nodeOverride = overrideFor(node);
+	nodeOverride.flags = hidden ? nodeOverride.flags | NodeOverride::Hidden : nodeOverride.flags & ~NodeOverride::Hidden;
+}
+
+void PrefabInstance::setNodeMaterial(uint32_t node, const glm::vec4& material)
+{
+	NodeOverride& nodeOverride = overrideFor(node);
+	nodeOverride.flags |= NodeOverride::Material;
+	nodeOverride.material = material;
+}
+
+void PrefabInstance::setNodeTransform(uint32_t node, const glm::mat4& local)
+{
+	NodeOverride& nodeOverride = overrideFor(node);
+	nodeOverride.flags |= NodeOverride::Transform;
+	nodeOverride.local = local;
+	m_hasTransformOverrides = true;
+}
+
+AABB PrefabInstance::worldBounds() const
+{
+	if (!m_hasTransformOverrides)
+		return m_prefab->bounds().transformed(TransformSystem::shared().world(m_transform));
+
+	AABB bounds;
+	forEachNode([&](const Mesh3D& mesh, const glm::mat4& model, const glm::vec4&) {
+		bounds.expand(mesh.bounds().transformed(model));
+	});
+	return bounds;
+}
+
+void PrefabInstance::enqueue(RenderQueue& queue, uint32_t views) const
+{
+	if (!m_hasTransformOverrides)
+	{
+		uint32_t visible = queue.visibleViews(m_prefab->bounds().transformed(TransformSystem::shared().world(m_transform)), views);
+		queue.reportCulled(views & ~visible, static_cast<uint32_t>(m_prefab->nodes().size()));
+		views = visible;
+		if (views == 0)
+			return;
+	}
+
+	forEachNode([&](const Mesh3D& mesh, const glm::mat4& model, const glm::vec4& material) {
+		if (m_shadowProxyError > 0.0f)
+			queue.add(mesh, model, material, mesh.shadowProxy(m_shadowProxyError, model).range, views);
+		else
+			queue.add(mesh, model, material, views);
+	});
+}
@@ -0,0 +1,157 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Object3D.h"
+
+/**
+ * @brief A model's node hierarchy, loaded once and shared by every instance placed from it. Never changes after
+ * it is built.
+ */
+class Prefab {
+public:
+	static const uint32_t NoParent = UINT32_MAX;
+
+	struct Node {
+		std::shared_ptr<Mesh3D> mesh;
+		// Index of the parent node; parents always come before their children.
+		uint32_t parent;
+		// The node's matrix relative to its parent, and relative to the prefab's root.
+		glm::mat4 local;
+		glm::mat4 prefabMatrix;
+		glm::vec4 material;
+	};
+
+private:
+	std::vector<Node> m_nodes;
+	// Bounds of every node's mesh, in the prefab's coordinates.
+	AABB m_bounds;
+
+	void flatten(const Object3D& object, uint32_t parent);
+
+public:
+	/**
+	 * @brief Builds a prefab from an object hierarchy, keeping its meshes, matrices and materials.
+	 */
+	explicit Prefab(const Object3D& root);
+
+	const std::vector<Node>& nodes() const { return m_nodes; }
+	const AABB& bounds() const { return m_bounds; }
+
+	/**
+	 * @brief Loads a model through assimpLoad, or returns the prefab already loaded from the same path.
+	 */
+	static std::shared_ptr<const Prefab> load(const std::string& path, bool flipTextureCoords, bool genNormals, bool genUV);
+};
+
+/**
+ * @brief One placement of a prefab. Stores only its root transform and whatever it overrides, so thousands of
+ * instances cost little more than their transforms.
+ */
+class PrefabInstance {
+private:
+	// Changes to one node of the prefab, kept sorted by node.
+	struct NodeOverride {
+		enum Flags : uint8_t { Hidden = 1, Material = 2, Transform = 4 };
+
+		uint32_t node;
+		uint8_t flags;
+		glm::vec4 material;
+		glm::mat4 local;
+	};
+
+	std::shared_ptr<const Prefab> m_prefab;
+
+	// The instance's root transform, in the shared TransformSystem.
+	TransformHandle m_transform;
+
+	// Material replacing every node's own, if set.
+	glm::vec4 m_material;
+	bool m_hasMaterial;
+
+	float m_shadowProxyError;
+	std::vector<NodeOverride> m_overrides;
+	bool m_hasTransformOverrides;
+
+	NodeOverride& overrideFor(uint32_t node);
+
+public:
+	explicit PrefabInstance(std::shared_ptr<const Prefab> prefab);
+
+	// Instances own their transform slot, so they can be moved but never copied.
+	PrefabInstance(const PrefabInstance&) = delete;
+	PrefabInstance(PrefabInstance&& other) noexcept;
+	PrefabInstance& operator=(const PrefabInstance&) = delete;
+	PrefabInstance& operator=(PrefabInstance&& other) noexcept;
+	~PrefabInstance();
+
+	const Prefab& prefab() const { return *m_prefab; }
+	TransformHandle getTransform() const { return m_transform; }
+
+	// Overrides for the whole instance.
+	void setMaterial(const glm::vec4& material);
+	void setShadowProxyError(float maxError);
+	float getShadowProxyError() const { return m_shadowProxyError; }
+
+	// Sparse overrides for single nodes of the prefab.
+	void setNodeHidden(uint32_t node, bool hidden);
+	void setNodeMaterial(uint32_t node, const glm::vec4& material);
+	void setNodeTransform(uint32_t node, const glm::mat4& local);
+	size_t overrideCount() const { return m_overrides.size(); }
+
+	/**
+	 * @brief Calls f(mesh, model, material) for every visible node, with its world matrix and overrides applied.
+	 */
+	template <typename F>
+	void forEachNode(F&& f) const;
+
+	/**
+	 * @brief The world bounds of the instance's visible nodes.
+	 */
+	AABB worldBounds() const;
+
+	/**
+	 * @brief Queues every visible node for the given views, unless none of them can see the instance's bounds.
+	 * Nodes moved by transform overrides are not covered by the prefab's bounds, so instances with any skip that
+	 * test.
+	 */
+	void enqueue(RenderQueue& queue, uint32_t views = RenderQueue::AllViews) const;
+};
+
+template <typename F>
+void PrefabInstance::forEachNode(F&& f) const
+{
+	const glm::mat4& root = TransformSystem::shared().world(m_transform);
+	const auto& nodes = m_prefab->nodes();
+
+	//Node matrices only need recomputing down the hierarchy when a node's transform is overridden
+	thread_local std::vector<glm::mat4> worlds;
+	if (m_hasTransformOverrides)
+		worlds.resize(nodes.size());
+
+	auto next = m_overrides.begin();
+	for (uint32_t i = 0; i < nodes.size(); i++)
+	{
+		const Prefab::Node& node = nodes[i];
+		const NodeOverride* nodeOverride = nullptr;
+		if (next != m_overrides.end() && next->node == i)
+			nodeOverride = &*next++;
+
+		glm::mat4 model;
+		if (m_hasTransformOverrides)
+		{
+			const glm::mat4& local = nodeOverride && (nodeOverride->flags & NodeOverride::Transform) ? nodeOverride->local : node.local;
+			worlds[i] = (node.parent == Prefab::NoParent ? root : worlds[node.parent]) * local;
+			model = worlds[i];
+		}
+		else
+			model = root * node.prefabMatrix;
+
+		if (nodeOverride && (nodeOverride->flags & NodeOverride::Hidden))
+			continue;
+		const glm::vec4& material = nodeOverride && (nodeOverride->flags & NodeOverride::Material) ? nodeOverride->material
+			: m_hasMaterial ? m_material : node.material;
+		f(*node.mesh, model, material);
+	}
+}
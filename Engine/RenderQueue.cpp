@@ -0,0 +1,420 @@
+#include "RenderQueue.h"
+#include "GLExtensions.h"
+#include "Mesh3D.h"
+#include "OcclusionBuffer.h"
+#include <algorithm>
+#include <cfloat>
+
+RenderQueue::RenderQueue(StreamBuffer& stream) : m_culledViews(0), m_stream(stream), m_drawDataBuffer(0), m_dirty(false), m_drawn(0), m_drawCalls(0), m_triangles(0)
+{
+	//Per-draw data is read through a buffer texture so any number of draws can be indexed from the shaders
+	glGenTextures(1, &m_drawDataTexture);
+	std::fill(std::begin(m_culled), std::end(m_culled), 0);
+	std::fill(std::begin(m_visible), std::end(m_visible), 0);
+	std::fill(std::begin(m_occlusion), std::end(m_occlusion), nullptr);
+	std::fill(std::begin(m_occluded), std::end(m_occluded), 0);
+}
+
+void RenderQueue::clear()
+{
+	m_items.clear();
+	m_culledViews = 0;
+	std::fill(std::begin(m_culled), std::end(m_culled), 0);
+	std::fill(std::begin(m_visible), std::end(m_visible), 0);
+	std::fill(std::begin(m_occlusion), std::end(m_occlusion), nullptr);
+	std::fill(std::begin(m_occluded), std::end(m_occluded), 0);
+	m_dirty = true;
+}
+
+void RenderQueue::setFrustum(uint32_t view, const Frustum& frustum)
+{
+	m_frusta[view] = frustum;
+	m_culledViews |= 1u << view;
+}
+
+void RenderQueue::setOcclusion(uint32_t view, const OcclusionBuffer* occlusion)
+{
+	m_occlusion[view] = occlusion;
+	m_culledViews |= 1u << view;
+}
+
+uint32_t RenderQueue::visibleViews(const AABB& bounds, uint32_t candidates) const
+{
+	uint32_t visible = candidates;
+	for (uint32_t views = candidates & m_culledViews; views != 0; views &= views - 1)
+	{
+		uint32_t view = glm::findLSB(views);
+		if (!m_frusta[view].intersects(bounds))
+			visible &= ~(1u << view);
+	}
+	return visible;
+}
+
+void RenderQueue::visibleBounds(uint32_t view, std::vector<AABB>& bounds) const
+{
+	bounds.clear();
+	for (auto& item : m_items)
+	{
+		if (item.viewMask & (1u << view))
+			bounds.push_back(item.bounds);
+	}
+}
+
+void RenderQueue::reportCulled(uint32_t views, uint32_t draws)
+{
+	for (views &= m_culledViews; views != 0; views &= views - 1)
+		m_culled[glm::findLSB(views)] += draws;
+}
+
+void RenderQueue::add(const Mesh3D& mesh, const glm::mat4& model, const glm::vec4& material, uint32_t viewMask)
+{
+	add(mesh, model, material, mesh.range(), viewMask);
+}
+
+void RenderQueue::add(const Mesh3D& mesh, const glm::mat4& model, const glm::vec4& material, const MeshRange& shadowRange, uint32_t viewMask)
+{
+	DrawItem item;
+	item.buffer = &mesh.buffer();
+	item.texture = mesh.activeTexture();
+	item.range = mesh.range();
+	item.shadowRange = shadowRange;
+	item.model = model;
+	item.material = material;
+	item.bounds = mesh.bounds().transformed(model);
+	item.viewMask = viewMask;
+	add(item);
+}
+
+void RenderQueue::add(const DrawItem& item)
+{
+	m_items.push_back(item);
+	m_dirty = true;
+}
+
+void RenderQueue::setCondition(size_t first, uint32_t query)
+{
+	for (size_t i = first; i < m_items.size(); i++)
+		m_items[i].condition = query;
+}
+
+uint32_t RenderQueue::selectDepthPrepass(uint32_t view, const glm::mat4& viewProjection, uint32_t width, uint32_t height, const DepthPrepassCosts& costs)
+{
+	if (m_dirty)
+		upload();
+
+	//Where each draw the view sees lands on the screen. Draws reaching behind the camera may cover all of it
+	uint32_t bit = 1u << view;
+	m_screenRects.resize(m_items.size());
+	for (size_t i = 0; i < m_items.size(); i++)
+	{
+		ScreenRect& rect = m_screenRects[i];
+		rect = ScreenRect{ 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, -1.0f };
+		m_items[i].prepass = false;
+		if (!(m_items[i].viewMask & bit))
+			continue;
+		glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+		bool behind = false;
+		for (uint32_t corner = 0; corner < 8; corner++)
+		{
+			const AABB& box = m_items[i].bounds;
+			glm::vec4 clip = viewProjection * glm::vec4(corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y, corner & 4 ? box.max.z : box.min.z, 1.0f);
+			if (clip.w <= 0.0f)
+			{
+				behind = true;
+				break;
+			}
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			low = glm::min(low, ndc);
+			high = glm::max(high, ndc);
+		}
+		if (behind)
+		{
+			low = glm::vec3(-1.0f);
+			high = glm::vec3(1.0f);
+		}
+		rect.x0 = (glm::clamp(low.x, -1.0f, 1.0f) * 0.5f + 0.5f) * width;
+		rect.x1 = (glm::clamp(high.x, -1.0f, 1.0f) * 0.5f + 0.5f) * width;
+		rect.y0 = (glm::clamp(low.y, -1.0f, 1.0f) * 0.5f + 0.5f) * height;
+		rect.y1 = (glm::clamp(high.y, -1.0f, 1.0f) * 0.5f + 0.5f) * height;
+		rect.nearDepth = low.z;
+		rect.farDepth = high.z;
+	}
+
+	//Only the draws the view sees on screen can be picked or cover others. Bin them, nearest first, by the tiles
+	//they touch, so each is only compared against draws sharing a tile and no further than its far depth
+	m_prepassCandidates.clear();
+	for (uint32_t i = 0; i < m_items.size(); i++)
+	{
+		const ScreenRect& rect = m_screenRects[i];
+		if ((m_items[i].viewMask & bit) && rect.x1 > rect.x0 && rect.y1 > rect.y0)
+			m_prepassCandidates.push_back(i);
+	}
+	std::sort(m_prepassCandidates.begin(), m_prepassCandidates.end(), [&](uint32_t a, uint32_t b) {
+		return m_screenRects[a].nearDepth < m_screenRects[b].nearDepth;
+	});
+	for (auto& bin : m_prepassBins)
+		bin.clear();
+	auto binRange = [](float low, float high, float size, uint32_t bins, uint32_t& first, uint32_t& last) {
+		first = std::min(static_cast<uint32_t>(low / size * bins), bins - 1);
+		last = std::min(static_cast<uint32_t>(high / size * bins), bins - 1);
+	};
+	for (uint32_t i : m_prepassCandidates)
+	{
+		const ScreenRect& rect = m_screenRects[i];
+		uint32_t x0, x1, y0, y1;
+		binRange(rect.x0, rect.x1, static_cast<float>(width), PrepassBinsX, x0, x1);
+		binRange(rect.y0, rect.y1, static_cast<float>(height), PrepassBinsY, y0, y1);
+		for (uint32_t y = y0; y <= y1; y++)
+		{
+			for (uint32_t x = x0; x <= x1; x++)
+				m_prepassBins[y * PrepassBinsX + x].push_back(i);
+		}
+	}
+
+	//Weigh the shading a draw's hidden pixels would waste against drawing its depth first
+	m_prepassCounted.assign(m_items.size(), 0u);
+	uint32_t picked = 0;
+	for (uint32_t candidate = 0; candidate < m_prepassCandidates.size(); candidate++)
+	{
+		uint32_t i = m_prepassCandidates[candidate];
+		const ScreenRect& rect = m_screenRects[i];
+		float pixels = (rect.x1 - rect.x0) * (rect.y1 - rect.y0);
+		float covered = 0.0f;
+		uint32_t x0, x1, y0, y1;
+		binRange(rect.x0, rect.x1, static_cast<float>(width), PrepassBinsX, x0, x1);
+		binRange(rect.y0, rect.y1, static_cast<float>(height), PrepassBinsY, y0, y1);
+		for (uint32_t y = y0; y <= y1; y++)
+		{
+			for (uint32_t x = x0; x <= x1; x++)
+			{
+				for (uint32_t j : m_prepassBins[y * PrepassBinsX + x])
+				{
+					//The rest of the tile's draws are all further than this one reaches
+					const ScreenRect& other = m_screenRects[j];
+					if (other.nearDepth > rect.farDepth)
+						break;
+					//Draws spanning several of the tiles are met in each, but only counted the first time
+					if (j == i || m_prepassCounted[j] == candidate + 1)
+						continue;
+					m_prepassCounted[j] = candidate + 1;
+					covered += std::max(std::min(rect.x1, other.x1) - std::max(rect.x0, other.x0), 0.0f) *
+						std::max(std::min(rect.y1, other.y1) - std::max(rect.y0, other.y0), 0.0f);
+				}
+			}
+		}
+		float hidden = std::min(covered / pixels + costs.selfOverdraw, 1.0f);
+		float saved = pixels * hidden * costs.shadedPixel;
+		float cost = m_items[i].range.indexCount / 3 * costs.depthTriangle + pixels;
+		if (saved > cost)
+		{
+			m_items[i].prepass = true;
+			picked++;
+		}
+	}
+	return picked;
+}
+
+void RenderQueue::cull()
+{
+	m_cullBounds.resize(m_items.size());
+	m_cullResults.resize(m_items.size());
+	for (size_t i = 0; i < m_items.size(); i++)
+		m_cullBounds[i] = m_items[i].bounds;
+
+	for (uint32_t views = m_culledViews; views != 0; views &= views - 1)
+	{
+		uint32_t view = glm::findLSB(views);
+		uint32_t bit = 1u << view;
+		m_frusta[view].cull(m_cullBounds.data(), static_cast<uint32_t>(m_cullBounds.size()), m_cullResults.data());
+		for (size_t i = 0; i < m_items.size(); i++)
+		{
+			if ((m_items[i].viewMask & bit) && !m_cullResults[i])
+			{
+				m_items[i].viewMask &= ~bit;
+				m_culled[view]++;
+			}
+		}
+
+		//Only draws the frustum kept are worth rasterizing against the occluders
+		if (m_occlusion[view])
+		{
+			for (size_t i = 0; i < m_items.size(); i++)
+			{
+				if ((m_items[i].viewMask & bit) && !m_occlusion[view]->visible(m_items[i].bounds))
+				{
+					m_items[i].viewMask &= ~bit;
+					m_culled[view]++;
+					m_occluded[view]++;
+				}
+			}
+		}
+	}
+
+	//Drop the draws no view can see, and count what each view kept
+	m_items.erase(std::remove_if(m_items.begin(), m_items.end(), [](const DrawItem& item) { return item.viewMask == 0; }), m_items.end());
+	for (auto& item : m_items)
+	{
+		for (uint32_t views = item.viewMask & m_culledViews; views != 0; views &= views - 1)
+			m_visible[glm::findLSB(views)]++;
+	}
+}
+
+void RenderQueue::upload()
+{
+	cull();
+	m_dirty = false;
+	if (m_items.empty())
+		return;
+
+	//Group draws that can share a call; stable so draw order within a group is the order they were added
+	std::stable_sort(m_items.begin(), m_items.end(), [](const DrawItem& a, const DrawItem& b) {
+		if (a.condition != b.condition)
+			return a.condition < b.condition;
+		if (a.buffer != b.buffer)
+			return a.buffer < b.buffer;
+		return a.texture < b.texture;
+	});
+
+	//Write the per-draw data straight into this frame's region of the stream buffer
+	m_drawData = m_stream.allocate(m_items.size() * DrawDataTexels * sizeof(glm::vec4), sizeof(glm::vec4));
+	glm::vec4* drawData = static_cast<glm::vec4*>(m_drawData.data);
+	for (uint32_t i = 0; i < m_items.size(); i++)
+	{
+		const DrawItem& item = m_items[i];
+		glm::vec4* data = drawData + i * DrawDataTexels;
+		data[0] = item.model[0];
+		data[1] = item.model[1];
+		data[2] = item.model[2];
+		data[3] = item.model[3];
+		data[4] = item.material;
+	}
+	m_stream.commit();
+
+	//The stream buffer is replaced when it grows, so point the buffer texture at whichever one holds the data
+	if (m_drawDataBuffer != m_drawData.buffer)
+	{
+		glBindTexture(GL_TEXTURE_BUFFER, m_drawDataTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_drawData.buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		m_drawDataBuffer = m_drawData.buffer;
+	}
+}
+
+void RenderQueue::submit(Shader& shader, DrawMode mode)
+{
+	submit(shader, mode, mode == DrawMode::ShadowCaster ? ShadowView : CameraView);
+}
+
+void RenderQueue::submit(Shader& shader, DrawMode mode, uint32_t view, DrawSet set, PrepassSet prepass)
+{
+	bool bindTextures = mode == DrawMode::Shaded;
+	bool shadowCaster = mode == DrawMode::ShadowCaster;
+	bool conditional = view == CameraView;
+	m_drawn = 0;
+	m_drawCalls = 0;
+	m_triangles = 0;
+	if (m_dirty)
+		upload();
+	if (m_items.empty())
+		return;
+
+	//Gather the draws this view sees into runs that can each go out in one call
+	uint32_t bit = 1u << view;
+	m_viewItems.clear();
+	m_runs.clear();
+	for (uint32_t i = 0; i < m_items.size(); i++)
+	{
+		const DrawItem& item = m_items[i];
+		const MeshRange& range = shadowCaster ? item.shadowRange : item.range;
+		uint32_t condition = conditional ? item.condition : 0;
+		if (!(item.viewMask & bit) || range.indexCount == 0)
+			continue;
+		if ((set == DrawSet::Unconditional && condition != 0) || (set == DrawSet::Conditional && condition == 0))
+			continue;
+		if ((prepass == PrepassSet::Prepassed && !item.prepass) || (prepass == PrepassSet::Rest && item.prepass))
+			continue;
+		if (m_runs.empty() || m_runs.back().buffer != item.buffer || (bindTextures && m_runs.back().texture != item.texture) ||
+			m_runs.back().condition != condition)
+			m_runs.push_back({ item.buffer, item.texture, condition, static_cast<uint32_t>(m_viewItems.size()), 0 });
+		m_runs.back().count++;
+		m_viewItems.push_back(i);
+		m_triangles += range.indexCount / 3;
+	}
+	m_drawn = static_cast<uint32_t>(m_viewItems.size());
+	if (m_viewItems.empty())
+		return;
+
+	//Stream this view's indirect commands; baseInstance doubles as the draw ID, which indexes the per-draw data.
+	//The ID buffer only counts up to MaxDrawIDs, so larger queues set each draw's ID directly instead
+	bool indirect = glCaps.multiDrawIndirect && m_items.size() <= MeshBuffer::MaxDrawIDs;
+	StreamAllocation commands;
+	if (indirect)
+	{
+		commands = m_stream.allocate(m_viewItems.size() * sizeof(DrawElementsIndirectCommand), sizeof(uint32_t));
+		DrawElementsIndirectCommand* command = static_cast<DrawElementsIndirectCommand*>(commands.data);
+		for (uint32_t i : m_viewItems)
+		{
+			const MeshRange& range = shadowCaster ? m_items[i].shadowRange : m_items[i].range;
+			command->count = range.indexCount;
+			command->instanceCount = 1;
+			command->firstIndex = range.firstIndex;
+			command->baseVertex = range.baseVertex;
+			command->baseInstance = i;
+			command++;
+		}
+		m_stream.commit();
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.buffer);
+	}
+
+	shader.setUniform("drawData", DrawDataUnit);
+	shader.setUniform("drawDataBase", static_cast<int32_t>(m_drawData.offset / sizeof(glm::vec4)));
+	glActiveTexture(GL_TEXTURE0 + DrawDataUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, m_drawDataTexture);
+
+	for (const DrawRun& run : m_runs)
+	{
+		glBindVertexArray(bindTextures ? run.buffer->vao() : run.buffer->depthVao());
+		if (bindTextures)
+		{
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, run.texture);
+		}
+
+		//Never wait on the query; if its result is not ready the run is simply drawn
+		if (run.condition != 0)
+			glBeginConditionalRender(run.condition, GL_QUERY_NO_WAIT);
+
+		if (indirect)
+		{
+			glEnableVertexAttribArray(MeshBuffer::DrawIDAttribute);
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(commands.offset + run.first * sizeof(DrawElementsIndirectCommand)),
+				static_cast<GLsizei>(run.count), 0);
+			m_drawCalls++;
+		}
+		else
+		{
+			//Without baseInstance the draw ID comes from the attribute's current value instead of the ID buffer
+			glDisableVertexAttribArray(MeshBuffer::DrawIDAttribute);
+			for (uint32_t k = run.first; k < run.first + run.count; k++)
+			{
+				uint32_t i = m_viewItems[k];
+				const MeshRange& range = shadowCaster ? m_items[i].shadowRange : m_items[i].range;
+				glVertexAttribI1ui(MeshBuffer::DrawIDAttribute, static_cast<GLuint>(i));
+				glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+					(void*)(range.firstIndex * sizeof(uint32_t)), range.baseVertex);
+				m_drawCalls++;
+			}
+		}
+
+		if (run.condition != 0)
+			glEndConditionalRender();
+	}
+
+	glBindVertexArray(0);
+	if (indirect)
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0 + DrawDataUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,270 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Bounds.h"
+#include "Frustum.h"
+#include "MeshBuffer.h"
+#include "Shader.h"
+#include "StreamBuffer.h"
+
+class Mesh3D;
+class OcclusionBuffer;
+
+/**
+ * @brief The command layout consumed by glMultiDrawElementsIndirect.
+ */
+struct DrawElementsIndirectCommand {
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t baseInstance;
+};
+
+/**
+ * @brief One mesh to be drawn this frame, with the per-draw data the shaders look up by draw ID.
+ */
+struct DrawItem {
+	const MeshBuffer* buffer;
+	uint32_t texture;
+	MeshRange range;
+	// What the shadow pass draws instead of range; a simplified proxy in the same buffer, or range itself.
+	MeshRange shadowRange;
+	glm::mat4 model;
+	glm::vec4 material;
+	// World-space bounds, tested against each view's frustum.
+	AABB bounds;
+	// The views (bit per view index) that may still see this draw.
+	uint32_t viewMask = ~0u;
+	// An occlusion query deciding on the GPU whether the camera view draws this, or 0 to always draw it.
+	uint32_t condition = 0;
+	// Whether the camera's depth prepass lays down this draw's depth, so its shading only passes on equal depth.
+	bool prepass = false;
+};
+
+/**
+ * @brief How RenderQueue::submit feeds the draws to the shader.
+ */
+enum class DrawMode {
+	// The full Vertex3D format, with each draw's diffuse texture bound to unit 0.
+	Shaded,
+	// Positions only and no textures, for depth passes. Every draw in a buffer merges into one call.
+	DepthOnly,
+	// Like DepthOnly, but drawing each item's shadow proxy where it has one.
+	ShadowCaster
+};
+
+/**
+ * @brief Which of the draws a submit covers, so occlusion queries can be issued after the draws that occlude and
+ * before those depending on them.
+ */
+enum class DrawSet {
+	All,
+	Unconditional,
+	Conditional
+};
+
+/**
+ * @brief Which of the draws a submit covers by the depth prepass: those it drew, shaded with an equal depth test
+ * and depth writes off, or the rest, shaded as usual.
+ */
+enum class PrepassSet {
+	All,
+	Prepassed,
+	Rest
+};
+
+/**
+ * @brief What RenderQueue::selectDepthPrepass weighs for each draw, in units of the cost of a depth-only pixel.
+ */
+struct DepthPrepassCosts {
+	// Shading one pixel in the main pass, such as its shadow taps and lights.
+	float shadedPixel = 20.0f;
+	// Transforming and setting up one triangle again for the prepass.
+	float depthTriangle = 4.0f;
+	// Share of a draw's pixels its own nearer faces are expected to cover, on top of what other draws cover.
+	float selfOverdraw = 0.25f;
+};
+
+/**
+ * @brief Collects a frame's draws and submits them in as few calls as possible.
+ *
+ * Each pass draws the queue from a view, such as the camera or a light. Views given a frustum have every draw's
+ * bounds tested against it, four boxes at a time, before anything is uploaded; draws no view can see are dropped.
+ * Callers walking a hierarchy can test a whole subtree with visibleViews() and pass the surviving views down, so
+ * children of a culled parent are never tested. Views can also be given an OcclusionBuffer, against which draws
+ * that pass the frustum are tested next.
+ *
+ * Camera draws can be made conditional on an occlusion query; each object's conditional draws form runs of their
+ * own, wrapped in glBeginConditionalRender. Other views always draw them. A view's draws can also be split by
+ * whether a depth prepass lays down their depth first, with selectDepthPrepass(), and submitted apart.
+ *
+ * Draws are sorted by condition, buffer and texture. Their model matrices and materials are streamed into a StreamBuffer,
+ * viewed through a buffer texture (sampler "drawData", texture unit 2, starting at texel "drawDataBase") that the
+ * shaders index with the draw ID attribute. Each submit streams the indirect commands for the draws its view sees.
+ * Each run of those sharing a buffer (and, when shading, a texture) becomes one glMultiDrawElementsIndirect call
+ * when it is available, or a loop of glDrawElementsBaseVertex calls on GL 3.3.
+ */
+class RenderQueue {
+public:
+	/**
+	 * @brief View indices. Each is a bit in a DrawItem's viewMask.
+	 */
+	static const uint32_t CameraView = 0;
+	// The first shadow view; shadow cascades use consecutive views from it.
+	static const uint32_t ShadowView = 1;
+	static const uint32_t MaxViews = 32;
+	static const uint32_t AllViews = ~0u;
+
+private:
+	std::vector<DrawItem> m_items;
+
+	// Frusta of the views that are culled; views without one see everything.
+	Frustum m_frusta[MaxViews];
+	uint32_t m_culledViews;
+	// Per view: draws culled, by the frustum test or by callers skipping a culled subtree, and draws kept.
+	uint32_t m_culled[MaxViews];
+	uint32_t m_visible[MaxViews];
+	// Per view: the occlusion buffer draws are tested against, if any, and draws it hid.
+	const OcclusionBuffer* m_occlusion[MaxViews];
+	uint32_t m_occluded[MaxViews];
+	std::vector<AABB> m_cullBounds;
+	std::vector<uint8_t> m_cullResults;
+
+	// A draw's bounds on the screen in pixels, and their depth range in normalized device coordinates.
+	struct ScreenRect {
+		float x0, y0, x1, y1;
+		float nearDepth, farDepth;
+	};
+	std::vector<ScreenRect> m_screenRects;
+	// The depth prepass candidates: indices of the view's draws covering any pixels, binned by the coarse screen
+	// tiles their rects touch, and per draw the last candidate that counted it as covering, so it counts once.
+	static const uint32_t PrepassBinsX = 16;
+	static const uint32_t PrepassBinsY = 9;
+	std::vector<uint32_t> m_prepassCandidates;
+	std::vector<uint32_t> m_prepassBins[PrepassBinsX * PrepassBinsY];
+	std::vector<uint32_t> m_prepassCounted;
+
+	// A run of the submitted view's draws that goes out in one call; first indexes m_viewItems.
+	struct DrawRun {
+		const MeshBuffer* buffer;
+		uint32_t texture;
+		uint32_t condition;
+		uint32_t first;
+		uint32_t count;
+	};
+	std::vector<uint32_t> m_viewItems;
+	std::vector<DrawRun> m_runs;
+
+	StreamBuffer& m_stream;
+	StreamAllocation m_drawData;
+
+	uint32_t m_drawDataTexture;
+	// The stream buffer the buffer texture currently views.
+	uint32_t m_drawDataBuffer;
+
+	// True when items were added since the commands and draw data were last uploaded.
+	bool m_dirty;
+	// Number of draws, GL draw calls and triangles issued by the last submit().
+	uint32_t m_drawn;
+	uint32_t m_drawCalls;
+	uint32_t m_triangles;
+
+	// Culls the items against each view's frustum, dropping those no view sees.
+	void cull();
+	// Culls and sorts the items and uploads their per-draw data.
+	void upload();
+
+public:
+	/**
+	 * @brief The texture unit the per-draw data buffer texture is bound to.
+	 */
+	static const int32_t DrawDataUnit = 2;
+	/**
+	 * @brief vec4 texels per draw: four model matrix columns, then the material.
+	 */
+	static const uint32_t DrawDataTexels = 5;
+
+	RenderQueue(StreamBuffer& stream);
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+
+	/**
+	 * @brief Removes every draw and frustum, ready for the next frame. Call after the stream buffer's beginFrame().
+	 */
+	void clear();
+
+	/**
+	 * @brief Culls draws seen from the given view against a frustum this frame.
+	 */
+	void setFrustum(uint32_t view, const Frustum& frustum);
+
+	/**
+	 * @brief Also culls draws seen from the given view that the buffer's occluders hide this frame. The buffer
+	 * must stay alive and unchanged until the queue has been submitted.
+	 */
+	void setOcclusion(uint32_t view, const OcclusionBuffer* occlusion);
+
+	/**
+	 * @brief Which of the candidate views may see the given world-space bounds.
+	 */
+	uint32_t visibleViews(const AABB& bounds, uint32_t candidates = AllViews) const;
+
+	// The views culled this frame, and their frusta indexed by view.
+	uint32_t culledViews() const { return m_culledViews; }
+	const Frustum* frusta() const { return m_frusta; }
+
+	/**
+	 * @brief Counts draws a caller left out of the given views without queuing them, such as a culled subtree.
+	 */
+	void reportCulled(uint32_t views, uint32_t draws);
+
+	/**
+	 * @brief Queues a mesh with the given model matrix and material, for the given views.
+	 */
+	void add(const Mesh3D& mesh, const glm::mat4& model, const glm::vec4& material, uint32_t viewMask = AllViews);
+	void add(const Mesh3D& mesh, const glm::mat4& model, const glm::vec4& material, const MeshRange& shadowRange, uint32_t viewMask = AllViews);
+
+	/**
+	 * @brief Queues an arbitrary range of a mesh buffer, such as a static batch.
+	 */
+	void add(const DrawItem& item);
+
+	/**
+	 * @brief Makes the camera's draws of every item queued since index first depend on an occlusion query, or
+	 * no query when it is 0.
+	 */
+	void setCondition(size_t first, uint32_t query);
+
+	/**
+	 * @brief Picks which of the draws a view sees go into its depth prepass: those whose shading saved on pixels
+	 * that end up hidden outweighs drawing their triangles a second time. A draw's hidden pixels are estimated from
+	 * how much of its screen rectangle other draws that may be nearer overlap, plus its own overdraw. Returns the
+	 * number of draws picked.
+	 */
+	uint32_t selectDepthPrepass(uint32_t view, const glm::mat4& viewProjection, uint32_t width, uint32_t height, const DepthPrepassCosts& costs = DepthPrepassCosts());
+
+	/**
+	 * @brief Draws everything the view sees with the given (already active) shader. Without a view, shadow casters
+	 * are drawn from the shadow view and everything else from the camera.
+	 */
+	void submit(Shader& shader, DrawMode mode, uint32_t view, DrawSet set = DrawSet::All, PrepassSet prepass = PrepassSet::All);
+	void submit(Shader& shader, DrawMode mode);
+
+	/**
+	 * @brief Replaces bounds with the world-space bounds of every draw the view kept. Valid after the first submit().
+	 */
+	void visibleBounds(uint32_t view, std::vector<AABB>& bounds) const;
+
+	size_t size() const { return m_items.size(); }
+	uint32_t drawn() const { return m_drawn; }
+	// Draws culled from and kept for a view this frame. Valid after the first submit().
+	uint32_t culled(uint32_t view) const { return m_culled[view]; }
+	uint32_t visible(uint32_t view) const { return m_visible[view]; }
+	// Draws that passed a view's frustum but were hidden by its occluders; also counted as culled.
+	uint32_t occluded(uint32_t view) const { return m_occluded[view]; }
+	uint32_t drawCalls() const { return m_drawCalls; }
+	uint32_t triangles() const { return m_triangles; }
+};
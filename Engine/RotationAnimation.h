@@ -1,5 +1,5 @@
 #pragma once
-#include "Object3D.h"
+#include "SceneGraph.h"
 #include "Animation.h"
 /**
  * @brief Rotates an object at a continuous rate over an interval.
@@ -23,7 +23,7 @@ public:
 	 * @brief Constructs a animation of a constant rotation by the given total rotation 
 	 * angle, linearly interpolated across the given duration.
 	 */
-	RotationAnimation(Object3D& object, float_t duration, const glm::vec3& totalRotation) : 
-		Animation(object, duration), m_perSecond(totalRotation / duration) {}
+	RotationAnimation(SceneGraph& scene, SceneHandle object, float_t duration, const glm::vec3& totalRotation) : 
+		Animation(scene, object, duration), m_perSecond(totalRotation / duration) {}
 };
 
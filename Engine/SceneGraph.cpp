@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "SceneGraph.h"
+
+const uint32_t SceneGraph::None;
+
+SceneGraph::SceneGraph() : m_count(0)
+{
+}
+
+uint32_t SceneGraph::addNode(Object3D&& object, uint32_t parent)
+{
+	uint32_t index;
+	if (!m_free.empty())
+	{
+		index = m_free.back();
+		m_free.pop_back();
+	}
+	else
+	{
+		index = static_cast<uint32_t>(m_nodes.size());
+		m_nodes.emplace_back();
+	}
+
+	//The children become nodes of their own, so take them before the object is moved in
+	std::vector<Object3D> children = object.releaseChildren();
+
+	Node& node = m_nodes[index];
+	node.object.emplace(std::move(object));
+	node.parent = parent;
+	node.firstChild = node.lastChild = node.nextSibling = None;
+	node.boundsValid = false;
+	m_count++;
+
+	if (parent != None)
+	{
+		Node& parentNode = m_nodes[parent];
+		if (parentNode.lastChild == None)
+			parentNode.firstChild = index;
+		else
+			m_nodes[parentNode.lastChild].nextSibling = index;
+		parentNode.lastChild = index;
+		node.object->setParent(*parentNode.object);
+	}
+	else
+		m_roots.push_back(handleOf(index));
+
+	//m_nodes may grow while the children are added, so node is not used past this point
+	for (auto& child : children)
+		addNode(std::move(child), index);
+	return index;
+}
+
+SceneHandle SceneGraph::add(Object3D&& object, SceneHandle parent)
+{
+	uint32_t parentIndex = None;
+	if (parent.valid())
+	{
+		if (!contains(parent))
+			throw std::out_of_range("Stale scene handle");
+		parentIndex = parent.index;
+	}
+	return handleOf(addNode(std::move(object), parentIndex));
+}
+
+void SceneGraph::removeNode(uint32_t index)
+{
+	for (uint32_t child = m_nodes[index].firstChild; child != None;)
+	{
+		uint32_t next = m_nodes[child].nextSibling;
+		removeNode(child);
+		child = next;
+	}
+
+	Node& node = m_nodes[index];
+	node.object.reset();
+	node.boundsValid = false;
+	node.generation++;
+	node.parent = node.firstChild = node.lastChild = node.nextSibling = None;
+	m_free.push_back(index);
+	m_count--;
+}
+
+void SceneGraph::remove(SceneHandle handle)
+{
+	if (!contains(handle))
+		return;
+
+	//Unlink the node from its parent's children, or from the roots
+	uint32_t parent = m_nodes[handle.index].parent;
+	if (parent != None)
+	{
+		Node& parentNode = m_nodes[parent];
+		uint32_t previous = None;
+		for (uint32_t child = parentNode.firstChild; child != handle.index; child = m_nodes[child].nextSibling)
+			previous = child;
+		uint32_t next = m_nodes[handle.index].nextSibling;
+		if (previous == None)
+			parentNode.firstChild = next;
+		else
+			m_nodes[previous].nextSibling = next;
+		if (parentNode.lastChild == handle.index)
+			parentNode.lastChild = previous;
+	}
+	else
+		m_roots.erase(std::find(m_roots.begin(), m_roots.end(), handle));
+
+	removeNode(handle.index);
+}
+
+bool SceneGraph::contains(SceneHandle handle) const
+{
+	return handle.index < m_nodes.size() && m_nodes[handle.index].generation == handle.generation && m_nodes[handle.index].object;
+}
+
+Object3D& SceneGraph::get(SceneHandle handle)
+{
+	if (!contains(handle))
+		throw std::out_of_range("Stale scene handle");
+	return *m_nodes[handle.index].object;
+}
+
+const Object3D& SceneGraph::get(SceneHandle handle) const
+{
+	if (!contains(handle))
+		throw std::out_of_range("Stale scene handle");
+	return *m_nodes[handle.index].object;
+}
+
+SceneHandle SceneGraph::parent(SceneHandle handle) const
+{
+	uint32_t index = contains(handle) ? m_nodes[handle.index].parent : None;
+	return index == None ? SceneHandle() : handleOf(index);
+}
+
+SceneHandle SceneGraph::firstChild(SceneHandle handle) const
+{
+	uint32_t index = contains(handle) ? m_nodes[handle.index].firstChild : None;
+	return index == None ? SceneHandle() : handleOf(index);
+}
+
+SceneHandle SceneGraph::nextSibling(SceneHandle handle) const
+{
+	uint32_t index = contains(handle) ? m_nodes[handle.index].nextSibling : None;
+	return index == None ? SceneHandle() : handleOf(index);
+}
+
+void SceneGraph::updateNodeBounds(uint32_t index)
+{
+	Node& node = m_nodes[index];
+	if (!node.boundsValid || TransformSystem::shared().changed(node.object->getTransform()))
+		node.bounds = node.object->getWorldBounds();
+	node.boundsValid = true;
+
+	node.subtreeBounds = node.bounds;
+	node.subtreeSize = 1;
+	for (uint32_t child = node.firstChild; child != None; child = m_nodes[child].nextSibling)
+	{
+		updateNodeBounds(child);
+		node.subtreeBounds.expand(m_nodes[child].subtreeBounds);
+		node.subtreeSize += m_nodes[child].subtreeSize;
+	}
+}
+
+void SceneGraph::updateBounds()
+{
+	for (auto root : m_roots)
+		updateNodeBounds(root.index);
+}
+
+void SceneGraph::enqueueNode(uint32_t index, RenderQueue& queue, uint32_t views) const
+{
+	const Node& node = m_nodes[index];
+
+	//Test the whole subtree once; views it fails are not tested again further down
+	if (node.firstChild != None && node.boundsValid)
+	{
+		uint32_t subtreeViews = queue.visibleViews(node.subtreeBounds, views);
+		queue.reportCulled(views & ~subtreeViews, node.subtreeSize);
+		views = subtreeViews;
+		if (views == 0)
+			return;
+	}
+
+	node.object->enqueue(queue, views);
+	for (uint32_t child = node.firstChild; child != None; child = m_nodes[child].nextSibling)
+		enqueueNode(child, queue, views);
+}
+
+AABB SceneGraph::bounds(SceneHandle handle) const
+{
+	if (!contains(handle) || !m_nodes[handle.index].boundsValid)
+		return AABB();
+	return m_nodes[handle.index].subtreeBounds;
+}
+
+void SceneGraph::enqueue(SceneHandle handle, RenderQueue& queue, uint32_t views) const
+{
+	if (contains(handle))
+		enqueueNode(handle.index, queue, views);
+}
+
+void SceneGraph::collectNode(uint32_t index, std::vector<const Object3D*>& objects) const
+{
+	objects.push_back(&*m_nodes[index].object);
+	for (uint32_t child = m_nodes[index].firstChild; child != None; child = m_nodes[child].nextSibling)
+		collectNode(child, objects);
+}
+
+void SceneGraph::collect(SceneHandle handle, std::vector<const Object3D*>& objects) const
+{
+	if (contains(handle))
+		collectNode(handle.index, objects);
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <optional>
+#include <vector>
+
+#include "Object3D.h"
+
+/**
+ * @brief Refers to a node in a SceneGraph. The generation is bumped whenever a node is removed, so a handle to a
+ * removed node stays detectably stale even after its slot is reused.
+ */
+struct SceneHandle {
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+
+	bool valid() const { return index != UINT32_MAX; }
+	bool operator==(const SceneHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const SceneHandle& other) const { return !(*this == other); }
+};
+
+/**
+ * @brief Owns the scene's objects in a pooled arena of nodes, linked to their parent and children by index.
+ *
+ * Adding an object moves it into a node and moves each of its children into a node of its own beneath it, so the
+ * graph never copies an Object3D and walking it allocates nothing.
+ *
+ * Each node caches the world bounds of its mesh and of its whole subtree, refreshed by updateBounds() for nodes
+ * whose transforms moved. Queuing a node with children tests the subtree bounds first, so a culled parent skips
+ * all of its children.
+ */
+class SceneGraph {
+private:
+	static const uint32_t None = UINT32_MAX;
+
+	struct Node {
+		std::optional<Object3D> object;
+		uint32_t generation = 0;
+		uint32_t parent = None;
+		uint32_t firstChild = None;
+		uint32_t lastChild = None;
+		uint32_t nextSibling = None;
+
+		// World bounds of the node's own mesh and of it plus all its descendants, and the number of nodes in the
+		// subtree. Not valid until the first updateBounds() after the node is added.
+		AABB bounds;
+		AABB subtreeBounds;
+		uint32_t subtreeSize = 1;
+		bool boundsValid = false;
+	};
+
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_free;
+	std::vector<SceneHandle> m_roots;
+	uint32_t m_count;
+
+	SceneHandle handleOf(uint32_t index) const { return { index, m_nodes[index].generation }; }
+	uint32_t addNode(Object3D&& object, uint32_t parent);
+	void removeNode(uint32_t index);
+	void updateNodeBounds(uint32_t index);
+	void enqueueNode(uint32_t index, RenderQueue& queue, uint32_t views) const;
+	void collectNode(uint32_t index, std::vector<const Object3D*>& objects) const;
+
+public:
+	SceneGraph();
+
+	/**
+	 * @brief Moves an object and its children into the graph, as a root or beneath the given parent.
+	 */
+	SceneHandle add(Object3D&& object, SceneHandle parent = SceneHandle());
+
+	/**
+	 * @brief Removes a node and everything beneath it. Handles to any of them become stale.
+	 */
+	void remove(SceneHandle handle);
+
+	/**
+	 * @brief Whether the handle still refers to a node in the graph.
+	 */
+	bool contains(SceneHandle handle) const;
+
+	/**
+	 * @brief The object at a node. Throws std::out_of_range for a stale handle.
+	 */
+	Object3D& get(SceneHandle handle);
+	const Object3D& get(SceneHandle handle) const;
+
+	SceneHandle parent(SceneHandle handle) const;
+	SceneHandle firstChild(SceneHandle handle) const;
+	SceneHandle nextSibling(SceneHandle handle) const;
+
+	// The nodes without a parent, in the order they were added.
+	const std::vector<SceneHandle>& roots() const { return m_roots; }
+	uint32_t size() const { return m_count; }
+
+	/**
+	 * @brief Refreshes the cached bounds. Call once per frame, after the TransformSystem update and before its
+	 * clearChanged().
+	 */
+	void updateBounds();
+
+	/**
+	 * @brief The world bounds of a node and everything beneath it, empty until its bounds are first updated.
+	 */
+	AABB bounds(SceneHandle handle) const;
+
+	/**
+	 * @brief Queues a node and everything beneath it for the given views, skipping subtrees no view of the queue
+	 * can see.
+	 */
+	void enqueue(SceneHandle handle, RenderQueue& queue, uint32_t views = RenderQueue::AllViews) const;
+
+	/**
+	 * @brief Appends a node's object and those of everything beneath it.
+	 */
+	void collect(SceneHandle handle, std::vector<const Object3D*>& objects) const;
+};
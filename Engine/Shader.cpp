@@ -7,14 +7,22 @@ Shader::Shader()
 
 void Shader::load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath)
 {
-    // 1. retrieve the vertex/fragment source code from filePath
+    load(vertexShaderPath, "", fragmentShaderPath);
+}
+
+void Shader::load(const std::string& vertexShaderPath, const std::string& geometryShaderPath, const std::string& fragmentShaderPath)
+{
+    // 1. retrieve the vertex/geometry/fragment source code from filePath
     std::string vertexCode;
+    std::string geometryCode;
     std::string fragmentCode;
     std::ifstream vShaderFile;
+    std::ifstream gShaderFile;
     std::ifstream fShaderFile;
 
     // ensure ifstream objects can throw exceptions:
     vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
     fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
     try
     {
@@ -34,22 +42,49 @@ void Shader::load(const std::string& vertexShaderPath, const std::string& fragme
         // convert stream into string
         vertexCode = vShaderStream.str();
         fragmentCode = fShaderStream.str();
+
+        // the geometry shader is optional
+        if (!geometryShaderPath.empty())
+        {
+            gShaderFile.open(geometryShaderPath);
+            std::stringstream gShaderStream;
+            gShaderStream << gShaderFile.rdbuf();
+            gShaderFile.close();
+            geometryCode = gShaderStream.str();
+        }
     }
     catch (std::ifstream::failure& e)
     {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
     }
+
+    // insert the defines after the #version line, which must come first
+    for (std::string* code : { &vertexCode, &geometryCode, &fragmentCode })
+    {
+        size_t lineEnd = code->find('\n');
+        if (!m_defines.empty() && lineEnd != std::string::npos)
+            code->insert(lineEnd + 1, m_defines);
+    }
     const char* vShaderCode = vertexCode.c_str();
+    const char* gShaderCode = geometryCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
 
     // 2. compile shaders
-    unsigned int vertex, fragment;
+    unsigned int vertex, geometry = 0, fragment;
 
     // vertex shader
     vertex = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertex, 1, &vShaderCode, NULL);
     glCompileShader(vertex);
 
+    // geometry shader
+    if (!geometryShaderPath.empty())
+    {
+        geometry = glCreateShader(GL_GEOMETRY_SHADER);
+        glShaderSource(geometry, 1, &gShaderCode, NULL);
+        glCompileShader(geometry);
+    }
+
     // fragment Shader
     fragment = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragment, 1, &fShaderCode, NULL);
@@ -58,14 +93,23 @@ void Shader::load(const std::string& vertexShaderPath, const std::string& fragme
     // shader Program
     m_programID = glCreateProgram();
     glAttachShader(m_programID, vertex);
+    if (geometry)
+        glAttachShader(m_programID, geometry);
     glAttachShader(m_programID, fragment);
     glLinkProgram(m_programID);
 
     // delete the shaders as they're linked into our program now and no longer necessary
     glDeleteShader(vertex);
+    if (geometry)
+        glDeleteShader(geometry);
     glDeleteShader(fragment);
 }
 
+void Shader::addDefine(const std::string& name, const std::string& value)
+{
+    m_defines += "#define " + name + " " + value + "\n";
+}
+
 void Shader::activate()
 {
 	glUseProgram(m_programID);
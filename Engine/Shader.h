@@ -12,11 +12,16 @@ class Shader
 {
 private:
 	uint32_t m_programID;
+	// Lines inserted after the #version line of every stage.
+	std::string m_defines;
 
 public:
 	Shader();
 
 	void load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath);
+	void load(const std::string& vertexShaderPath, const std::string& geometryShaderPath, const std::string& fragmentShaderPath);
+	// Adds a #define to the stages of the next load().
+	void addDefine(const std::string& name, const std::string& value = "");
 	void activate();
 	void disable();
 
@@ -2,14 +2,39 @@
 
 layout (location=0) out vec4 FragColor;
 
+//With DEFERRED the shader lights every pixel of the screen once, reading the surface from the G-buffer: albedo,
+//the normal folded onto an octahedron, and the material with shininess as log2 / 8. Positions are rebuilt from depth
+#ifdef DEFERRED
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gMaterial;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+
+vec3 Normal;
+vec3 FragPos;
+vec4 material;
+#else
 in vec3 Normal;
 in vec2 TexCoord;
 in vec3 FragPos;
-in vec4 FragPosLightSpace;
   
 uniform sampler2D ourTexture;
-uniform sampler2D shadowMap;
+
+//(ambient x, diffuse y , specular z, shininess w), fetched per draw by the vertex shader
+flat in vec4 material;
+#endif
 uniform vec3 viewPos;
+uniform mat4 view;
+
+//Cascaded shadow map of the directional light, one layer per cascade ending at the view distance in cascadeSplits.
+//Each cascade is rendered into the cascadeScales share of its layer from the origin
+const int maxCascades = 4;
+uniform sampler2DArrayShadow shadowMap;
+uniform int cascadeCount;
+uniform float cascadeSplits[maxCascades];
+uniform float cascadeScales[maxCascades];
+uniform mat4 lightSpaceMatrices[maxCascades];
 
 struct DirectionalLight
 {
@@ -25,35 +50,114 @@ struct PointLight
     float linear;
     float quadratic;
 };
-const int numPointLights = 1;
-uniform PointLight pointLights[numPointLights];
 
-//(ambient x, diffuse y , specular z, shininess w)
-uniform vec4 material;
+//Point lights, gathered per cluster of the view by ClusteredLights. lightData holds two texels per light from
+//lightBase, (position, radius) and (linear, quadratic, index into pointShadows or -1, 0). clusterData holds an offset
+//and count per cluster from clusterBase, followed by the light indices the offsets point into
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterData;
+uniform int lightBase;
+uniform int clusterBase;
+//Clusters per axis, the slice of a view depth as log(depth) * x + y, and the screen size in pixels
+uniform vec3 clusterGrid;
+uniform vec2 clusterDepth;
+uniform vec2 screenSize;
+
+//With VIRTUAL_SHADOWS the directional light's shadows come from a virtual shadow map over the whole world instead of
+//the cascades: a page table with a mip level per level holds ResidentBit (0x10000) | physical row << 8 | column for
+//each page, and the depths of resident pages are in vsmPool, vsmPhysicalPerSide pages of vsmPageSize texels per side
+#ifdef VIRTUAL_SHADOWS
+uniform usampler2D vsmPageTable;
+uniform sampler2DShadow vsmPool;
+uniform mat4 vsmLightSpace;
+uniform int vsmPagesPerSide;
+uniform int vsmLevelCount;
+uniform int vsmPhysicalPerSide;
+uniform float vsmPageSize;
+#endif
+
+//Shadows of the point lights, as six cube faces per light in the shadow atlas, each holding the distance to the
+//nearest caster divided by the light's radius. Lights with a far distance of 0 cast no shadows
+uniform sampler2DShadow shadowAtlas;
+struct PointShadow
+{
+    float far;
+    //Texture coordinate offset (xy) and scale (zw) of the faces' tiles, in cube map face order
+    vec4 rects[6];
+};
+const int numPointShadows = 1;
+uniform PointShadow pointShadows[numPointShadows];
+
+//Shadow filter kernel, selected with defines by ShadowFilter: 0 for a grid, 1 for a Poisson disk and 2 for a
+//Vogel disk, of SHADOW_TAPS taps
+#ifndef SHADOW_KERNEL
+#define SHADOW_KERNEL 0
+#endif
+#ifndef SHADOW_TAPS
+#define SHADOW_TAPS 9
+#endif
 
-vec4 calculateDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDirection);
-vec4 calculatePointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDirection);
-float calculateShadows(vec4 fragPosLightSpace, vec3 normal, vec3 lightDirection);
+vec4 calculateDirectionalLight(DirectionalLight light, float shadows, vec3 normal, vec3 viewDirection);
+vec4 calculatePointLight(PointLight light, float shadows, vec3 normal, vec3 fragPos, vec3 viewDirection);
+float calculateShadows(vec3 fragPos, vec3 normal, vec3 lightDirection);
+float calculateVirtualShadows(vec3 fragPos, vec3 normal, vec3 lightDirection);
+float calculatePointShadows(PointShadow shadow, vec3 fragPos, vec3 lightPosition, vec3 normal);
+int clusterIndex(vec3 fragPos);
+vec3 octahedralDecode(vec2 e);
 
 void main() 
 {
+#ifdef DEFERRED
+    //Pixels no surface was drawn into are left to the skybox. The depth is kept for it to test against
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0)
+        discard;
+    gl_FragDepth = depth;
+
+    vec4 position = inverseViewProjection * vec4(vec3(gl_FragCoord.xy / screenSize, depth) * 2.0 - 1.0, 1.0);
+    FragPos = position.xyz / position.w;
+    Normal = octahedralDecode(texelFetch(gNormal, pixel, 0).rg * 2.0 - 1.0);
+    vec4 packedMaterial = texelFetch(gMaterial, pixel, 0);
+    material = vec4(packedMaterial.xyz, exp2(packedMaterial.w * 8.0));
+    vec4 texColor = vec4(texelFetch(gAlbedo, pixel, 0).rgb, 1.0);
+#else
+    //Compute texture color of fragment
+    vec4 texColor = texture(ourTexture, TexCoord);
+#endif
+
     //Normalize vectors for computing lighting
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
 
-    //Compute texture color of fragment
-    vec4 texColor = texture(ourTexture, TexCoord);
+    //Calculate Phong Lighting, evaluating each light's shadows once
+#ifdef VIRTUAL_SHADOWS
+    float sunShadows = calculateVirtualShadows(FragPos, norm, normalize(-dirLight.direction));
+#else
+    float sunShadows = calculateShadows(FragPos, norm, normalize(-dirLight.direction));
+#endif
+    vec4 lightRes = calculateDirectionalLight(dirLight, sunShadows, norm, viewDir);
 
-    //Calculate Phong Lighting
-    vec4 lightRes = calculateDirectionalLight(dirLight, norm, viewDir);
-    for (int i = 0; i < numPointLights; i++)
-        lightRes += calculatePointLight(pointLights[i], norm, FragPos, viewDir);
+    //Only the point lights reaching this fragment's cluster are shaded
+    int cluster = clusterIndex(FragPos);
+    int indexBase = clusterBase + int(clusterGrid.x * clusterGrid.y * clusterGrid.z) * 2;
+    int first = int(texelFetch(clusterData, clusterBase + cluster * 2).r);
+    int count = int(texelFetch(clusterData, clusterBase + cluster * 2 + 1).r);
+    for (int i = 0; i < count; i++)
+    {
+        int index = lightBase + int(texelFetch(clusterData, indexBase + first + i).r) * 2;
+        vec4 attenuation = texelFetch(lightData, index + 1);
+        PointLight light = PointLight(texelFetch(lightData, index).xyz, attenuation.x, attenuation.y);
+        int shadow = int(attenuation.z);
+        float shadows = shadow >= 0 ? calculatePointShadows(pointShadows[shadow], FragPos, light.position, norm) : 0.0;
+        lightRes += calculatePointLight(light, shadows, norm, FragPos, viewDir);
+    }
 
     //Ouput the resulting fragment color
     FragColor = lightRes * texColor;
 }
 
-vec4 calculateDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDirection)
+vec4 calculateDirectionalLight(DirectionalLight light, float shadows, vec3 normal, vec3 viewDirection)
 {
     //Normalize direction vector from frag towards light
     vec3 lightDirection = normalize(-light.direction);
@@ -71,14 +175,11 @@ vec4 calculateDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDir
     vec3 diffuse = vec3(1.0, 1.0, 1.0) * material.y * diff;
     vec3 specular = vec3(1.0, 1.0, 1.0) * material.z * spec;
 
-    //Calculate shadows for directional light
-    float shadows = calculateShadows(FragPosLightSpace, normal, lightDirection);
-    
     //Return effects of directional light
     return vec4((ambient + (1.0 - shadows) * (diffuse + specular)), 1.0);
 }
 
-vec4 calculatePointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDirection)
+vec4 calculatePointLight(PointLight light, float shadows, vec3 normal, vec3 fragPos, vec3 viewDirection)
 {
     //Normalize vector from fragment to light source
     vec3 lightDirection = normalize(light.position - fragPos);
@@ -100,53 +201,208 @@ vec4 calculatePointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewD
     vec3 diffuse = vec3(1.0, 1.0, 1.0) * material.y * diff * attenuation;
     vec3 specular = vec3(1.0, 1.0, 1.0) * material.z * spec * attenuation;
 
-    float shadows = calculateShadows(FragPosLightSpace, normal, lightDirection);
-
     //Return effects of point light
     return vec4((ambient + (1.0 - shadows) * (diffuse + specular)), 1.0);
 }
 
-float calculateShadows(vec4 fragPosLightSpace, vec3 normal, vec3 lightDirection)
+const vec2 poissonDisk[16] = vec2[]
+(
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725), vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464), vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+    vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420), vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590), vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790)
+);
+
+//Rotation turning the disk kernels per pixel (by interleaved gradient noise), so their banding becomes fine noise
+mat2 kernelRotation()
+{
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    float s = sin(angle);
+    float c = cos(angle);
+    return mat2(c, s, -s, c);
+}
+
+//Offset in texels of a tap of the shadow kernel
+vec2 kernelOffset(int tap, mat2 rotation)
 {
+#if SHADOW_KERNEL == 0
+#if SHADOW_TAPS == 5
+    const vec2 corners[5] = vec2[](vec2(0.0), vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(1.0, 1.0));
+    return corners[tap];
+#elif SHADOW_TAPS == 16
+    return vec2(float(tap % 4) - 1.5, float(tap / 4) - 1.5);
+#else
+    return vec2(float(tap % 3) - 1.0, float(tap / 3) - 1.0);
+#endif
+#elif SHADOW_KERNEL == 1
+    return rotation * poissonDisk[tap] * 2.0;
+#else
+    float radius = sqrt((float(tap) + 0.5) / float(SHADOW_TAPS)) * 2.0;
+    float angle = float(tap) * 2.3999632;
+    return rotation * vec2(cos(angle), sin(angle)) * radius;
+#endif
+}
+
+float calculateShadows(vec3 fragPos, vec3 normal, vec3 lightDirection)
+{
+    //Pick the first cascade whose slice of the view holds the fragment, fragments past the last one are not in shadow
+    float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+    int cascade = 0;
+    while (cascade < cascadeCount && viewDepth > cascadeSplits[cascade])
+        cascade++;
+    if (cascade == cascadeCount)
+        return 0.0;
+
     //Perspective divide light space fragment in clip space to projection coordinates
+    vec4 fragPosLightSpace = lightSpaceMatrices[cascade] * vec4(fragPos, 1.0);
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
 
     //Transform projection coordinates to range [0, 1]
     projCoords = projCoords * 0.5 + 0.5;
 
-    //Sample the shadow map to get the closest depth value to the light
-    float closestDepth = texture(shadowMap, projCoords.xy).r;
+    //For fragments outside of the far plane that should not be in shadow, set equal to 0 so they are always lit
+    if (projCoords.z > 1.0)
+        return 0.0;
 
-    //Get the depth of this fragment by sampling the z coordinate of the projection
-    float currentDepth = projCoords.z;
-    
-    //Create a small bias to offset the depths of the shadow map
-    float bias = max(0.05 * (1.0 - dot(normal, lightDirection)), 0.005);
+    //Size of one of the cascade's texels, which cover only part of its layer
+    float scale = cascadeScales[cascade];
+    vec2 texelSize = 1.0 / (vec2(textureSize(shadowMap, 0).xy) * scale);
 
-    float shadow = 0.0;
+    //Create a small bias to offset the depths of the shadow map. A cascade's depth range is as deep as it is wide,
+    //so a bias of a few texels holds in every cascade however large it is
+    float bias = texelSize.x * (1.5 + 3.0 * (1.0 - max(dot(normal, lightDirection), 0.0)));
+    float reference = projCoords.z - bias;
 
-    //For fragments outside of the far plane that should not be in shadow, set equal to 0 so they are always lit
-    if(projCoords.z > 1.0)
-        shadow = 0.0;
+    //Each tap compares against the 2x2 texels around it in hardware, returning the filtered fraction lit. Taps stay
+    //half a texel inside the part of the layer the cascade was rendered into
+    mat2 rotation = kernelRotation();
+    float lit = 0.0;
+    for (int i = 0; i < SHADOW_TAPS; ++i)
+    {
+        vec2 tap = clamp(projCoords.xy + kernelOffset(i, rotation) * texelSize, 0.5 * texelSize, 1.0 - 0.5 * texelSize);
+        lit += texture(shadowMap, vec4(tap * scale, float(cascade), reference));
+    }
+    return 1.0 - lit / float(SHADOW_TAPS);
+}
+
+#ifdef VIRTUAL_SHADOWS
+float calculateVirtualShadows(vec3 fragPos, vec3 normal, vec3 lightDirection)
+{
+    //The map is orthographic, so light space is already in clip space
+    vec3 projCoords = (vsmLightSpace * vec4(fragPos, 1.0)).xyz * 0.5 + 0.5;
+
+    //Pick the level the same way the feedback did, with derivatives taken before any branch
+    float virtualSize = float(vsmPagesPerSide) * vsmPageSize;
+    float texels = max(length(dFdx(projCoords.xy)), length(dFdy(projCoords.xy))) * virtualSize;
+    int level = clamp(int(floor(log2(max(texels, 1.0)))), 0, vsmLevelCount - 1);
+    if (any(lessThan(projCoords.xy, vec2(0.0))) || any(greaterThanEqual(projCoords.xy, vec2(1.0))))
+        return 0.0;
+
+    //Use the finest resident page from that level up, as a requested page may not have been rendered yet. Until
+    //even the coarsest page is, the fragment is lit
+    uint entry = 0u;
+    for (; level < vsmLevelCount; level++)
+    {
+        entry = texelFetch(vsmPageTable, ivec2(projCoords.xy * float(vsmPagesPerSide >> level)), level).r;
+        if ((entry & 0x10000u) != 0u)
+            break;
+    }
+    if ((entry & 0x10000u) == 0u)
+        return 0.0;
+    vec2 pageCoords = fract(projCoords.xy * float(vsmPagesPerSide >> level));
+    vec2 physicalPage = vec2(float(entry & 0xFFu), float((entry >> 8) & 0xFFu));
+
+    //The map is as deep as it is wide, so as with the cascades a bias of a few of the level's texels holds
+    float bias = exp2(float(level)) / virtualSize * (1.5 + 3.0 * (1.0 - max(dot(normal, lightDirection), 0.0)));
+    float reference = projCoords.z - bias;
+
+    //Filter within the physical page, keeping every tap half a texel inside so none reads a neighbouring page
+    float texel = 1.0 / vsmPageSize;
+    mat2 rotation = kernelRotation();
+    float lit = 0.0;
+    for (int i = 0; i < SHADOW_TAPS; ++i)
+    {
+        vec2 tap = clamp(pageCoords + kernelOffset(i, rotation) * texel, 0.5 * texel, 1.0 - 0.5 * texel);
+        lit += texture(vsmPool, vec3((physicalPage + tap) / float(vsmPhysicalPerSide), reference));
+    }
+    return 1.0 - lit / float(SHADOW_TAPS);
+}
+#endif
+
+//The cluster holding a fragment: its screen tile, and the depth slice of its distance from the camera
+int clusterIndex(vec3 fragPos)
+{
+    ivec3 grid = ivec3(clusterGrid);
+    float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / screenSize * clusterGrid.xy), ivec2(0), grid.xy - 1);
+    int slice = clamp(int(log(max(viewDepth, 1e-4)) * clusterDepth.x + clusterDepth.y), 0, grid.z - 1);
+    return (slice * grid.y + tile.y) * grid.x + tile.x;
+}
+
+//Unfolds a normal from the octahedron the G-buffer stores it on
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float fold = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -fold : fold;
+    n.y += n.y >= 0.0 ? -fold : fold;
+    return normalize(n);
+}
+
+//Where a direction from the light lands on its cube faces, picking the face the same way cube maps do
+vec2 cubeFaceCoords(vec3 direction, out int face)
+{
+    vec3 absolute = abs(direction);
+    vec2 st;
+    float major;
+    if (absolute.x >= absolute.y && absolute.x >= absolute.z)
+    {
+        face = direction.x > 0.0 ? 0 : 1;
+        st = vec2(direction.x > 0.0 ? -direction.z : direction.z, -direction.y);
+        major = absolute.x;
+    }
+    else if (absolute.y >= absolute.z)
+    {
+        face = direction.y > 0.0 ? 2 : 3;
+        st = vec2(direction.x, direction.y > 0.0 ? direction.z : -direction.z);
+        major = absolute.y;
+    }
     else
     {
-        //Retrieve the size of a single texel by sampling the shadow map at mipmap 0
-        vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-        for(int x = -1; x <= 1; ++x)
-        {
-            for(int y = -1; y <= 1; ++y)
-            {
-                //Sample x * y values around the projected coordinate to test for shadows 
-                //Use texelSize to offset the texture coordinates
-                float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
-            
-                //Check if the current depth or closest depth is closer
-                shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;        
-            }    
-        }
-        //Average the results
-        shadow /= 9.0;
+        face = direction.z > 0.0 ? 4 : 5;
+        st = vec2(direction.z > 0.0 ? direction.x : -direction.x, -direction.y);
+        major = absolute.z;
     }
+    return st / major * 0.5 + 0.5;
+}
+
+float calculatePointShadows(PointShadow shadow, vec3 fragPos, vec3 lightPosition, vec3 normal)
+{
+    //Fragments beyond the light's radius are not lit by it, so are not shadowed either
+    vec3 fragToLight = fragPos - lightPosition;
+    float currentDistance = length(fragToLight);
+    if (currentDistance >= shadow.far)
+        return 0.0;
+
+    //The stored depth is the linear distance to the nearest caster divided by the light's radius. Bias by more on
+    //surfaces facing away from the light
+    float bias = max(0.05 * (1.0 - dot(normal, -fragToLight / currentDistance)), 0.01);
+    float reference = (currentDistance - bias) / shadow.far;
 
-    return shadow;
+    //Filter within the face's tile, keeping every tap half a texel inside so none reads a neighbouring tile
+    int face;
+    vec2 uv = cubeFaceCoords(fragToLight, face);
+    vec4 rect = shadow.rects[face];
+    vec2 texel = 1.0 / (vec2(textureSize(shadowAtlas, 0)) * rect.zw);
+    vec2 low = 0.5 * texel;
+    vec2 high = 1.0 - 0.5 * texel;
+
+    mat2 rotation = kernelRotation();
+    float lit = 0.0;
+    for (int i = 0; i < SHADOW_TAPS; ++i)
+    {
+        vec2 tap = clamp(uv + kernelOffset(i, rotation) * texel, low, high);
+        lit += texture(shadowAtlas, vec3(rect.xy + tap * rect.zw, reference));
+    }
+    return 1.0 - lit / float(SHADOW_TAPS);
 }
\ No newline at end of file
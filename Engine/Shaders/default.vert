@@ -2,19 +2,30 @@
 layout (location=0) in vec3 vPosition;
 layout (location=1) in vec3 vNormal;
 layout (location=2) in vec2 vTexCoord;
+layout (location=3) in uint vDrawID;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
-uniform mat4 lightSpaceMatrix;
+uniform mat4 viewProjection;
+
+//Per-draw data written by the RenderQueue: 4 texels of model matrix followed by the material
+uniform samplerBuffer drawData;
+uniform int drawDataBase;
+
+//The depth prepass draws through depthShader.vert with the same matrix, and this pass only shades where the depth
+//is equal, so both compute the position with the same expression and declare it invariant
+invariant gl_Position;
 
 out vec3 Normal;
 out vec2 TexCoord;
 out vec3 FragPos;
-out vec4 FragPosLightSpace;
+flat out vec4 material;
 
 void main() 
 {
+    //Fetch this draw's model matrix and material
+    int base = drawDataBase + int(vDrawID) * 5;
+    mat4 model = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1), texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+    material = texelFetch(drawData, base + 4);
+
     //Calculate the normal matrix and multiply by the vertex normal to keep uniform scale and avoid distorting the lighting
     Normal = mat3(transpose(inverse(model))) * vNormal;
     TexCoord = vTexCoord;
@@ -22,9 +33,6 @@ void main()
     //Calculate world space coordinate of the fragment
     FragPos = vec3(model * vec4(vPosition, 1.0));
 
-    //Calculate the fragment position in light space using the position of the fragment and the supplied light space matrix
-    FragPosLightSpace = lightSpaceMatrix * vec4(FragPos, 1.0);
-
     // Project the position to clip space.
-    gl_Position = projection * view * model * vec4(vPosition, 1.0);
+    gl_Position = viewProjection * model * vec4(vPosition, 1.0);
 }
\ No newline at end of file
@@ -1,10 +1,19 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 3) in uint aDrawID;
 
 uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+
+//Per-draw data written by the RenderQueue: 4 texels of model matrix followed by the material
+uniform samplerBuffer drawData;
+uniform int drawDataBase;
+
+//Also the camera's depth prepass, whose depths the shaded pass from default.vert must match exactly
+invariant gl_Position;
 
 void main()
 {
+    int base = drawDataBase + int(aDrawID) * 5;
+    mat4 model = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1), texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
     gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
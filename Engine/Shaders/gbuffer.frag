@@ -0,0 +1,31 @@
+#version 330 core
+layout (location = 0) out vec4 Albedo;
+layout (location = 1) out vec2 OctahedralNormal;
+layout (location = 2) out vec4 Material;
+
+in vec3 Normal;
+in vec2 TexCoord;
+in vec3 FragPos;
+
+uniform sampler2D ourTexture;
+
+//(ambient x, diffuse y , specular z, shininess w), fetched per draw by the vertex shader
+flat in vec4 material;
+
+//Folds a unit vector onto the octahedron |x| + |y| + |z| = 1 and unfolds that flat, the lower half over the corners
+vec2 octahedralEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.xy;
+}
+
+void main()
+{
+    //Everything the lighting pass needs but the position, which it rebuilds from depth. Shininess is stored by its
+    //exponent, up to 256
+    Albedo = vec4(texture(ourTexture, TexCoord).rgb, 1.0);
+    OctahedralNormal = octahedralEncode(normalize(Normal)) * 0.5 + 0.5;
+    Material = vec4(clamp(material.xyz, 0.0, 1.0), clamp(log2(max(material.w, 1.0)) / 8.0, 0.0, 1.0));
+}
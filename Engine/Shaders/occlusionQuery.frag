@@ -0,0 +1,6 @@
+#version 330 core
+
+void main()
+{
+    //Only the samples passing the depth test matter; color writes are masked off
+}
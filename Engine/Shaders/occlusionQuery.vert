@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+//Maps the unit cube onto the box being queried, in clip space
+uniform mat4 boxTransform;
+
+void main()
+{
+    gl_Position = boxTransform * vec4(aPos, 1.0);
+}
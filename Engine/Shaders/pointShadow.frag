@@ -0,0 +1,11 @@
+#version 330 core
+in vec4 FragPos;
+
+uniform vec3 lightPosition;
+uniform float farPlane;
+
+void main()
+{
+    //Store the linear distance to the light, mapped to [0, 1] by the light's radius
+    gl_FragDepth = length(FragPos.xyz - lightPosition) / farPlane;
+}
@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in uint aDrawID;
+
+//Per-draw data written by the RenderQueue: 4 texels of model matrix followed by the material
+uniform samplerBuffer drawData;
+uniform int drawDataBase;
+
+void main()
+{
+    //Stay in world space, the geometry shader projects into each face
+    int base = drawDataBase + int(aDrawID) * 5;
+    mat4 model = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1), texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+    gl_Position = model * vec4(aPos, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 330 core
+layout (location = 0) out uint Feedback;
+
+in vec2 LightCoord;
+
+//Texels per side of the finest level, and the size of a screen pixel relative to a feedback pixel
+uniform float virtualSize;
+uniform float feedbackScale;
+uniform int pagesPerSide;
+uniform int levelCount;
+
+void main()
+{
+    //Pick the level with about one shadow texel per screen pixel, from how many the pixel spans at the finest level
+    vec2 dx = dFdx(LightCoord);
+    vec2 dy = dFdy(LightCoord);
+    float texels = max(length(dx), length(dy)) * virtualSize * feedbackScale;
+    int level = clamp(int(floor(log2(max(texels, 1.0)))), 0, levelCount - 1);
+
+    //Fragments outside of the map ask for nothing, which the cleared buffer already holds
+    if (any(lessThan(LightCoord, vec2(0.0))) || any(greaterThanEqual(LightCoord, vec2(1.0))))
+        discard;
+
+    //Request the page as valid bit, level, row and column
+    ivec2 page = ivec2(LightCoord * float(pagesPerSide >> level));
+    Feedback = (1u << 24) | (uint(level) << 16) | (uint(page.y) << 8) | uint(page.x);
+}
@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in uint aDrawID;
+
+uniform mat4 viewProjection;
+uniform mat4 lightSpaceMatrix;
+
+//Per-draw data written by the RenderQueue: 4 texels of model matrix followed by the material
+uniform samplerBuffer drawData;
+uniform int drawDataBase;
+
+//Where the vertex lands on the whole virtual shadow map, in [0, 1]
+out vec2 LightCoord;
+
+void main()
+{
+    int base = drawDataBase + int(aDrawID) * 5;
+    mat4 model = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1), texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    LightCoord = (lightSpaceMatrix * worldPos).xy * 0.5 + 0.5;
+    gl_Position = viewProjection * worldPos;
+}
@@ -0,0 +1,150 @@
+#include "ShadowAtlas.h"
+
+#include <algorithm>
+
+namespace {
+	uint32_t nextPowerOfTwo(uint32_t value)
+	{
+		uint32_t power = 1;
+		while (power < value)
+			power <<= 1;
+		return power;
+	}
+}
+
+ShadowAtlas::ShadowAtlas(uint32_t size, uint32_t minTile) : m_size(nextPowerOfTwo(size)), m_minTile(std::min(nextPowerOfTwo(minTile), nextPowerOfTwo(size))), m_usedTexels(0)
+{
+	m_nodes.push_back(Node{ 0, 0, m_size, -1, -1, NodeState::Free });
+
+	//One depth texture for every light's shadows
+	glGenTextures(1, &m_texture);
+	glBindTexture(GL_TEXTURE_2D, m_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, m_size, m_size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	//Sampled through a comparison sampler, whose linear filtering blends the results of the 2x2 texels it reads
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	//Depth only frame buffer
+	glGenFramebuffers(1, &m_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_texture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+	glDeleteFramebuffers(1, &m_fbo);
+	glDeleteTextures(1, &m_texture);
+}
+
+AtlasTile ShadowAtlas::allocate(uint32_t size)
+{
+	AtlasTile tile;
+	size = std::max(nextPowerOfTwo(size), m_minTile);
+	if (size > m_size)
+		return tile;
+	int32_t node = allocate(0, size);
+	if (node < 0)
+		return tile;
+	tile.x = m_nodes[node].x;
+	tile.y = m_nodes[node].y;
+	tile.size = size;
+	tile.node = node;
+	m_usedTexels += static_cast<uint64_t>(size) * size;
+	return tile;
+}
+
+int32_t ShadowAtlas::allocate(int32_t node, uint32_t size)
+{
+	if (m_nodes[node].size < size || m_nodes[node].state == NodeState::Used)
+		return -1;
+	if (m_nodes[node].state == NodeState::Free)
+	{
+		if (m_nodes[node].size == size)
+		{
+			m_nodes[node].state = NodeState::Used;
+			return node;
+		}
+
+		//Split into four free quarters, reusing the children from an earlier split
+		if (m_nodes[node].firstChild < 0)
+		{
+			m_nodes[node].firstChild = static_cast<int32_t>(m_nodes.size());
+			uint32_t half = m_nodes[node].size / 2;
+			uint32_t x = m_nodes[node].x, y = m_nodes[node].y;
+			m_nodes.push_back(Node{ x, y, half, node, -1, NodeState::Free });
+			m_nodes.push_back(Node{ x + half, y, half, node, -1, NodeState::Free });
+			m_nodes.push_back(Node{ x, y + half, half, node, -1, NodeState::Free });
+			m_nodes.push_back(Node{ x + half, y + half, half, node, -1, NodeState::Free });
+		}
+		m_nodes[node].state = NodeState::Split;
+	}
+
+	for (int32_t child = 0; child < 4; child++)
+	{
+		int32_t found = allocate(m_nodes[node].firstChild + child, size);
+		if (found >= 0)
+			return found;
+	}
+	return -1;
+}
+
+void ShadowAtlas::release(AtlasTile& tile)
+{
+	if (!tile.valid())
+		return;
+	m_usedTexels -= static_cast<uint64_t>(tile.size) * tile.size;
+	m_nodes[tile.node].state = NodeState::Free;
+
+	//Merge parents whose quarters are all free again
+	int32_t parent = m_nodes[tile.node].parent;
+	while (parent >= 0)
+	{
+		int32_t first = m_nodes[parent].firstChild;
+		bool allFree = true;
+		for (int32_t child = 0; child < 4; child++)
+			allFree = allFree && m_nodes[first + child].state == NodeState::Free;
+		if (!allFree)
+			break;
+		m_nodes[parent].state = NodeState::Free;
+		parent = m_nodes[parent].parent;
+	}
+	tile = AtlasTile();
+}
+
+void ShadowAtlas::bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glViewport(0, 0, m_size, m_size);
+}
+
+void ShadowAtlas::clear(const AtlasTile& tile)
+{
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(tile.x, tile.y, tile.size, tile.size);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+}
+
+glm::vec4 ShadowAtlas::uvRect(const AtlasTile& tile) const
+{
+	float scale = 1.0f / m_size;
+	return glm::vec4(tile.x * scale, tile.y * scale, tile.size * scale, tile.size * scale);
+}
+
+glm::vec4 ShadowAtlas::clipRect(const AtlasTile& tile) const
+{
+	//A tile's [-1, 1] clip range lands on [x, x + size] of the atlas, whose clip range is [0, atlas size]
+	float scale = static_cast<float>(tile.size) / m_size;
+	float offsetX = (2.0f * tile.x + tile.size) / m_size - 1.0f;
+	float offsetY = (2.0f * tile.y + tile.size) / m_size - 1.0f;
+	return glm::vec4(scale, scale, offsetX, offsetY);
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief A square region of a ShadowAtlas, in texels. Tiles from a failed allocation are not valid.
+ */
+struct AtlasTile {
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint32_t size = 0;
+	int32_t node = -1;
+
+	bool valid() const { return node >= 0; }
+};
+
+/**
+ * @brief One large depth texture shared by the shadows of many lights, carved into power of two tiles.
+ *
+ * Tiles are allocated from a quadtree: a free node larger than the request is split into four, and released
+ * nodes merge back into their parent once all four siblings are free. Tiles keep their texels until released,
+ * so lights can cache their shadows across frames, and every light's shadows are sampled through one texture.
+ */
+class ShadowAtlas {
+private:
+	enum class NodeState : uint8_t { Free, Split, Used };
+
+	struct Node {
+		uint32_t x, y, size;
+		int32_t parent;
+		// Index of the first of four consecutive children, kept after they merge so they can be reused.
+		int32_t firstChild;
+		NodeState state;
+	};
+
+	uint32_t m_size;
+	uint32_t m_minTile;
+	uint32_t m_fbo;
+	uint32_t m_texture;
+	std::vector<Node> m_nodes;
+	uint64_t m_usedTexels;
+
+	int32_t allocate(int32_t node, uint32_t size);
+
+public:
+	/**
+	 * @brief Creates a size x size depth texture whose smallest tiles are minTile texels wide. Both are rounded up
+	 * to powers of two.
+	 */
+	explicit ShadowAtlas(uint32_t size = 4096, uint32_t minTile = 64);
+	ShadowAtlas(const ShadowAtlas&) = delete;
+	ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+	~ShadowAtlas();
+
+	/**
+	 * @brief Allocates a tile of at least size texels, rounded up to a power of two. The tile is not valid if no
+	 * space is left.
+	 */
+	AtlasTile allocate(uint32_t size);
+	void release(AtlasTile& tile);
+
+	/**
+	 * @brief Binds the atlas framebuffer with the viewport covering the whole atlas.
+	 */
+	void bind();
+
+	/**
+	 * @brief Clears a tile's depth to the far plane. The atlas must be bound.
+	 */
+	void clear(const AtlasTile& tile);
+
+	/**
+	 * @brief A tile's texture coordinate rectangle, as offset in xy and scale in zw.
+	 */
+	glm::vec4 uvRect(const AtlasTile& tile) const;
+
+	/**
+	 * @brief Maps a tile's clip space onto the atlas': xy scale in xy and xy offset in zw.
+	 */
+	glm::vec4 clipRect(const AtlasTile& tile) const;
+
+	uint32_t size() const { return m_size; }
+	uint32_t texture() const { return m_texture; }
+	// Fraction of the atlas allocated to tiles.
+	float usage() const { return static_cast<float>(m_usedTexels) / (static_cast<float>(m_size) * m_size); }
+};
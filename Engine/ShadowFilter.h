@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "Shader.h"
+
+/**
+ * @brief The pattern of taps default.frag filters shadows with. Every tap is a hardware comparison whose 2x2
+ * bilinear filtering already smooths the edge between its texels.
+ */
+enum class ShadowKernel {
+	// A square grid one texel apart; 5 taps is the center and the four diagonals.
+	Grid,
+	// A 16 point Poisson disk, rotated per pixel.
+	Poisson,
+	// Taps spiraling out at the golden angle, rotated per pixel.
+	Vogel
+};
+
+struct ShadowFilter {
+	ShadowKernel kernel = ShadowKernel::Grid;
+	// 5, 9 or 16 for the grid, up to 16 for the disks.
+	uint32_t taps = 9;
+
+	std::string name() const
+	{
+		const char* names[] = { "grid", "Poisson", "Vogel" };
+		return std::to_string(taps) + " tap " + names[static_cast<int>(kernel)];
+	}
+
+	/**
+	 * @brief Adds the defines selecting this filter, before the shader is loaded.
+	 */
+	void apply(Shader& shader) const
+	{
+		shader.addDefine("SHADOW_KERNEL", std::to_string(static_cast<int>(kernel)));
+		shader.addDefine("SHADOW_TAPS", std::to_string(taps));
+	}
+};
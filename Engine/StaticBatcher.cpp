@@ -0,0 +1,172 @@
+#include "StaticBatcher.h"
+#include "Object3D.h"
+#include "Prefab.h"
+
+//A batch while it is being assembled on the CPU
+struct StagingBatch {
+	StaticBatch batch;
+	std::vector<Vertex3D> vertices;
+	std::vector<uint32_t> faces;
+	std::vector<Vertex3D> shadowVertices;
+	std::vector<uint32_t> shadowFaces;
+};
+
+//Appends a mesh, transformed to world space, to the staging batch matching its texture and material
+static void stageMesh(const Mesh3D& mesh, const glm::mat4& trueModel, const glm::vec4& material, float shadowProxyError, std::vector<StagingBatch>& staging, uint32_t& meshCount)
+{
+	glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(trueModel)));
+
+	StagingBatch* target = nullptr;
+	for (auto& candidate : staging)
+	{
+		if (candidate.batch.texture == mesh.activeTexture() && candidate.batch.material == material)
+		{
+			target = &candidate;
+			break;
+		}
+	}
+	if (target == nullptr)
+	{
+		staging.emplace_back();
+		target = &staging.back();
+		target->batch.texture = mesh.activeTexture();
+		target->batch.material = material;
+	}
+
+	StaticSubmesh submesh;
+	submesh.range.firstIndex = static_cast<uint32_t>(target->faces.size());
+	submesh.range.indexCount = static_cast<uint32_t>(mesh.m_faces.size());
+	submesh.range.vertexCount = static_cast<uint32_t>(mesh.m_vertices.size());
+
+	//Indices are rebased onto the batch's vertices, so the whole batch shares one base vertex
+	uint32_t firstVertex = static_cast<uint32_t>(target->vertices.size());
+	for (auto& vertex : mesh.m_vertices)
+	{
+		glm::vec3 position = glm::vec3(trueModel * glm::vec4(vertex.position, 1.0f));
+		glm::vec3 normal = glm::normalize(normalMatrix * vertex.normal);
+		target->vertices.emplace_back(position, normal, vertex.texCoords);
+		submesh.bounds.expand(position);
+	}
+	for (auto index : mesh.m_faces)
+		target->faces.push_back(firstVertex + index);
+
+	//Shadow casters draw the mesh itself unless the object asked for a proxy, which only needs positions and is
+	//stored apart
+	if (shadowProxyError > 0.0f)
+	{
+		const ShadowProxy& proxy = mesh.shadowProxy(shadowProxyError, trueModel);
+		uint32_t firstShadowVertex = static_cast<uint32_t>(target->shadowVertices.size());
+		submesh.shadowRange.firstIndex = static_cast<uint32_t>(target->shadowFaces.size());
+		submesh.shadowRange.indexCount = static_cast<uint32_t>(proxy.faces.size());
+		submesh.shadowRange.vertexCount = static_cast<uint32_t>(proxy.positions.size());
+		submesh.hasShadowProxy = true;
+		for (auto& position : proxy.positions)
+			target->shadowVertices.emplace_back(glm::vec3(trueModel * glm::vec4(position, 1.0f)), glm::vec3(0.0f), glm::vec2(0.0f));
+		for (auto index : proxy.faces)
+			target->shadowFaces.push_back(firstShadowVertex + index);
+	}
+	else
+		submesh.shadowRange = submesh.range;
+
+	target->batch.bounds.expand(submesh.bounds);
+	target->batch.submeshes.push_back(submesh);
+	meshCount++;
+}
+
+//Stages an object's mesh, and then its children's
+static void stageRecursive(const Object3D& object, std::vector<StagingBatch>& staging, uint32_t& meshCount)
+{
+	stageMesh(object.getMesh(), object.getWorldMatrix(), object.getMaterial(), object.getShadowProxyError(), staging, meshCount);
+	for (int i = 0; i < object.numChildren; i++)
+		stageRecursive(object.getChild(i), staging, meshCount);
+}
+
+StaticBatcher::StaticBatcher() : m_buffer(1 << 16, 1 << 18), m_meshCount(0)
+{
+}
+
+void StaticBatcher::build(const std::vector<const Object3D*>& objects, const std::vector<const PrefabInstance*>& instances)
+{
+	std::vector<StagingBatch> staging;
+	m_meshCount = 0;
+	for (auto object : objects)
+		stageRecursive(*object, staging, m_meshCount);
+	for (auto instance : instances)
+	{
+		instance->forEachNode([&](const Mesh3D& mesh, const glm::mat4& model, const glm::vec4& material) {
+			stageMesh(mesh, model, material, instance->getShadowProxyError(), staging, m_meshCount);
+		});
+	}
+
+	//Start the buffer over; the previous batches' draws have already been submitted
+	m_buffer.reset();
+	m_batches.clear();
+	for (auto& stage : staging)
+	{
+		StaticBatch& batch = stage.batch;
+		batch.range = m_buffer.allocate(stage.vertices, stage.faces);
+		batch.shadowRange = MeshRange();
+		if (!stage.shadowFaces.empty())
+			batch.shadowRange = m_buffer.allocate(stage.shadowVertices, stage.shadowFaces);
+		for (auto& submesh : batch.submeshes)
+		{
+			submesh.range.firstIndex += batch.range.firstIndex;
+			submesh.range.baseVertex = batch.range.baseVertex;
+			const MeshRange& shadowBase = submesh.hasShadowProxy ? batch.shadowRange : batch.range;
+			submesh.shadowRange.firstIndex += shadowBase.firstIndex;
+			submesh.shadowRange.baseVertex = shadowBase.baseVertex;
+		}
+		m_batches.push_back(std::move(batch));
+	}
+}
+
+void StaticBatcher::enqueue(RenderQueue& queue, uint32_t views) const
+{
+	for (auto& batch : m_batches)
+	{
+		//Skip batches no view sees without testing their submeshes
+		uint32_t batchViews = queue.visibleViews(batch.bounds, views);
+		if (batchViews == 0)
+		{
+			queue.reportCulled(views, static_cast<uint32_t>(batch.submeshes.size()));
+			continue;
+		}
+		queue.reportCulled(views & ~batchViews, static_cast<uint32_t>(batch.submeshes.size()));
+
+		//Submeshes follow each other in the batch's range, so a run of them seen by the same views is one
+		//contiguous range. Their shadow ranges only follow each other while the run keeps to meshes with proxies
+		//or to meshes without
+		DrawItem item;
+		item.buffer = &m_buffer;
+		item.texture = batch.texture;
+		item.model = glm::mat4(1);
+		item.material = batch.material;
+		item.viewMask = 0;
+		for (auto& submesh : batch.submeshes)
+		{
+			uint32_t submeshViews = queue.visibleViews(submesh.bounds, batchViews);
+			queue.reportCulled(batchViews & ~submeshViews, 1);
+			bool shadowFollows = submesh.shadowRange.baseVertex == item.shadowRange.baseVertex &&
+				submesh.shadowRange.firstIndex == item.shadowRange.firstIndex + item.shadowRange.indexCount;
+			if (submeshViews != item.viewMask || (submeshViews != 0 && !shadowFollows))
+			{
+				if (item.viewMask != 0)
+					queue.add(item);
+				item.range = submesh.range;
+				item.shadowRange = submesh.shadowRange;
+				item.bounds = submesh.bounds;
+				item.viewMask = submeshViews;
+				continue;
+			}
+			if (submeshViews == 0)
+				continue;
+			item.range.indexCount += submesh.range.indexCount;
+			item.range.vertexCount += submesh.range.vertexCount;
+			item.shadowRange.indexCount += submesh.shadowRange.indexCount;
+			item.shadowRange.vertexCount += submesh.shadowRange.vertexCount;
+			item.bounds.expand(submesh.bounds);
+		}
+		if (item.viewMask != 0)
+			queue.add(item);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Bounds.h"
+#include "MeshBuffer.h"
+#include "RenderQueue.h"
+
+class Object3D;
+class PrefabInstance;
+
+/**
+ * @brief One original mesh inside a static batch, kept so the batch can still be culled piece by piece.
+ */
+struct StaticSubmesh {
+	MeshRange range;
+	// The range itself, or where the mesh's shadow proxy is if it has one.
+	MeshRange shadowRange;
+	bool hasShadowProxy = false;
+	AABB bounds;
+};
+
+/**
+ * @brief Static geometry sharing a texture and material, pre-transformed to world space and merged.
+ */
+struct StaticBatch {
+	uint32_t texture;
+	glm::vec4 material;
+	MeshRange range;
+	// The shadow proxies of the batch's meshes that have one, stored after the batch; empty when none do. Meshes
+	// without one cast shadows with their part of range.
+	MeshRange shadowRange;
+	AABB bounds;
+	std::vector<StaticSubmesh> submeshes;
+};
+
+/**
+ * @brief Merges objects that never move into a few world-space batches at load time.
+ *
+ * Every mesh in the given objects' hierarchies is transformed into world space and appended to the batch for
+ * its texture and material, so static scenery costs one draw per material instead of one per mesh. Call
+ * build() again whenever the set of static objects changes.
+ */
+class StaticBatcher {
+private:
+	MeshBuffer m_buffer;
+	std::vector<StaticBatch> m_batches;
+	uint32_t m_meshCount;
+
+public:
+	StaticBatcher();
+
+	/**
+	 * @brief Replaces the batches with ones built from the given objects and their children, and the given prefab
+	 * instances.
+	 */
+	void build(const std::vector<const Object3D*>& objects, const std::vector<const PrefabInstance*>& instances = {});
+
+	/**
+	 * @brief Queues each batch for the given views, culling its submeshes against the queue's frusta. Neighbouring
+	 * submeshes seen by the same views are queued as one draw, so a batch seen whole is still a single draw.
+	 */
+	void enqueue(RenderQueue& queue, uint32_t views = RenderQueue::AllViews) const;
+
+	const std::vector<StaticBatch>& batches() const { return m_batches; }
+	// Number of meshes merged into the batches.
+	uint32_t meshCount() const { return m_meshCount; }
+};
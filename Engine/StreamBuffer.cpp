@@ -0,0 +1,147 @@
+#include "StreamBuffer.h"
+#include "GLExtensions.h"
+#include <chrono>
+
+StreamBuffer::StreamBuffer(size_t frameSize) : m_buffer(0), m_frameSize(frameSize), m_persistent(glCaps.bufferStorage), m_mapping(nullptr), m_mapped(false),
+	m_fences(), m_frame(0), m_frameOffset(0), m_bytesStreamed(0), m_totalBytesStreamed(0), m_fenceWaitMs(0)
+{
+	createStorage();
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	for (uint32_t i = 0; i < FramesInFlight; i++)
+	{
+		if (m_fences[i] != nullptr)
+			glDeleteSync(m_fences[i]);
+		if (!m_retired[i].empty())
+			glDeleteBuffers(static_cast<GLsizei>(m_retired[i].size()), m_retired[i].data());
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+	if (m_mapping != nullptr || m_mapped)
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &m_buffer);
+}
+
+void StreamBuffer::createStorage()
+{
+	size_t size = m_frameSize * FramesInFlight;
+
+	//GL_COPY_WRITE_BUFFER is only used as a neutral binding point, the buffer itself can be bound to any target later
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+	if (m_persistent)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+		m_mapping = static_cast<uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+	}
+	else
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void StreamBuffer::grow(size_t frameSize)
+{
+	commit();
+
+	//The old buffer may still be read by frames in flight, so only retire it here
+	if (m_mapping != nullptr)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		m_mapping = nullptr;
+	}
+	m_retired[m_frame].push_back(m_buffer);
+
+	while (m_frameSize < frameSize)
+		m_frameSize *= 2;
+	createStorage();
+
+	//Start writing at the beginning of this frame's region in the new buffer; nothing has used it yet
+	m_frameOffset = 0;
+}
+
+void StreamBuffer::beginFrame()
+{
+	m_frame = (m_frame + 1) % FramesInFlight;
+	m_frameOffset = 0;
+	m_fenceWaitMs = 0;
+
+	//Wait until the GPU has finished the frame that last used this region. With three regions this is
+	//normally already signalled and the wait is free.
+	GLsync& fence = m_fences[m_frame];
+	if (fence != nullptr)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		auto end = std::chrono::high_resolution_clock::now();
+		m_fenceWaitMs = std::chrono::duration<float, std::milli>(end - start).count();
+
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	if (!m_retired[m_frame].empty())
+	{
+		glDeleteBuffers(static_cast<GLsizei>(m_retired[m_frame].size()), m_retired[m_frame].data());
+		m_retired[m_frame].clear();
+	}
+}
+
+void StreamBuffer::endFrame()
+{
+	commit();
+	m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_bytesStreamed = m_frameOffset;
+	m_totalBytesStreamed += m_frameOffset;
+}
+
+StreamAllocation StreamBuffer::allocate(size_t size, size_t alignment)
+{
+	size_t offset = (m_frameOffset + alignment - 1) / alignment * alignment;
+	if (offset + size > m_frameSize)
+	{
+		grow(size * 2 > m_frameSize * 2 ? size * 2 : m_frameSize * 2);
+		offset = 0;
+	}
+	m_frameOffset = offset + size;
+
+	StreamAllocation allocation;
+	allocation.buffer = m_buffer;
+	allocation.offset = m_frame * m_frameSize + offset;
+
+	if (m_persistent)
+	{
+		allocation.data = m_mapping + allocation.offset;
+	}
+	else
+	{
+		//Only one range of a buffer can be mapped at a time
+		commit();
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		allocation.data = glMapBufferRange(GL_COPY_WRITE_BUFFER, allocation.offset, size,
+			GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		m_mapped = true;
+	}
+	return allocation;
+}
+
+void StreamBuffer::commit()
+{
+	//The persistent mapping is coherent, so there is nothing to do there
+	if (m_mapped)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		m_mapped = false;
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief A region of a StreamBuffer handed out for this frame's data.
+ */
+struct StreamAllocation {
+	// Where to write. Valid until StreamBuffer::commit() or the end of the frame.
+	void* data = nullptr;
+	// The buffer object and byte offset the GPU should read the data from.
+	uint32_t buffer = 0;
+	size_t offset = 0;
+};
+
+/**
+ * @brief A ring buffer for data that is rewritten every frame (matrices, materials, draw commands, particle
+ * vertices, ...).
+ *
+ * The buffer is split into one region per frame in flight. Each frame sub-allocates linearly from its region,
+ * and a fence placed at the end of the frame tells us when the GPU is done with it, so the CPU never writes
+ * over data the GPU is still reading and never has to wait for the frame it is currently recording.
+ * With ARB_buffer_storage the whole buffer stays persistently mapped; otherwise each allocation is mapped
+ * with GL_MAP_UNSYNCHRONIZED_BIT, which is safe for the same reason.
+ */
+class StreamBuffer {
+private:
+	uint32_t m_buffer;
+	size_t m_frameSize;
+	bool m_persistent;
+	// The persistent mapping of the whole buffer, or null in fallback mode.
+	uint8_t* m_mapping;
+	// True while an allocation is mapped in fallback mode.
+	bool m_mapped;
+
+	GLsync m_fences[3];
+	uint32_t m_frame;
+	size_t m_frameOffset;
+
+	// Buffers replaced by grow() this frame; deleted once the frame's fence has passed.
+	std::vector<uint32_t> m_retired[3];
+
+	size_t m_bytesStreamed;
+	size_t m_totalBytesStreamed;
+	float m_fenceWaitMs;
+
+	void createStorage();
+	// Replaces the buffer with one whose frame regions hold at least the given size.
+	void grow(size_t frameSize);
+
+public:
+	/**
+	 * @brief Number of frames the CPU may run ahead of the GPU.
+	 */
+	static const uint32_t FramesInFlight = 3;
+
+	StreamBuffer(size_t frameSize);
+	~StreamBuffer();
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	/**
+	 * @brief Moves to the next frame's region, waiting for the GPU to release it if it is still in use.
+	 */
+	void beginFrame();
+
+	/**
+	 * @brief Fences the current frame's region. Call after the frame's last draw that reads from the buffer.
+	 */
+	void endFrame();
+
+	/**
+	 * @brief Reserves size bytes at the given alignment in this frame's region.
+	 */
+	StreamAllocation allocate(size_t size, size_t alignment);
+
+	/**
+	 * @brief Makes the writes to earlier allocations visible to the GPU. Call before drawing with them.
+	 */
+	void commit();
+
+	/**
+	 * @brief The current buffer object. It changes if the buffer has to grow, so bind it each frame.
+	 */
+	uint32_t buffer() const { return m_buffer; }
+
+	// Statistics for the last completed frame.
+	size_t bytesStreamed() const { return m_bytesStreamed; }
+	size_t totalBytesStreamed() const { return m_totalBytesStreamed; }
+	float fenceWaitMs() const { return m_fenceWaitMs; }
+	// Bytes each frame's region holds, doubled whenever a frame outgrows it.
+	size_t frameSize() const { return m_frameSize; }
+};
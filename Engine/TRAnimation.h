@@ -1,6 +1,6 @@
 #pragma once
 
-#include "Object3D.h"
+#include "SceneGraph.h"
 #include "Animation.h"
 class TRAnimation : public Animation {
 private:
@@ -12,6 +12,6 @@ private:
 		object().rotate(m_perSecond * dt);
 	}
 public:
-	TRAnimation(Object3D& object, float_t duration, const glm::vec3& totalMovement, const glm::vec3& totalRotation) :
-		Animation(object, duration), m_translation(totalMovement / duration), m_perSecond(totalRotation / duration) {}
+	TRAnimation(SceneGraph& scene, SceneHandle object, float_t duration, const glm::vec3& totalMovement, const glm::vec3& totalRotation) :
+		Animation(scene, object, duration), m_translation(totalMovement / duration), m_perSecond(totalRotation / duration) {}
 };
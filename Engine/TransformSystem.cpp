@@ -0,0 +1,383 @@
+#include <algorithm>
+#include <glm/ext.hpp>
+#include <immintrin.h>
+
+#include "TransformSystem.h"
+
+namespace {
+	//Four floats in an SSE register, plus the handful of operations the matrix rebuild needs
+	struct Float4 {
+		__m128 v;
+
+		static const int Width = 4;
+
+		static Float4 load(const float* p) { return { _mm_loadu_ps(p) }; }
+		static Float4 splat(float f) { return { _mm_set1_ps(f) }; }
+
+		friend Float4 operator+(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+		friend Float4 operator-(Float4 a, Float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+		friend Float4 operator*(Float4 a, Float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+
+		//Lanes of b where the mask is set, lanes of a elsewhere
+		static Float4 select(Float4 mask, Float4 a, Float4 b) { return { _mm_or_ps(_mm_and_ps(mask.v, b.v), _mm_andnot_ps(mask.v, a.v)) }; }
+		static Float4 negateWhere(Float4 mask, Float4 a) { return { _mm_xor_ps(a.v, _mm_and_ps(mask.v, _mm_set1_ps(-0.0f))) }; }
+
+		//Rounds x / (pi/2) to the nearest quadrant, returning it as a float and building the masks sincos needs
+		static Float4 quadrant(Float4 x, Float4& swap, Float4& sinNegative, Float4& cosNegative)
+		{
+			__m128i q = _mm_cvtps_epi32(_mm_mul_ps(x.v, _mm_set1_ps(0.636619772f)));
+			__m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+			swap.v = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+			sinNegative.v = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, two), two));
+			cosNegative.v = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), two));
+			return { _mm_cvtepi32_ps(q) };
+		}
+
+		//Writes the four lanes of one matrix column to four consecutive matrices
+		static void storeColumn(glm::mat4* out, int column, Float4 x, Float4 y, Float4 z, Float4 w)
+		{
+			_MM_TRANSPOSE4_PS(x.v, y.v, z.v, w.v);
+			_mm_storeu_ps(&out[0][column][0], x.v);
+			_mm_storeu_ps(&out[1][column][0], y.v);
+			_mm_storeu_ps(&out[2][column][0], z.v);
+			_mm_storeu_ps(&out[3][column][0], w.v);
+		}
+	};
+
+#ifdef __AVX__
+	//Eight floats in an AVX register
+	struct Float8 {
+		__m256 v;
+
+		static const int Width = 8;
+
+		static Float8 load(const float* p) { return { _mm256_loadu_ps(p) }; }
+		static Float8 splat(float f) { return { _mm256_set1_ps(f) }; }
+
+		friend Float8 operator+(Float8 a, Float8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+		friend Float8 operator-(Float8 a, Float8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+		friend Float8 operator*(Float8 a, Float8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+
+		static Float8 select(Float8 mask, Float8 a, Float8 b) { return { _mm256_blendv_ps(a.v, b.v, mask.v) }; }
+		static Float8 negateWhere(Float8 mask, Float8 a) { return { _mm256_xor_ps(a.v, _mm256_and_ps(mask.v, _mm256_set1_ps(-0.0f))) }; }
+
+		//AVX has no 256-bit integer ops before AVX2, so the quadrant bits are found with float arithmetic
+		static Float8 quadrant(Float8 x, Float8& swap, Float8& sinNegative, Float8& cosNegative)
+		{
+			__m256 q = _mm256_round_ps(_mm256_mul_ps(x.v, _mm256_set1_ps(0.636619772f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+			//q mod 4, in 0..3 even for negative angles
+			__m256 m = _mm256_sub_ps(q, _mm256_mul_ps(_mm256_floor_ps(_mm256_mul_ps(q, _mm256_set1_ps(0.25f))), _mm256_set1_ps(4.0f)));
+			__m256 odd = _mm256_sub_ps(m, _mm256_mul_ps(_mm256_floor_ps(_mm256_mul_ps(m, _mm256_set1_ps(0.5f))), _mm256_set1_ps(2.0f)));
+			swap.v = _mm256_cmp_ps(odd, _mm256_set1_ps(0.5f), _CMP_GT_OQ);
+			sinNegative.v = _mm256_cmp_ps(m, _mm256_set1_ps(1.5f), _CMP_GT_OQ);
+			cosNegative.v = _mm256_and_ps(_mm256_cmp_ps(m, _mm256_set1_ps(0.5f), _CMP_GT_OQ), _mm256_cmp_ps(m, _mm256_set1_ps(2.5f), _CMP_LT_OQ));
+			return { q };
+		}
+
+		static void storeColumn(glm::mat4* out, int column, Float8 x, Float8 y, Float8 z, Float8 w)
+		{
+			Float4::storeColumn(out, column, { _mm256_castps256_ps128(x.v) }, { _mm256_castps256_ps128(y.v) }, { _mm256_castps256_ps128(z.v) }, { _mm256_castps256_ps128(w.v) });
+			Float4::storeColumn(out + 4, column, { _mm256_extractf128_ps(x.v, 1) }, { _mm256_extractf128_ps(y.v, 1) }, { _mm256_extractf128_ps(z.v, 1) }, { _mm256_extractf128_ps(w.v, 1) });
+		}
+	};
+	typedef Float8 FloatN;
+#else
+	typedef Float4 FloatN;
+#endif
+
+	//Sine and cosine of every lane: reduction to [-pi/4, pi/4] then the Cephes single-precision polynomials
+	template <typename V>
+	void sincos(V x, V& s, V& c)
+	{
+		V swap, sinNegative, cosNegative;
+		V q = V::quadrant(x, swap, sinNegative, cosNegative);
+
+		//pi/2 split into three parts so the reduction stays accurate for large angles
+		V r = x - q * V::splat(1.5703125f);
+		r = r - q * V::splat(4.837512969970703125e-4f);
+		r = r - q * V::splat(7.54978995489188216e-8f);
+		V z = r * r;
+
+		V sp = ((V::splat(-1.9515295891e-4f) * z + V::splat(8.3321608736e-3f)) * z - V::splat(1.6666654611e-1f)) * z * r + r;
+		V cp = ((V::splat(2.443315711809948e-5f) * z - V::splat(1.388731625493765e-3f)) * z + V::splat(4.166664568298827e-2f)) * z * z
+			- V::splat(0.5f) * z + V::splat(1.0f);
+
+		s = V::negateWhere(sinNegative, V::select(swap, sp, cp));
+		c = V::negateWhere(cosNegative, V::select(swap, cp, sp));
+	}
+}
+
+const uint32_t TransformSystem::BatchSize = FloatN::Width;
+const uint32_t TransformSystem::NoParent;
+
+TransformSystem::TransformSystem() : m_updateCount(0), m_orderStale(false), m_count(0), m_stale(false), m_rebuilt(0)
+{
+}
+
+TransformHandle TransformSystem::create(const glm::mat4& base)
+{
+	TransformHandle handle;
+	if (!m_free.empty())
+	{
+		handle.index = m_free.back();
+		m_free.pop_back();
+	}
+	else
+	{
+		handle.index = m_count++;
+		if (m_count > m_alive.size())
+		{
+			//Grow by whole batches so update() never reads past the end of an array
+			size_t capacity = std::max<size_t>(BatchSize, m_alive.size() * 2);
+			for (auto& component : m_components)
+				component.resize(capacity, 0.0f);
+			m_local.resize(capacity, glm::mat4(1));
+			m_world.resize(capacity, glm::mat4(1));
+			m_parent.resize(capacity, NoParent);
+			m_dirty.resize(capacity, 0);
+			m_changedAt.resize(capacity, 0);
+			m_changed.resize(capacity, 0);
+			m_alive.resize(capacity, 0);
+		}
+	}
+
+	m_alive[handle.index] = 1;
+	m_parent[handle.index] = NoParent;
+	m_orderStale = true;
+	setPosition(handle, glm::vec3(0));
+	setOrientation(handle, glm::vec3(0));
+	setScale(handle, glm::vec3(1));
+	setCenter(handle, glm::vec3(0));
+	setBase(handle, base);
+	return handle;
+}
+
+void TransformSystem::destroy(TransformHandle handle)
+{
+	if (!handle.valid() || !m_alive[handle.index])
+		return;
+	m_alive[handle.index] = 0;
+	m_parent[handle.index] = NoParent;
+	m_dirty[handle.index] = 0;
+	m_free.push_back(handle.index);
+	m_orderStale = true;
+}
+
+glm::vec3 TransformSystem::position(TransformHandle handle) const
+{
+	return glm::vec3(get(PositionX, handle), get(PositionY, handle), get(PositionZ, handle));
+}
+
+glm::vec3 TransformSystem::orientation(TransformHandle handle) const
+{
+	return glm::vec3(get(OrientationX, handle), get(OrientationY, handle), get(OrientationZ, handle));
+}
+
+glm::vec3 TransformSystem::scale(TransformHandle handle) const
+{
+	return glm::vec3(get(ScaleX, handle), get(ScaleY, handle), get(ScaleZ, handle));
+}
+
+glm::vec3 TransformSystem::center(TransformHandle handle) const
+{
+	return glm::vec3(get(CenterX, handle), get(CenterY, handle), get(CenterZ, handle));
+}
+
+glm::mat4 TransformSystem::base(TransformHandle handle) const
+{
+	glm::mat4 m;
+	for (int i = 0; i < 16; i++)
+		m[i / 4][i % 4] = get(static_cast<Component>(Base00 + i), handle);
+	return m;
+}
+
+void TransformSystem::setPosition(TransformHandle handle, const glm::vec3& position)
+{
+	set(PositionX, handle, position.x);
+	set(PositionY, handle, position.y);
+	set(PositionZ, handle, position.z);
+	markDirty(handle);
+}
+
+void TransformSystem::setOrientation(TransformHandle handle, const glm::vec3& orientation)
+{
+	set(OrientationX, handle, orientation.x);
+	set(OrientationY, handle, orientation.y);
+	set(OrientationZ, handle, orientation.z);
+	markDirty(handle);
+}
+
+void TransformSystem::setScale(TransformHandle handle, const glm::vec3& scale)
+{
+	set(ScaleX, handle, scale.x);
+	set(ScaleY, handle, scale.y);
+	set(ScaleZ, handle, scale.z);
+	markDirty(handle);
+}
+
+void TransformSystem::setCenter(TransformHandle handle, const glm::vec3& center)
+{
+	set(CenterX, handle, center.x);
+	set(CenterY, handle, center.y);
+	set(CenterZ, handle, center.z);
+	markDirty(handle);
+}
+
+void TransformSystem::setBase(TransformHandle handle, const glm::mat4& base)
+{
+	for (int i = 0; i < 16; i++)
+		set(static_cast<Component>(Base00 + i), handle, base[i / 4][i % 4]);
+	markDirty(handle);
+}
+
+void TransformSystem::copy(TransformHandle from, TransformHandle to)
+{
+	for (auto& component : m_components)
+		component[to.index] = component[from.index];
+	markDirty(to);
+}
+
+void TransformSystem::setParent(TransformHandle handle, TransformHandle parent)
+{
+	m_parent[handle.index] = parent.valid() ? parent.index : NoParent;
+	m_orderStale = true;
+	markDirty(handle);
+}
+
+const glm::mat4& TransformSystem::local(TransformHandle handle)
+{
+	if (m_stale)
+		update();
+	return m_local[handle.index];
+}
+
+const glm::mat4& TransformSystem::world(TransformHandle handle)
+{
+	if (m_stale)
+		update();
+	return m_world[handle.index];
+}
+
+void TransformSystem::rebuildLocal(uint32_t first)
+{
+	typedef FloatN V;
+	auto load = [&](int component) { return V::load(&m_components[component][first]); };
+
+	V sx, cx, sy, cy, sz, cz;
+	sincos(load(OrientationX), sx, cx);
+	sincos(load(OrientationY), sy, cy);
+	sincos(load(OrientationZ), sz, cz);
+
+	//Rows of Rz * Rx * Ry, the order glm::rotate applied them in
+	V r[3][3] = {
+		{ cz * cy - sz * sx * sy, V::splat(0) - sz * cx, cz * sy + sz * sx * cy },
+		{ sz * cy + cz * sx * sy, cz * cx, sz * sy - cz * sx * cy },
+		{ V::splat(0) - cx * sy, sx, cx * cy }
+	};
+
+	V scale[3] = { load(ScaleX), load(ScaleY), load(ScaleZ) };
+	V center[3] = { load(CenterX), load(CenterY), load(CenterZ) };
+	V position[3] = { load(PositionX), load(PositionY), load(PositionZ) };
+
+	//Local matrix: rotation times scale, translated so the scaled center stays the pivot
+	V local[3][4];
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			local[i][j] = r[i][j] * scale[j];
+		local[i][3] = position[i] + center[i] * scale[i] - (local[i][0] * center[0] + local[i][1] * center[1] + local[i][2] * center[2]);
+	}
+
+	//World = local * base, one column at a time; the bottom row of local is (0, 0, 0, 1)
+	for (int k = 0; k < 4; k++)
+	{
+		V b[4] = { load(Base00 + k * 4), load(Base00 + k * 4 + 1), load(Base00 + k * 4 + 2), load(Base00 + k * 4 + 3) };
+		V column[3];
+		for (int i = 0; i < 3; i++)
+			column[i] = local[i][0] * b[0] + local[i][1] * b[1] + local[i][2] * b[2] + local[i][3] * b[3];
+		V::storeColumn(&m_local[first], k, column[0], column[1], column[2], b[3]);
+	}
+}
+
+void TransformSystem::rebuildOrder()
+{
+	//Depth of each live transform below its root; parents sort ahead of their children
+	std::vector<uint32_t> depth(m_count, 0);
+	m_order.clear();
+	for (uint32_t i = 0; i < m_count; i++)
+	{
+		if (!m_alive[i])
+			continue;
+		for (uint32_t p = m_parent[i]; p != NoParent; p = m_parent[p])
+			depth[i]++;
+		m_order.push_back(i);
+	}
+	std::stable_sort(m_order.begin(), m_order.end(), [&](uint32_t a, uint32_t b) { return depth[a] < depth[b]; });
+	m_orderStale = false;
+}
+
+void TransformSystem::update()
+{
+	m_rebuilt = 0;
+	if (!m_stale)
+		return;
+	m_updateCount++;
+
+	//Local matrices, for every batch with at least one dirty transform
+	for (uint32_t first = 0; first < m_count; first += BatchSize)
+	{
+		uint32_t dirty = 0;
+		for (uint32_t i = 0; i < BatchSize; i++)
+			dirty |= m_dirty[first + i];
+		if (dirty)
+			rebuildLocal(first);
+	}
+
+	//World matrices, for dirty transforms and anything below one
+	if (m_orderStale)
+		rebuildOrder();
+	for (uint32_t i : m_order)
+	{
+		uint32_t parent = m_parent[i];
+		bool parentChanged = parent != NoParent && m_changedAt[parent] == m_updateCount;
+		if (!m_dirty[i] && !parentChanged)
+			continue;
+		m_changedAt[i] = m_updateCount;
+		if (!m_changed[i])
+		{
+			m_changed[i] = 1;
+			m_changedList.push_back(i);
+		}
+		m_world[i] = parent != NoParent ? m_world[parent] * m_local[i] : m_local[i];
+		m_dirty[i] = 0;
+		m_rebuilt++;
+	}
+	m_stale = false;
+}
+
+void TransformSystem::clearChanged()
+{
+	for (uint32_t i : m_changedList)
+		m_changed[i] = 0;
+	m_changedList.clear();
+}
+
+glm::mat4 TransformSystem::buildReference(TransformHandle handle) const
+{
+	glm::vec3 p = position(handle), o = orientation(handle), s = scale(handle), c = center(handle);
+	auto m = glm::translate(glm::mat4(1), p);
+	m = glm::translate(m, c * s);
+	m = glm::rotate(m, o[2], glm::vec3(0, 0, 1));
+	m = glm::rotate(m, o[0], glm::vec3(1, 0, 0));
+	m = glm::rotate(m, o[1], glm::vec3(0, 1, 0));
+	m = glm::scale(m, s);
+	m = glm::translate(m, -c);
+	return m * base(handle);
+}
+
+TransformSystem& TransformSystem::shared()
+{
+	//Object3D's constructor creates this before the first transform is allocated
+	static TransformSystem system;
+	return system;
+}
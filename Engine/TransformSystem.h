@@ -0,0 +1,165 @@
+#pragma once
+#include <atomic>
+#include <glm/glm.hpp>
+#include <vector>
+
+/**
+ * @brief Refers to one transform stored in a TransformSystem.
+ */
+struct TransformHandle {
+	uint32_t index = UINT32_MAX;
+
+	bool valid() const { return index != UINT32_MAX; }
+};
+
+/**
+ * @brief Stores object transforms as structure-of-arrays and rebuilds their matrices in SIMD batches.
+ *
+ * Each transform is a position, Euler orientation (applied Z, then X, then Y), scale, pivot center and a base
+ * matrix, composed exactly like Object3D always has:
+ *     translate(position) * translate(center * scale) * rotateZ * rotateX * rotateY * scale * translate(-center) * base
+ * Every component lives in its own tightly packed float array, so a batch of 4 (SSE) or 8 (AVX) transforms can be
+ * loaded straight into registers and turned into matrices together, sines and cosines included.
+ *
+ * A transform may have a parent, in which case its world matrix is the parent's world matrix times its local one.
+ * Changing a transform only writes its arrays and marks it dirty; update() then rebuilds the local matrices of
+ * batches holding a dirty transform and the world matrices of dirty transforms and their descendants, so a
+ * hierarchy that did not move costs no matrix math at all.
+ */
+class TransformSystem {
+private:
+	// One array per scalar component: position xyz, orientation xyz, scale xyz, center xyz, then the 16 base matrix
+	// entries in column-major order. Arrays are padded to a whole number of SIMD batches.
+	enum Component {
+		PositionX, PositionY, PositionZ,
+		OrientationX, OrientationY, OrientationZ,
+		ScaleX, ScaleY, ScaleZ,
+		CenterX, CenterY, CenterZ,
+		Base00,
+		ComponentCount = Base00 + 16
+	};
+	std::vector<float> m_components[ComponentCount];
+
+	// Cached local matrices, and world matrices that include every parent's transform.
+	std::vector<glm::mat4> m_local;
+	std::vector<glm::mat4> m_world;
+
+	// Each transform's parent index, or NoParent.
+	std::vector<uint32_t> m_parent;
+
+	// Set when a transform changed since the last update().
+	std::vector<uint8_t> m_dirty;
+	// The update() that last rebuilt each world matrix, counting from 1, so children see their parent changed.
+	std::vector<uint32_t> m_changedAt;
+	uint32_t m_updateCount;
+	// Set when a world matrix was rebuilt since the last clearChanged(), by any update(), and the transforms set.
+	std::vector<uint8_t> m_changed;
+	std::vector<uint32_t> m_changedList;
+
+	// Live transforms ordered so every parent comes before its children.
+	std::vector<uint32_t> m_order;
+	bool m_orderStale;
+
+	std::vector<uint8_t> m_alive;
+	std::vector<uint32_t> m_free;
+	uint32_t m_count;
+
+	// True when any transform changed since the last update(). Atomic so systems may move different transforms
+	// from several threads at once.
+	std::atomic<bool> m_stale;
+
+	// World matrices rebuilt by the last update().
+	uint32_t m_rebuilt;
+
+	static const uint32_t NoParent = UINT32_MAX;
+
+	void markDirty(TransformHandle handle) { m_dirty[handle.index] = 1; m_stale = true; }
+	// Rebuilds the local matrices of the SIMD batch starting at the given index.
+	void rebuildLocal(uint32_t first);
+	void rebuildOrder();
+
+	float get(Component component, TransformHandle handle) const { return m_components[component][handle.index]; }
+	void set(Component component, TransformHandle handle, float value) { m_components[component][handle.index] = value; }
+
+public:
+	/**
+	 * @brief Transforms processed per SIMD batch: 8 when compiled for AVX, otherwise 4.
+	 */
+	static const uint32_t BatchSize;
+
+	TransformSystem();
+	TransformSystem(const TransformSystem&) = delete;
+	TransformSystem& operator=(const TransformSystem&) = delete;
+
+	/**
+	 * @brief Allocates an identity transform with the given base matrix.
+	 */
+	TransformHandle create(const glm::mat4& base);
+	void destroy(TransformHandle handle);
+
+	glm::vec3 position(TransformHandle handle) const;
+	glm::vec3 orientation(TransformHandle handle) const;
+	glm::vec3 scale(TransformHandle handle) const;
+	glm::vec3 center(TransformHandle handle) const;
+	glm::mat4 base(TransformHandle handle) const;
+
+	void setPosition(TransformHandle handle, const glm::vec3& position);
+	void setOrientation(TransformHandle handle, const glm::vec3& orientation);
+	void setScale(TransformHandle handle, const glm::vec3& scale);
+	void setCenter(TransformHandle handle, const glm::vec3& center);
+	void setBase(TransformHandle handle, const glm::mat4& base);
+
+	/**
+	 * @brief Attaches a transform to a parent, or detaches it when the parent handle is invalid.
+	 */
+	void setParent(TransformHandle handle, TransformHandle parent);
+
+	/**
+	 * @brief Copies every component of one transform into another. The parent is not copied.
+	 */
+	void copy(TransformHandle from, TransformHandle to);
+
+	/**
+	 * @brief The transform's own matrix, without its parents, rebuilding dirty matrices first.
+	 */
+	const glm::mat4& local(TransformHandle handle);
+
+	/**
+	 * @brief The transform's local->world matrix including its parents, rebuilding dirty matrices first.
+	 */
+	const glm::mat4& world(TransformHandle handle);
+
+	/**
+	 * @brief Rebuilds the matrices of dirty transforms and their descendants. Called once per frame, after
+	 * animations have run; does nothing when no transform changed.
+	 */
+	void update();
+
+	/**
+	 * @brief World matrices recomputed by the last update().
+	 */
+	uint32_t matricesRebuilt() const { return m_rebuilt; }
+
+	/**
+	 * @brief Whether this transform's world matrix was rebuilt since the last clearChanged(), including by a lazy
+	 * local() or world(), so anything derived from it, such as world-space bounds, needs recomputing.
+	 */
+	bool changed(TransformHandle handle) const { return m_changed[handle.index] != 0; }
+
+	/**
+	 * @brief Forgets which transforms changed, once everything derived from them has been refreshed.
+	 */
+	void clearChanged();
+
+	/**
+	 * @brief Builds one matrix the straightforward way with glm, for comparison with update().
+	 */
+	glm::mat4 buildReference(TransformHandle handle) const;
+
+	uint32_t capacity() const { return static_cast<uint32_t>(m_alive.size()); }
+
+	/**
+	 * @brief The system Object3D stores its transforms in.
+	 */
+	static TransformSystem& shared();
+};
@@ -1,5 +1,5 @@
 #pragma once
-#include "Object3D.h"
+#include "SceneGraph.h"
 #include "Animation.h"
 class TranslationAnimation : public Animation {
 private:
@@ -9,7 +9,7 @@ private:
 		object().move(m_translation * dt);
 	}
 public:
-	TranslationAnimation(Object3D& object, float_t duration, 
+	TranslationAnimation(SceneGraph& scene, SceneHandle object, float_t duration, 
 		const glm::vec3& totalMovement) :
-		Animation(object, duration), m_translation(totalMovement / duration) {}
+		Animation(scene, object, duration), m_translation(totalMovement / duration) {}
 };
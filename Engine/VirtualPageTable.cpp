@@ -0,0 +1,149 @@
+#include "VirtualPageTable.h"
+
+#include <algorithm>
+#include <functional>
+
+VirtualPageTable::VirtualPageTable(uint32_t pagesPerSide, uint32_t physicalPerSide) : m_pagesPerSide(pagesPerSide), m_physicalPerSide(physicalPerSide), m_levelCount(0), m_frame(0), m_evictions(0)
+{
+	for (uint32_t side = m_pagesPerSide; side > 0; side /= 2)
+	{
+		m_pages.emplace_back(side * side);
+		m_entries.emplace_back(side * side, 0u);
+		m_levelChanged.push_back(true);
+		m_levelCount++;
+	}
+
+	//Hand out physical pages from the first
+	m_slots.resize(m_physicalPerSide * m_physicalPerSide);
+	for (uint32_t slot = static_cast<uint32_t>(m_slots.size()); slot > 0; slot--)
+		m_freeSlots.push_back(slot - 1);
+}
+
+void VirtualPageTable::setEntry(uint32_t level, uint32_t x, uint32_t y, uint32_t entry)
+{
+	m_entries[level][y * pagesPerSide(level) + x] = entry;
+	m_levelChanged[level] = true;
+}
+
+void VirtualPageTable::beginFrame()
+{
+	m_frame++;
+	m_requests.clear();
+	request(m_levelCount - 1, 0, 0);
+}
+
+void VirtualPageTable::request(uint32_t level, uint32_t x, uint32_t y)
+{
+	if (level >= m_levelCount || x >= pagesPerSide(level) || y >= pagesPerSide(level))
+		return;
+	Page& page = m_pages[level][y * pagesPerSide(level) + x];
+	if (page.lastRequested == m_frame)
+		return;
+	page.lastRequested = m_frame;
+	m_requests.push_back(level << 16 | y << 8 | x);
+}
+
+void VirtualPageTable::feedback(const uint32_t* texels, size_t count)
+{
+	//Neighbouring texels mostly ask for the same page, so skip runs of one value
+	uint32_t previous = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t texel = texels[i];
+		if (texel == previous || !(texel & FeedbackValid))
+			continue;
+		previous = texel;
+		request((texel >> 16) & 0xFF, texel & 0xFF, (texel >> 8) & 0xFF);
+	}
+}
+
+void VirtualPageTable::invalidate(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+	x1 = std::min(x1, m_pagesPerSide - 1);
+	y1 = std::min(y1, m_pagesPerSide - 1);
+	if (x0 > x1 || y0 > y1)
+		return;
+	for (uint32_t level = 0; level < m_levelCount; level++)
+	{
+		uint32_t side = pagesPerSide(level);
+		for (uint32_t y = y0 >> level; y <= y1 >> level; y++)
+		{
+			for (uint32_t x = x0 >> level; x <= x1 >> level; x++)
+			{
+				Page& page = m_pages[level][y * side + x];
+				if (page.physical >= 0)
+					page.dirty = true;
+			}
+		}
+	}
+}
+
+void VirtualPageTable::invalidateAll()
+{
+	for (std::vector<Page>& level : m_pages)
+	{
+		for (Page& page : level)
+			page.dirty = page.physical >= 0;
+	}
+}
+
+const std::vector<PageRender>& VirtualPageTable::update(uint32_t maxRenders)
+{
+	m_renders.clear();
+
+	//Coarse pages first, since finer ones fall back on them until they are rendered
+	std::sort(m_requests.begin(), m_requests.end(), std::greater<uint32_t>());
+	for (uint32_t key : m_requests)
+	{
+		if (m_renders.size() >= maxRenders)
+			break;
+		uint32_t level = key >> 16, x = key & 0xFF, y = (key >> 8) & 0xFF;
+		Page& page = m_pages[level][y * pagesPerSide(level) + x];
+		if (page.physical >= 0 && !page.dirty)
+			continue;
+
+		if (page.physical < 0)
+		{
+			if (m_freeSlots.empty())
+			{
+				//Evict the least recently requested page, but never one wanted this frame
+				int32_t victim = -1;
+				uint32_t oldest = m_frame;
+				for (uint32_t slot = 0; slot < m_slots.size(); slot++)
+				{
+					const Slot& used = m_slots[slot];
+					const Page& candidate = m_pages[used.level][used.y * pagesPerSide(used.level) + used.x];
+					if (candidate.lastRequested < oldest)
+					{
+						oldest = candidate.lastRequested;
+						victim = static_cast<int32_t>(slot);
+					}
+				}
+				if (victim < 0)
+					break;
+				Slot& evicted = m_slots[victim];
+				Page& old = m_pages[evicted.level][evicted.y * pagesPerSide(evicted.level) + evicted.x];
+				old.physical = -1;
+				old.dirty = false;
+				evicted.used = false;
+				setEntry(evicted.level, evicted.x, evicted.y, 0);
+				m_freeSlots.push_back(static_cast<uint32_t>(victim));
+				m_evictions++;
+			}
+			page.physical = static_cast<int32_t>(m_freeSlots.back());
+			m_freeSlots.pop_back();
+			m_slots[page.physical] = Slot{ level, x, y, true };
+		}
+
+		uint32_t physicalX = page.physical % m_physicalPerSide, physicalY = page.physical / m_physicalPerSide;
+		setEntry(level, x, y, ResidentBit | physicalY << 8 | physicalX);
+		page.dirty = false;
+		m_renders.push_back(PageRender{ level, x, y, physicalX, physicalY });
+	}
+	return m_renders;
+}
+
+void VirtualPageTable::clearChanged()
+{
+	std::fill(m_levelChanged.begin(), m_levelChanged.end(), false);
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief A page of a virtual shadow map to render into a physical page of the pool.
+ */
+struct PageRender {
+	uint32_t level;
+	uint32_t x, y;
+	uint32_t physicalX, physicalY;
+};
+
+/**
+ * @brief The CPU side of a virtual shadow map: which virtual pages are wanted, which physical page of the pool
+ * holds each, and which must be rendered. Uses no GL, so it can be driven by hand.
+ *
+ * The virtual map is a mip chain of square page grids, level 0 the finest with pagesPerSide pages per side and
+ * each level above half as many, down to a single page. Each frame the pages visible pixels need are requested,
+ * usually from feedback(), and update() gives any that are missing or invalidated a physical page, evicting the
+ * least recently requested ones when the pool is full, up to a budget of renders per frame. The coarsest level is
+ * always requested, so every point has a resident page to fall back on.
+ *
+ * Feedback texels encode a request as FeedbackValid | level << 16 | y << 8 | x, and 0 for no request.
+ */
+class VirtualPageTable {
+public:
+	static const uint32_t FeedbackValid = 1u << 24;
+	// Page table entries are ResidentBit | physicalY << 8 | physicalX, or 0 for pages without a physical page.
+	static const uint32_t ResidentBit = 1u << 16;
+
+private:
+	struct Page {
+		int32_t physical = -1;
+		uint32_t lastRequested = 0;
+		bool dirty = false;
+	};
+
+	struct Slot {
+		uint32_t level;
+		uint32_t x, y;
+		bool used = false;
+	};
+
+	uint32_t m_pagesPerSide;
+	uint32_t m_physicalPerSide;
+	uint32_t m_levelCount;
+	uint32_t m_frame;
+	std::vector<std::vector<Page>> m_pages;
+	std::vector<std::vector<uint32_t>> m_entries;
+	std::vector<bool> m_levelChanged;
+	std::vector<Slot> m_slots;
+	std::vector<uint32_t> m_freeSlots;
+	// Pages requested this frame, as level << 16 | y << 8 | x.
+	std::vector<uint32_t> m_requests;
+	std::vector<PageRender> m_renders;
+	uint32_t m_evictions;
+
+	void setEntry(uint32_t level, uint32_t x, uint32_t y, uint32_t entry);
+
+public:
+	/**
+	 * @brief A virtual map of pagesPerSide pages per side at level 0 backed by a pool of physicalPerSide pages per
+	 * side. Both at most 256.
+	 */
+	VirtualPageTable(uint32_t pagesPerSide, uint32_t physicalPerSide);
+
+	/**
+	 * @brief Starts a frame of requests.
+	 */
+	void beginFrame();
+
+	/**
+	 * @brief Requests a page for this frame. Pages outside the map are ignored.
+	 */
+	void request(uint32_t level, uint32_t x, uint32_t y);
+
+	/**
+	 * @brief Requests the pages named by feedback texels.
+	 */
+	void feedback(const uint32_t* texels, size_t count);
+
+	/**
+	 * @brief Marks the resident pages overlapping a rectangle of level 0 pages, inclusive, as needing rendering
+	 * again, along with the pages covering it on every other level.
+	 */
+	void invalidate(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+	void invalidateAll();
+
+	/**
+	 * @brief Allocates and queues for rendering up to maxRenders of this frame's requested pages that are missing
+	 * or invalidated, coarsest first. The rest wait for a later frame.
+	 */
+	const std::vector<PageRender>& update(uint32_t maxRenders);
+
+	// The page table of a level, one entry per page in rows, and whether it changed since the last clearChanged().
+	const std::vector<uint32_t>& entries(uint32_t level) const { return m_entries[level]; }
+	bool levelChanged(uint32_t level) const { return m_levelChanged[level]; }
+	void clearChanged();
+
+	uint32_t levelCount() const { return m_levelCount; }
+	uint32_t pagesPerSide(uint32_t level) const { return m_pagesPerSide >> level; }
+	uint32_t physicalPerSide() const { return m_physicalPerSide; }
+	// Physical pages in use, pages requested this frame, and pages evicted since creation.
+	uint32_t residentPages() const { return static_cast<uint32_t>(m_slots.size() - m_freeSlots.size()); }
+	uint32_t requestedPages() const { return static_cast<uint32_t>(m_requests.size()); }
+	uint32_t evictions() const { return m_evictions; }
+};
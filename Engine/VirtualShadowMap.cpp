@@ -0,0 +1,244 @@
+#include "VirtualShadowMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/ext.hpp>
+
+VirtualShadowMap::VirtualShadowMap(const AABB& world, uint32_t screenWidth, uint32_t screenHeight, const VirtualShadowSettings& settings)
+	: m_settings(settings), m_table(settings.pagesPerSide, settings.physicalPerSide), m_world(world), m_lightDirection(0.0f), m_lightSpace(1.0f), m_readbackFences(), m_readbackNext(0)
+{
+	//Physical pages, sampled through a comparison sampler like the other shadow maps
+	uint32_t poolSize = m_settings.pageSize * m_settings.physicalPerSide;
+	glGenTextures(1, &m_poolTexture);
+	glBindTexture(GL_TEXTURE_2D, m_poolTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, poolSize, poolSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenFramebuffers(1, &m_poolFbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_poolFbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_poolTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	//The page table, a mip level per virtual level, fetched texel by texel
+	glGenTextures(1, &m_pageTableTexture);
+	glBindTexture(GL_TEXTURE_2D, m_pageTableTexture);
+	for (uint32_t level = 0; level < m_table.levelCount(); level++)
+	{
+		uint32_t side = m_table.pagesPerSide(level);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_R32UI, side, side, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, m_table.entries(level).data());
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_table.levelCount() - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	m_table.clearChanged();
+
+	//Feedback: the page each pixel wants, with a depth buffer so only the nearest surface asks
+	m_feedbackWidth = std::max(screenWidth / m_settings.feedbackDivisor, 1u);
+	m_feedbackHeight = std::max(screenHeight / m_settings.feedbackDivisor, 1u);
+	glGenTextures(1, &m_feedbackTexture);
+	glBindTexture(GL_TEXTURE_2D, m_feedbackTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, m_feedbackWidth, m_feedbackHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glGenRenderbuffers(1, &m_feedbackDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_feedbackDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_feedbackWidth, m_feedbackHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &m_feedbackFbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_feedbackFbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_feedbackTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_feedbackDepth);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	//Pixel buffers the feedback is copied into without waiting, read once their fence has passed
+	glGenBuffers(ReadbackLatency, m_readbackBuffers);
+	for (uint32_t i = 0; i < ReadbackLatency; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, m_feedbackWidth * m_feedbackHeight * sizeof(uint32_t), NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+VirtualShadowMap::~VirtualShadowMap()
+{
+	for (GLsync fence : m_readbackFences)
+	{
+		if (fence != nullptr)
+			glDeleteSync(fence);
+	}
+	glDeleteBuffers(ReadbackLatency, m_readbackBuffers);
+	glDeleteFramebuffers(1, &m_feedbackFbo);
+	glDeleteRenderbuffers(1, &m_feedbackDepth);
+	glDeleteTextures(1, &m_feedbackTexture);
+	glDeleteTextures(1, &m_pageTableTexture);
+	glDeleteFramebuffers(1, &m_poolFbo);
+	glDeleteTextures(1, &m_poolTexture);
+}
+
+void VirtualShadowMap::beginFrame(const glm::vec3& lightDirection)
+{
+	//Cover the world's bounding sphere, as deep as it is wide, looking along the light
+	glm::vec3 direction = glm::normalize(lightDirection);
+	if (direction != m_lightDirection)
+	{
+		m_lightDirection = direction;
+		glm::vec3 center = m_world.center();
+		float radius = std::max(glm::length(m_world.extent()), 1.0f);
+		glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		m_lightSpace = glm::ortho(-radius, radius, -radius, radius, -radius, radius) * glm::lookAt(center, center + direction, up);
+		m_table.invalidateAll();
+	}
+
+	readFeedback();
+	m_table.beginFrame();
+	m_table.feedback(m_feedback.data(), m_feedback.size());
+}
+
+void VirtualShadowMap::readFeedback()
+{
+	GLsync& fence = m_readbackFences[m_readbackNext];
+	if (fence == nullptr)
+		return;
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+		return;
+	glDeleteSync(fence);
+	fence = nullptr;
+
+	m_feedback.resize(m_feedbackWidth * m_feedbackHeight);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackBuffers[m_readbackNext]);
+	if (void* texels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m_feedback.size() * sizeof(uint32_t), GL_MAP_READ_BIT))
+	{
+		std::memcpy(m_feedback.data(), texels, m_feedback.size() * sizeof(uint32_t));
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void VirtualShadowMap::invalidate(const AABB& box)
+{
+	if (box.empty())
+		return;
+
+	//Everything a box shadows lies behind it along the light, inside the same rectangle of the map
+	AABB lightBox = box.transformed(m_lightSpace);
+	float pages = static_cast<float>(m_settings.pagesPerSide);
+	glm::vec2 low = (glm::vec2(lightBox.min.x, lightBox.min.y) * 0.5f + 0.5f) * pages;
+	glm::vec2 high = (glm::vec2(lightBox.max.x, lightBox.max.y) * 0.5f + 0.5f) * pages;
+	if (high.x < 0.0f || high.y < 0.0f || low.x >= pages || low.y >= pages)
+		return;
+	low = glm::max(low, glm::vec2(0.0f));
+	m_table.invalidate(static_cast<uint32_t>(low.x), static_cast<uint32_t>(low.y), static_cast<uint32_t>(high.x), static_cast<uint32_t>(high.y));
+}
+
+uint32_t VirtualShadowMap::update()
+{
+	m_renders = m_table.update(m_settings.maxPageRenders);
+
+	//Cull the casters against the light space rectangle holding every page to render
+	if (!m_renders.empty())
+	{
+		glm::vec2 low(1.0f), high(-1.0f);
+		for (const PageRender& page : m_renders)
+		{
+			float size = 2.0f / m_table.pagesPerSide(page.level);
+			glm::vec2 corner(-1.0f + page.x * size, -1.0f + page.y * size);
+			low = glm::min(low, corner);
+			high = glm::max(high, corner + size);
+		}
+		glm::vec2 scale = 2.0f / (high - low);
+		glm::mat4 rect = glm::translate(glm::mat4(1.0f), glm::vec3(-1.0f - low.x * scale.x, -1.0f - low.y * scale.y, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(scale.x, scale.y, 1.0f));
+		m_casters = Frustum(rect * m_lightSpace);
+	}
+
+	//Upload the levels whose pages moved
+	glBindTexture(GL_TEXTURE_2D, m_pageTableTexture);
+	for (uint32_t level = 0; level < m_table.levelCount(); level++)
+	{
+		if (!m_table.levelChanged(level))
+			continue;
+		uint32_t side = m_table.pagesPerSide(level);
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, side, side, GL_RED_INTEGER, GL_UNSIGNED_INT, m_table.entries(level).data());
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	m_table.clearChanged();
+	return static_cast<uint32_t>(m_renders.size());
+}
+
+void VirtualShadowMap::bindPage(uint32_t page)
+{
+	const PageRender& render = m_renders[page];
+	uint32_t size = m_settings.pageSize;
+	glBindFramebuffer(GL_FRAMEBUFFER, m_poolFbo);
+	glViewport(render.physicalX * size, render.physicalY * size, size, size);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(render.physicalX * size, render.physicalY * size, size, size);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+}
+
+glm::mat4 VirtualShadowMap::pageSpace(uint32_t page) const
+{
+	//Stretch the page's rectangle of the whole map's clip space over [-1, 1], keeping depth as it is so every page
+	//stores depths comparable with the others
+	const PageRender& render = m_renders[page];
+	float pages = static_cast<float>(m_table.pagesPerSide(render.level));
+	float size = 2.0f / pages;
+	glm::vec2 corner(-1.0f + render.x * size, -1.0f + render.y * size);
+	glm::mat4 rect = glm::translate(glm::mat4(1.0f), glm::vec3(-1.0f - corner.x * pages, -1.0f - corner.y * pages, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(pages, pages, 1.0f));
+	return rect * m_lightSpace;
+}
+
+void VirtualShadowMap::setUniforms(Shader& shader) const
+{
+	shader.setUniform("vsmPageTable", PageTableUnit);
+	shader.setUniform("vsmPool", PoolUnit);
+	shader.setUniform("vsmLightSpace", m_lightSpace);
+	shader.setUniform("vsmPagesPerSide", static_cast<int32_t>(m_settings.pagesPerSide));
+	shader.setUniform("vsmLevelCount", static_cast<int32_t>(m_table.levelCount()));
+	shader.setUniform("vsmPhysicalPerSide", static_cast<int32_t>(m_settings.physicalPerSide));
+	shader.setUniform("vsmPageSize", static_cast<float>(m_settings.pageSize));
+}
+
+void VirtualShadowMap::beginFeedback(Shader& shader, const glm::mat4& viewProjection)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_feedbackFbo);
+	glViewport(0, 0, m_feedbackWidth, m_feedbackHeight);
+	const GLuint none[] = { 0, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, none);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	shader.setUniform("viewProjection", viewProjection);
+	shader.setUniform("lightSpaceMatrix", m_lightSpace);
+	shader.setUniform("virtualSize", static_cast<float>(m_settings.pagesPerSide * m_settings.pageSize));
+	shader.setUniform("feedbackScale", 1.0f / m_settings.feedbackDivisor);
+	shader.setUniform("pagesPerSide", static_cast<int32_t>(m_settings.pagesPerSide));
+	shader.setUniform("levelCount", static_cast<int32_t>(m_table.levelCount()));
+}
+
+void VirtualShadowMap::endFeedback()
+{
+	//Copy into the next pixel buffer, dropping whatever it held if that was never read
+	GLsync& fence = m_readbackFences[m_readbackNext];
+	if (fence != nullptr)
+		glDeleteSync(fence);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackBuffers[m_readbackNext]);
+	glReadPixels(0, 0, m_feedbackWidth, m_feedbackHeight, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_readbackNext = (m_readbackNext + 1) % ReadbackLatency;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "Bounds.h"
+#include "Frustum.h"
+#include "Shader.h"
+#include "VirtualPageTable.h"
+
+struct VirtualShadowSettings {
+	// Texels per side of a page, and pages per side of the finest level. 128 pages of 128 texels make a 16k map.
+	uint32_t pageSize = 128;
+	uint32_t pagesPerSide = 128;
+	// Pages per side of the physical pool. 16 pages of 128 texels make a 2048 texture.
+	uint32_t physicalPerSide = 16;
+	// Most pages rendered in a frame; the rest of the requests wait for the next frames.
+	uint32_t maxPageRenders = 16;
+	// Feedback is rendered at the screen size divided by this.
+	uint32_t feedbackDivisor = 8;
+};
+
+/**
+ * @brief Directional light shadows over the whole world as one very large virtual shadow map, of which only the
+ * pages visible pixels need are rendered, into a small pool of physical pages.
+ *
+ * A light space orthographic projection covers the world's bounding sphere, and is split into a mip chain of page
+ * grids. Each frame the camera's view is rendered at a low resolution into a feedback buffer holding, for every
+ * pixel, the page at the level matching its shadow texel density. The buffer is read back asynchronously a frame
+ * later, so rendering never waits on it, and its pages are requested from the VirtualPageTable. Rendered pages stay
+ * in the pool until invalidate() reports a change under them or they are evicted for newer requests, so a still
+ * scene renders nothing at all. Shaders look pages up through a page table texture with a mip level per level, and
+ * fall back to coarser resident pages where a fine one is missing.
+ *
+ * Each frame: beginFrame() with the light direction, invalidate() the old and new bounds of everything that moved,
+ * then update(). Render every caster within casters() into each page between bindPage() and the next, with
+ * pageSpace() as the light space matrix. setUniforms() on the shader sampling the map with its textures bound, and
+ * after the camera's pass render its draws between beginFeedback() and endFeedback() with a shader built from the
+ * vsmFeedback shaders.
+ */
+class VirtualShadowMap {
+public:
+	// Texture units the page table and the physical pages are bound to.
+	static const int32_t PageTableUnit = 4;
+	static const int32_t PoolUnit = 5;
+	// Fence and pixel buffer pairs cycled through by the feedback readback.
+	static const uint32_t ReadbackLatency = 2;
+
+private:
+	VirtualShadowSettings m_settings;
+	VirtualPageTable m_table;
+	AABB m_world;
+	glm::vec3 m_lightDirection;
+	glm::mat4 m_lightSpace;
+	Frustum m_casters;
+	std::vector<PageRender> m_renders;
+
+	uint32_t m_poolFbo;
+	uint32_t m_poolTexture;
+	uint32_t m_pageTableTexture;
+
+	uint32_t m_feedbackFbo;
+	uint32_t m_feedbackTexture;
+	uint32_t m_feedbackDepth;
+	uint32_t m_feedbackWidth, m_feedbackHeight;
+	uint32_t m_readbackBuffers[ReadbackLatency];
+	GLsync m_readbackFences[ReadbackLatency];
+	uint32_t m_readbackNext;
+	// The latest feedback read back, requested again every frame until newer feedback arrives.
+	std::vector<uint32_t> m_feedback;
+
+	// Reads back the oldest feedback if the GPU has finished writing it.
+	void readFeedback();
+
+public:
+	/**
+	 * @brief Covers the world box with the map, with feedback sized for a screen of the given size.
+	 */
+	VirtualShadowMap(const AABB& world, uint32_t screenWidth, uint32_t screenHeight, const VirtualShadowSettings& settings = VirtualShadowSettings());
+	VirtualShadowMap(const VirtualShadowMap&) = delete;
+	VirtualShadowMap& operator=(const VirtualShadowMap&) = delete;
+	~VirtualShadowMap();
+
+	/**
+	 * @brief Points the light along lightDirection, invalidating every page if it turned, and requests the pages
+	 * of the latest feedback.
+	 */
+	void beginFrame(const glm::vec3& lightDirection);
+
+	/**
+	 * @brief Marks the pages a box casts shadows or is shadowed in as needing rendering again.
+	 */
+	void invalidate(const AABB& box);
+	void invalidateAll() { m_table.invalidateAll(); }
+
+	/**
+	 * @brief Allocates the requested pages, picks which to render this frame and uploads the changed page tables.
+	 * Returns the number of pages to render.
+	 */
+	uint32_t update();
+
+	/**
+	 * @brief Binds the pool with the viewport on a page to render and clears it.
+	 */
+	void bindPage(uint32_t page);
+
+	/**
+	 * @brief The light space matrix drawing the virtual page into the viewport bindPage() set.
+	 */
+	glm::mat4 pageSpace(uint32_t page) const;
+
+	/**
+	 * @brief Sets the virtual map's uniforms on a shader sampling it, which reads the page table from
+	 * PageTableUnit and the physical pages from PoolUnit.
+	 */
+	void setUniforms(Shader& shader) const;
+
+	/**
+	 * @brief Binds the feedback buffer and clears it, setting the camera and feedback scale on the active feedback
+	 * shader. The camera's draws are then rendered with it.
+	 */
+	void beginFeedback(Shader& shader, const glm::mat4& viewProjection);
+
+	/**
+	 * @brief Starts reading back the feedback rendered since beginFeedback().
+	 */
+	void endFeedback();
+
+	// The region holding every caster of the pages rendered this frame.
+	const Frustum& casters() const { return m_casters; }
+	uint32_t pageTableTexture() const { return m_pageTableTexture; }
+	uint32_t poolTexture() const { return m_poolTexture; }
+	uint32_t pagesToRender() const { return static_cast<uint32_t>(m_renders.size()); }
+	const VirtualPageTable& pageTable() const { return m_table; }
+};
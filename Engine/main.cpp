@@ -3,10 +3,32 @@
 #include <SDL2/SDL_image.h>
 #include <iostream>
 
+#include "GLExtensions.h"
 #include "Shader.h"
 #include "Object3D.h"
+#include "SceneGraph.h"
+#include "EntityWorld.h"
+#include "Components.h"
+#include "Prefab.h"
+#include "DynamicBVH.h"
+#include "JobSystem.h"
 #include "Mesh3D.h"
 #include "AssimpImport.h"
+#include "RenderQueue.h"
+#include "OcclusionBuffer.h"
+#include "OcclusionQueries.h"
+#include "CascadedShadowMap.h"
+#include "ShadowAtlas.h"
+#include "PointShadowMap.h"
+#include "VirtualShadowMap.h"
+#include "ClusteredLights.h"
+#include "GBuffer.h"
+#include "ShadowFilter.h"
+#include "GpuTimer.h"
+#include "StaticBatcher.h"
+#include "StreamBuffer.h"
+#include "FrameStats.h"
+#include "Benchmarks.h"
 #include "Animator.h"
 #include "Skybox.h"
 //#include "Billboard.h"
@@ -31,14 +53,12 @@ glm::vec3 mound2pos = glm::vec3(9, -3.15, 1);
 glm::vec3 mound3pos = glm::vec3(-3, -3.15, 8);
 glm::vec3 mound4pos = glm::vec3(-7, -3.15, 0);
 glm::vec3 mound5pos = glm::vec3(6.5, -3.15, -6.5);
-std::vector<glm::vec3> moundPositions = { mound1pos, mound2pos, mound3pos, mound4pos, mound5pos };
 
-bool renderMound1 = true;
-bool renderMound2 = true;
-bool renderMound3 = true;
-bool renderMound4 = true;
-bool renderMound5 = true;
-std::vector<bool> moundBools = { renderMound1, renderMound2, renderMound3, renderMound4, renderMound5 };
+//Distance from which a mound can be dug up
+const float digRadius = 5.0f;
+
+//Set when a static object is removed, so the static batches get rebuilt
+bool staticSceneChanged = false;
 
 //Directional light
 glm::vec3 sun = glm::vec3(-8.0f, 6.0f, -1.0f);
@@ -46,8 +66,9 @@ glm::vec3 sun = glm::vec3(-8.0f, 6.0f, -1.0f);
 //Point light
 glm::vec3 fire = glm::vec3(3.85, -2.57, -1.91);
 
-//Set the resolution of the shadow map
-const uint32_t shadowWidth = 2048, shadowHeight = 2048;
+//Camera projection
+const float fieldOfView = glm::radians(45.0f);
+const float nearClip = 0.1f, farClip = 100.0f;
 
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
@@ -60,34 +81,6 @@ float pitch = 0.0f;
 
 SDL_Surface* windowIcon = IMG_Load("resources/skull_icon.png");
 
-void createShadowMap(uint32_t& fbo, uint32_t& id)
-{
-	//Create frame buffer object to represent shadow map
-	glGenFramebuffers(1, &fbo);
-
-	//Create a texture for the shadow map to be drawn to
-	glGenTextures(1, &id);
-	glBindTexture(GL_TEXTURE_2D, id);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, shadowWidth, shadowHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	
-	//Set texture wrapping for depth map to clamp to a white border so that any objects outside of the light's frustum will not be in shadow
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-	//Attach the shadow map to the frame buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, id, 0);
-
-	//Tell OpenGL not to render any color buffer and bind the frame buffer to 0
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
-
 void mouseCallback(SDL_Window* window, double x, double y, SDL_Event event)
 {
 	float sensitivity = 0.1f;
@@ -107,7 +100,7 @@ void mouseCallback(SDL_Window* window, double x, double y, SDL_Event event)
 	cameraFront = glm::normalize(direction);
 }
 
-void processInput(SDL_Window* window, SDL_Event event)
+void processInput(SDL_Window* window, SDL_Event event, EntityWorld& world, const DynamicBVH& staticIndex, const DynamicBVH& dynamicIndex)
 {
 	float cameraSpeed = 3.5f * deltaTime;
 	if (event.type == SDL_KEYDOWN)
@@ -122,16 +115,29 @@ void processInput(SDL_Window* window, SDL_Event event)
 			cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
 		if (event.key.keysym.sym == 101) //E for interacting with mounds
 		{
-			int i = 0;
-			for (auto mound : moundPositions)
-			{
-				float distance = glm::length(cameraPos - mound);
-				if (distance <= 5)
+			//Dig up any visible mound in reach, starting the animation of the treasure under it. Only entities whose
+			//bounds are within reach of the camera are found by the spatial index and checked
+			BoundingSphere reach;
+			reach.center = cameraPos;
+			reach.radius = digRadius;
+			auto dig = [&](uint32_t index) {
+				Entity entity = world.entityAt(index);
+				TransformComponent* transform = world.get<TransformComponent>(entity);
+				InteractableComponent* interactable = world.get<InteractableComponent>(entity);
+				VisibilityComponent* visibility = world.get<VisibilityComponent>(entity);
+				if (!transform || !interactable || !visibility || !visibility->visible)
+					return;
+				float distance = glm::length(cameraPos - TransformSystem::shared().position(transform->handle));
+				if (distance <= interactable->radius)
 				{
-					moundBools[i] = false;
+					visibility->visible = false;
+					staticSceneChanged = true;
+					if (AnimatorComponent* animator = world.get<AnimatorComponent>(interactable->reveals))
+						animator->playing = true;
 				}
-				i++;
-			}
+			};
+			staticIndex.query(reach, dig);
+			dynamicIndex.query(reach, dig);
 		}
 	}
 	if (event.type == SDL_MOUSEMOTION)
@@ -142,6 +148,50 @@ void processInput(SDL_Window* window, SDL_Event event)
 	}
 }
 
+//Moves an object into the scene graph and creates its entity, with the components every drawn object has
+Entity spawn(EntityWorld& world, SceneGraph& sceneGraph, Object3D&& object)
+{
+	TransformComponent transform{ object.getTransform() };
+	bool isStatic = object.isStatic();
+	SceneHandle node = sceneGraph.add(std::move(object));
+	return world.create(transform, MeshRefComponent{ node, isStatic }, VisibilityComponent{ true }, SpatialComponent{});
+}
+
+//Creates the entity for a prefab instance
+Entity spawn(EntityWorld& world, PrefabInstance&& instance, bool isStatic)
+{
+	TransformComponent transform{ instance.getTransform() };
+	return world.create(transform, PrefabComponent{ std::move(instance), isStatic }, VisibilityComponent{ true }, SpatialComponent{});
+}
+
+//Keeps each entity's leaf in the spatial index around its current world bounds. Static and dynamic entities are
+//indexed apart, as only dynamic ones are culled through the index. The bounds of every entity that moved, from
+//before and after the move, are added to moved
+void updateSpatialIndex(EntityWorld& world, const SceneGraph& sceneGraph, DynamicBVH& staticIndex, DynamicBVH& dynamicIndex, std::vector<AABB>& moved)
+{
+	auto place = [&](DynamicBVH& index, Entity entity, SpatialComponent& spatial, const AABB& bounds) {
+		if (bounds.empty())
+			return;
+		if (spatial.proxy == DynamicBVH::Null)
+			spatial.proxy = index.insert(bounds, entity.index);
+		else if (bounds.min != spatial.bounds.min || bounds.max != spatial.bounds.max)
+		{
+			index.update(spatial.proxy, bounds);
+			moved.push_back(spatial.bounds);
+		}
+		else
+			return;
+		moved.push_back(bounds);
+		spatial.bounds = bounds;
+	};
+	world.each<MeshRefComponent, SpatialComponent>([&](Entity entity, MeshRefComponent& mesh, SpatialComponent& spatial) {
+		place(mesh.isStatic ? staticIndex : dynamicIndex, entity, spatial, sceneGraph.bounds(mesh.node));
+	});
+	world.each<PrefabComponent, SpatialComponent>([&](Entity entity, PrefabComponent& prefab, SpatialComponent& spatial) {
+		place(prefab.isStatic ? staticIndex : dynamicIndex, entity, spatial, prefab.instance.worldBounds());
+	});
+}
+
 void init()
 {
 	//Initialize SDL2 library and set OpenGL version 3.30
@@ -162,6 +212,55 @@ void init()
 
 int main(int argc, char* argv[])
 {
+	bool benchmarkShadowFilters = false;
+	bool virtualShadows = false;
+	float shadowScale = 1.0f;
+	uint32_t torchCount = 0;
+	bool deferredShading = false;
+	bool depthPrepass = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--benchmark-transforms")
+		{
+			benchmarkTransforms();
+			return 0;
+		}
+		if (std::string(argv[i]) == "--benchmark-entities")
+		{
+			benchmarkEntities();
+			return 0;
+		}
+		if (std::string(argv[i]) == "--benchmark-occlusion")
+		{
+			benchmarkOcclusion();
+			return 0;
+		}
+		if (std::string(argv[i]) == "--test-occlusion")
+			return testOcclusion() ? 0 : 1;
+		if (std::string(argv[i]) == "--test-virtual-pages")
+			return testVirtualPages() ? 0 : 1;
+		if (std::string(argv[i]) == "--test-clusters")
+			return testClusters() ? 0 : 1;
+		//Runs the scene, timing the shaded pass with each shadow filter in turn
+		if (std::string(argv[i]) == "--benchmark-shadow-filters")
+			benchmarkShadowFilters = true;
+		//Shadows the sun with a virtual shadow map over the whole island instead of the cascades
+		if (std::string(argv[i]) == "--virtual-shadows")
+			virtualShadows = true;
+		//Scales the shadow texels wanted per pixel, such as 0.5 for slower machines
+		if (std::string(argv[i]) == "--shadow-scale" && i + 1 < argc)
+			shadowScale = std::max(std::stof(argv[++i]), 0.0f);
+		//Scatters the given number of torches over the island, lit through the light clusters
+		if (std::string(argv[i]) == "--torches" && i + 1 < argc)
+			torchCount = static_cast<uint32_t>(std::max(std::stoi(argv[++i]), 0));
+		//Shades through a G-buffer, lighting each pixel once, instead of shading every fragment drawn
+		if (std::string(argv[i]) == "--deferred")
+			deferredShading = true;
+		//Lays down the depth of the draws worth it before shading, so hidden surfaces of theirs are never shaded
+		if (std::string(argv[i]) == "--depth-prepass")
+			depthPrepass = true;
+	}
+
 	init();
 	//Set width and height of the window and create a window. The window is given a OpenGL flag for rendering with OpenGL context
 	SDL_Window* window = SDL_CreateWindow("Pirate Island", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_OPENGL);
@@ -176,6 +275,7 @@ int main(int argc, char* argv[])
 	{
 		std::cout << "Failed to initialize GLAD" << std::endl;
 	}
+	loadGLExtensions();
 
 	//Set up window coordinates for rendering
 	glViewport(0, 0, width, height);
@@ -205,28 +305,33 @@ int main(int argc, char* argv[])
 	auto island = assimpLoad("resources/island/island.obj", true, false, false);
 	island.setMaterial(glm::vec4(0.3, 0.8, 0.1, 1));
 	island.move(glm::vec3(0, -3, 0));
+	island.setStatic(true);
 
 	auto fish = assimpLoad("resources/fish/12265_Fish_v1_L2.obj", true, false, false);
 	fish.setMaterial(glm::vec4(0.3, 0.8, 0.1, 1));
 	fish.move(glm::vec3(-2, -4, -7));
 	fish.grow(glm::vec3(0.0125));
+	fish.setShadowProxyError(0.03f);
 
 	auto wine = assimpLoad("resources/wine/14042_750_mL_Wine_Bottle_r_v1_L3.obj", true, false, false);
 	wine.setMaterial(glm::vec4(0.3, 0.8, 0.1, 1));
 	wine.move(glm::vec3(9, -4, 1));
 	wine.grow(glm::vec3(0.025));
+	wine.setShadowProxyError(0.03f);
 
 	auto slr = assimpLoad("resources/slrCamera/10124_SLR_Camera_SG_V1_Iteration2.obj", true, false, false);
 	slr.setMaterial(glm::vec4(0.3, 0.8, 0.1, 1));
 	slr.move(glm::vec3(-3, -4, 8));
 	slr.grow(glm::vec3(0.003));
 	slr.rotate(glm::vec3(-1.57, 0, 0));
+	slr.setShadowProxyError(0.03f);
 
 	auto skull = assimpLoad("resources/skull/12140_Skull_v3_L2.obj", true, false, false);
 	skull.setMaterial(glm::vec4(0.3, 0.8, 0.1, 1));
 	skull.move(glm::vec3(-7, -4, 0));
 	skull.grow(glm::vec3(0.0125));
 	skull.rotate(glm::vec3(-90, 0, 0));
+	skull.setShadowProxyError(0.03f);
 
 	auto goldenBunny = assimpLoad("resources/bunny/bunny_textured.obj", true, false, false);
 	goldenBunny.setMaterial(glm::vec4(0.3, 1.0, 1.0, 32));
@@ -234,55 +339,114 @@ int main(int argc, char* argv[])
 	goldenBunny.cycleTex();
 	goldenBunny.move(glm::vec3(6.5, -4, -6.5));
 	goldenBunny.grow(glm::vec3(3));
+	goldenBunny.setShadowProxyError(0.03f);
+
+	//Every mound is a placement of one shared prefab, loaded once
+	auto moundPrefab = Prefab::load("resources/mound/mound.obj", true, false, false);
+	std::vector<PrefabInstance> mounds;
+	for (auto& position : { mound1pos, mound2pos, mound3pos, mound4pos, mound5pos })
+	{
+		PrefabInstance mound(moundPrefab);
+		mound.setMaterial(glm::vec4(0.3, 0.8, 0.1, 1));
+		TransformSystem::shared().setPosition(mound.getTransform(), position);
+		mounds.push_back(std::move(mound));
+	}
 
-	auto mound1 = assimpLoad("resources/mound/mound.obj", true, false, false);
-	mound1.setMaterial(glm::vec4(0.3, 0.8, 0.1, 1));
-	mound1.move(mound1pos);
-
-	auto mound2 = assimpLoad("resources/mound/mound.obj", true, false, false);
-	mound2.setMaterial(glm::vec4(0.3, 0.8, 0.1, 1));
-	mound2.move(mound2pos);
-
-	auto mound3 = assimpLoad("resources/mound/mound.obj", true, false, false);
-	mound3.setMaterial(glm::vec4(0.3, 0.8, 0.1, 1));
-	mound3.move(mound3pos);
-
-	auto mound4 = assimpLoad("resources/mound/mound.obj", true, false, false);
-	mound4.setMaterial(glm::vec4(0.3, 0.8, 0.1, 1));
-	mound4.move(mound4pos);
-
-	auto mound5 = assimpLoad("resources/mound/mound.obj", true, false, false);
-	mound5.setMaterial(glm::vec4(0.3, 0.8, 0.1, 1));
-	mound5.move(mound5pos);
-
-	std::vector<Object3D> scene;
-	scene.push_back(island);
-	scene.push_back(std::move(fish));
-	scene.push_back(std::move(wine));
-	scene.push_back(std::move(slr));
-	scene.push_back(std::move(skull));
-	scene.push_back(std::move(goldenBunny));
-	scene.push_back(mound1);
-	scene.push_back(mound2);
-	scene.push_back(mound3);
-	scene.push_back(mound4);
-	scene.push_back(mound5);
-
-	//Create the shadow map
-	uint32_t shadowMapFBO, shadowMapID;
-	createShadowMap(shadowMapFBO, shadowMapID);
-
-	Shader defaultShader;
-	defaultShader.load("Shaders/default.vert", "Shaders/default.frag");
+	//The scene graph owns every object; entities tie each one to its material, visibility, animation and interaction
+	SceneGraph sceneGraph;
+	EntityWorld world;
+
+	//Spatial indices over the entities' world bounds, for culling and for finding what is in reach
+	DynamicBVH staticIndex, dynamicIndex;
+
+	Entity islandEntity = spawn(world, sceneGraph, std::move(island));
+	world.add(islandEntity, OccluderComponent{});
+	Entity fishEntity = spawn(world, sceneGraph, std::move(fish));
+	Entity wineEntity = spawn(world, sceneGraph, std::move(wine));
+	Entity slrEntity = spawn(world, sceneGraph, std::move(slr));
+	Entity skullEntity = spawn(world, sceneGraph, std::move(skull));
+	Entity goldenBunnyEntity = spawn(world, sceneGraph, std::move(goldenBunny));
+
+	//Each mound hides one treasure
+	world.add(spawn(world, std::move(mounds[0]), true), InteractableComponent{ digRadius, fishEntity });
+	world.add(spawn(world, std::move(mounds[1]), true), InteractableComponent{ digRadius, wineEntity });
+	world.add(spawn(world, std::move(mounds[2]), true), InteractableComponent{ digRadius, slrEntity });
+	world.add(spawn(world, std::move(mounds[3]), true), InteractableComponent{ digRadius, skullEntity });
+	world.add(spawn(world, std::move(mounds[4]), true), InteractableComponent{ digRadius, goldenBunnyEntity });
+
+	//Create the cascaded shadow map of the directional light. Static casters are drawn into its cache through their
+	//own views, after the cascades' views for the dynamic casters
+	CascadeSettings cascadeSettings;
+	cascadeSettings.resolutionScale = shadowScale;
+	CascadedShadowMap shadowMap(cascadeSettings);
+	const uint32_t staticShadowView = RenderQueue::ShadowView + CascadedShadowMap::MaxCascades;
+	const uint32_t staticShadowViews = ((1u << CascadedShadowMap::MaxCascades) - 1) << staticShadowView;
+
+	//Shadows of the local lights share one atlas. The fire's reach as far as its light does, and its casters are
+	//only drawn through their view while some of its faces need rendering again
+	ShadowAtlas shadowAtlas;
+	PointShadowMap fireShadow(shadowAtlas);
+	const float fireRadius = PointShadowMap::radiusFor(0.7f, 1.8f);
+	const uint32_t pointShadowView = staticShadowView + CascadedShadowMap::MaxCascades;
+	std::vector<AABB> movedBounds;
+
+	//The virtual shadow map replaces the cascades when enabled. It is created once the spatial indices know how large
+	//the world is, and its casters are only drawn through their view while some of its pages need rendering
+	std::unique_ptr<VirtualShadowMap> virtualShadowMap;
+	const uint32_t virtualShadowView = pointShadowView + 1;
+	const uint32_t cascadeViews = ((1u << CascadedShadowMap::MaxCascades) - 1) << RenderQueue::ShadowView;
+	const uint32_t cachedShadowViews = staticShadowViews | (1u << pointShadowView) | (1u << virtualShadowView);
+	const uint32_t unusedShadowViews = virtualShadows ? cascadeViews : 0;
+
+	//Build the shaded pass's shader with the default shadow filter, or with every filter when benchmarking them.
+	//With deferred shading it is the lighting pass over the screen instead, and the scene fills the G-buffer
+	std::vector<ShadowFilter> shadowFilters = { ShadowFilter{ ShadowKernel::Grid, 9 } };
+	if (benchmarkShadowFilters)
+	{
+		shadowFilters = {
+			ShadowFilter{ ShadowKernel::Grid, 5 }, ShadowFilter{ ShadowKernel::Grid, 9 }, ShadowFilter{ ShadowKernel::Grid, 16 },
+			ShadowFilter{ ShadowKernel::Poisson, 16 }, ShadowFilter{ ShadowKernel::Vogel, 8 }, ShadowFilter{ ShadowKernel::Vogel, 16 }
+		};
+	}
+	std::vector<Shader> shadedShaders(shadowFilters.size());
+	for (size_t i = 0; i < shadowFilters.size(); i++)
+	{
+		shadowFilters[i].apply(shadedShaders[i]);
+		if (virtualShadows)
+			shadedShaders[i].addDefine("VIRTUAL_SHADOWS");
+		if (deferredShading)
+			shadedShaders[i].addDefine("DEFERRED");
+		shadedShaders[i].load(deferredShading ? "Shaders/deferred.vert" : "Shaders/default.vert", "Shaders/default.frag");
+		shadedShaders[i].activate();
+		shadedShaders[i].setUniform("ourTexture", 0);
+		shadedShaders[i].setUniform("shadowMap", 1);
+		shadedShaders[i].setUniform("shadowAtlas", 3);
+	}
+	Shader defaultShader = shadedShaders[0];
 	defaultShader.activate();
-	defaultShader.setUniform("ourTexture", 0);
-	defaultShader.setUniform("shadowMap", 1);
+
+	Shader gBufferShader;
+	if (deferredShading)
+	{
+		gBufferShader.load("Shaders/default.vert", "Shaders/gbuffer.frag");
+		gBufferShader.activate();
+		gBufferShader.setUniform("ourTexture", 0);
+		gBufferShader.disable();
+		defaultShader.activate();
+	}
 
 	Shader skyboxShader;
 	skyboxShader.load("Shaders/skybox.vert", "Shaders/skybox.frag");
 
 	Shader simpleDepthShader;
 	simpleDepthShader.load("Shaders/depthShader.vert", "Shaders/depthShader.frag");
+
+	Shader pointShadowShader;
+	pointShadowShader.load("Shaders/pointShadow.vert", "Shaders/pointShadow.geom", "Shaders/pointShadow.frag");
+
+	Shader virtualFeedbackShader;
+	if (virtualShadows)
+		virtualFeedbackShader.load("Shaders/vsmFeedback.vert", "Shaders/vsmFeedback.frag");
 	
 	//Get the size of the window for setting the perspective matrix
 	int* wide = &width;
@@ -291,44 +455,38 @@ int main(int argc, char* argv[])
 
 	//Set up view and projection matrices for vertex shader
 	glm::mat4 camera = glm::lookAt(cameraPos, cameraFront, cameraUp);
-	glm::mat4 perspective = glm::perspective(glm::radians(45.0), static_cast<double>(*wide) / *tall, 0.1, 100.0);
+	float aspect = static_cast<float>(*wide) / *tall;
+	glm::mat4 perspective = glm::perspective(fieldOfView, aspect, nearClip, farClip);
 	defaultShader.setUniform("view", camera);
-	defaultShader.setUniform("projection", perspective);
+	defaultShader.setUniform("viewProjection", perspective * camera);
 	defaultShader.setUniform("viewPos", cameraPos);
 	//Skybox shader
 	skyboxShader.setUniform("view", camera);
 	skyboxShader.setUniform("projection", perspective);
 
+	//The G-buffer covers the window, one pixel per pixel of the lighting pass
+	std::unique_ptr<GBuffer> gBuffer;
+	if (deferredShading)
+		gBuffer = std::make_unique<GBuffer>(width, height);
+
 	//Set directional light
 	defaultShader.setUniform("dirLight.direction", -sun);
 
-	//Set point light
-	defaultShader.setUniform("pointLights[0].position", fire);
-	defaultShader.setUniform("pointLights[0].linear", 0.7f);
-	defaultShader.setUniform("pointLights[0].quadratic", 1.8f);
-
-	//Model directional light source with parallel light rays
-	glm::mat4 lightProj, lightView, lightSpace;
-	float nearPlane = 1.0f, farPlane = 20.0f;
-	lightProj = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, nearPlane, farPlane);
-	lightView = glm::lookAt(sun, origin, glm::vec3(0.0f, 1.0f, 0.0f));
-	lightSpace = lightProj * lightView;
-
 	Animator fishAnimator;
-	fishAnimator.addAnimation(std::make_unique<TranslationAnimation>(scene[1], 1.5, glm::vec3(0, 2, 0)));
+	fishAnimator.addAnimation(std::make_unique<TranslationAnimation>(sceneGraph, world.get<MeshRefComponent>(fishEntity)->node, 1.5, glm::vec3(0, 2, 0)));
 	
 	Animator wineAnimator;
-	wineAnimator.addAnimation(std::make_unique<TranslationAnimation>(scene[2], 1.5, glm::vec3(0, 2, 0)));
+	wineAnimator.addAnimation(std::make_unique<TranslationAnimation>(sceneGraph, world.get<MeshRefComponent>(wineEntity)->node, 1.5, glm::vec3(0, 2, 0)));
 
 	Animator slrAnimator;
-	slrAnimator.addAnimation(std::make_unique<TranslationAnimation>(scene[3], 1.5, glm::vec3(0, 2, 0)));
+	slrAnimator.addAnimation(std::make_unique<TranslationAnimation>(sceneGraph, world.get<MeshRefComponent>(slrEntity)->node, 1.5, glm::vec3(0, 2, 0)));
 
 	Animator skullAnimator;
-	skullAnimator.addAnimation(std::make_unique<TranslationAnimation>(scene[4], 1.5, glm::vec3(0, 2, 0)));
+	skullAnimator.addAnimation(std::make_unique<TranslationAnimation>(sceneGraph, world.get<MeshRefComponent>(skullEntity)->node, 1.5, glm::vec3(0, 2, 0)));
 
 	Animator goldenBunnyAnimator;
-	goldenBunnyAnimator.addAnimation(std::make_unique<TRAnimation>(scene[5], 1.5, glm::vec3(0, 2, 0), glm::vec3(0, 6.28, 0)));
-	goldenBunnyAnimator.addAnimation(std::make_unique<RotationAnimation>(scene[5], 3.5, glm::vec3(0, 12.56, 0)));
+	goldenBunnyAnimator.addAnimation(std::make_unique<TRAnimation>(sceneGraph, world.get<MeshRefComponent>(goldenBunnyEntity)->node, 1.5, glm::vec3(0, 2, 0), glm::vec3(0, 6.28, 0)));
+	goldenBunnyAnimator.addAnimation(std::make_unique<RotationAnimation>(sceneGraph, world.get<MeshRefComponent>(goldenBunnyEntity)->node, 3.5, glm::vec3(0, 12.56, 0)));
 
 	fishAnimator.start();
 	wineAnimator.start();
@@ -336,12 +494,62 @@ int main(int argc, char* argv[])
 	skullAnimator.start();
 	goldenBunnyAnimator.start();
 
-	std::vector<Animator> animators;
-	animators.push_back(std::move(fishAnimator));
-	animators.push_back(std::move(wineAnimator));
-	animators.push_back(std::move(slrAnimator));
-	animators.push_back(std::move(skullAnimator));
-	animators.push_back(std::move(goldenBunnyAnimator));
+	//The animators only play once the treasure has been dug up
+	world.add(fishEntity, AnimatorComponent{ std::move(fishAnimator), false });
+	world.add(wineEntity, AnimatorComponent{ std::move(wineAnimator), false });
+	world.add(slrEntity, AnimatorComponent{ std::move(slrAnimator), false });
+	world.add(skullEntity, AnimatorComponent{ std::move(skullAnimator), false });
+	world.add(goldenBunnyEntity, AnimatorComponent{ std::move(goldenBunnyAnimator), false });
+
+	//Per-frame data (per-draw matrices and materials, draw commands) is streamed through a triple-buffered ring
+	StreamBuffer streamBuffer(1 << 20);
+
+	//Every visible mesh is queued once per frame and drawn by both the shadow and main passes
+	RenderQueue renderQueue(streamBuffer);
+
+	//Point lights are shaded per cluster of the view, each fragment only with the lights reaching its cluster. The
+	//fire casts the only point light shadows; any torches spiral out from the middle of the island
+	ClusteredLights clusteredLights(streamBuffer);
+	clusteredLights.setProjection(fieldOfView, aspect, nearClip, farClip, JobSystem::shared());
+	std::vector<PointLightSource> pointLights;
+	pointLights.push_back(PointLightSource{ fire, 0.7f, 1.8f, fireRadius, 0 });
+	for (uint32_t i = 0; i < torchCount; i++)
+	{
+		float distance = 3.0f + 11.0f * std::sqrt((i + 0.5f) / torchCount);
+		float angle = i * 2.3999632f;
+		glm::vec3 position(distance * std::cos(angle), -2.6f, distance * std::sin(angle));
+		pointLights.push_back(PointLightSource{ position, 1.4f, 3.6f, PointShadowMap::radiusFor(1.4f, 3.6f), -1 });
+	}
+
+	//The island hides much of the scene; what is behind it is culled on the CPU before it reaches the GPU
+	OcclusionBuffer occlusion;
+	std::vector<const Object3D*> occluderObjects;
+	// Bounds of the draws the camera kept last frame, which the cascades are sized by along with the occluders.
+	std::vector<AABB> cameraDrawBounds;
+
+	//The treasures are the most detailed objects, and mostly hidden underground or behind the island
+	OcclusionQueries occlusionQueries;
+	for (Entity entity : { fishEntity, wineEntity, slrEntity, skullEntity, goldenBunnyEntity })
+		world.add(entity, OcclusionQueryComponent{});
+
+	//Merge the island and the mounds that have not been dug up into world-space batches
+	StaticBatcher staticBatcher;
+	staticSceneChanged = true;
+
+	//Frame counters, shown in the window title once a second
+	FrameStats stats;
+	float statsTimer = 0.0f;
+	GpuTimer shadedTimer;
+	GpuTimer lightingTimer;
+
+	//Each shadow filter being benchmarked is shown for a number of frames, the first few only letting the timings
+	//catch up with the switch
+	const uint32_t benchmarkWarmupFrames = 30, benchmarkFrames = 300;
+	size_t benchmarkFilter = 0;
+	uint32_t benchmarkFrame = 0;
+	double benchmarkGpuMs = 0.0, benchmarkFrameMs = 0.0;
+	if (benchmarkShadowFilters)
+		std::cout << "Shadow filters, shaded pass GPU time and frame time at " << width << "x" << height << (deferredShading ? ", deferred" : "") << std::endl;
 
 	//main loop runs until window is closed
 	bool destroyed = false;
@@ -358,7 +566,7 @@ int main(int argc, char* argv[])
 			{
 				destroyed = true;
 			}
-			processInput(window, event);
+			processInput(window, event, world, staticIndex, dynamicIndex);
 		}
 		camera = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
 		defaultShader.setUniform("view", camera);
@@ -367,64 +575,351 @@ int main(int argc, char* argv[])
 		//Clear the depth buffer bit
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		//Render the scene to a depth map
-		glViewport(0, 0, shadowWidth, shadowHeight);
-		glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-		glClear(GL_DEPTH_BUFFER_BIT);
+		streamBuffer.beginFrame();
+		stats = FrameStats();
+
+		//Each animator only moves its own object, so they can tick in parallel
+		world.parallelEach<AnimatorComponent>(JobSystem::shared(), [&](Entity, AnimatorComponent& animator) {
+			if (animator.playing)
+				animator.animator.tick(deltaTime);
+		});
+
+		//Recompute the matrices of whatever the animations moved, once for both passes
+		TransformSystem::shared().update();
+		stats.matricesRebuilt = TransformSystem::shared().matricesRebuilt();
+		sceneGraph.updateBounds();
+		TransformSystem::shared().clearChanged();
+		movedBounds.clear();
+		updateSpatialIndex(world, sceneGraph, staticIndex, dynamicIndex, movedBounds);
+
+		//Only the faces of the fire's shadows something moved through are rendered again
+		fireShadow.setLight(fire, fireRadius);
+		fireShadow.setResolution(fireShadow.resolutionFor(cameraPos, fieldOfView, static_cast<uint32_t>(height * shadowScale), 64, 512));
+		for (const AABB& bounds : movedBounds)
+			fireShadow.invalidate(bounds);
+
+		//Cover everything in the world, with room for the treasures to rise out of the ground. Pages under whatever
+		//moved are rendered again once something asks for them
+		if (virtualShadows && !virtualShadowMap)
+		{
+			AABB world = staticIndex.bounds();
+			world.expand(dynamicIndex.bounds());
+			virtualShadowMap = std::make_unique<VirtualShadowMap>(AABB(world.min - glm::vec3(4.0f), world.max + glm::vec3(4.0f)), width, height);
+		}
+		if (virtualShadowMap)
+		{
+			virtualShadowMap->beginFrame(origin - sun);
+			for (const AABB& bounds : movedBounds)
+				virtualShadowMap->invalidate(bounds);
+		}
+
+		//Rebuild the static batches if a static object was added or removed
+		if (staticSceneChanged)
+		{
+			std::vector<const Object3D*> staticObjects;
+			world.each<MeshRefComponent, VisibilityComponent>([&](Entity, MeshRefComponent& mesh, VisibilityComponent& visibility) {
+				if (mesh.isStatic && visibility.visible)
+					sceneGraph.collect(mesh.node, staticObjects);
+			});
+			std::vector<const PrefabInstance*> staticInstances;
+			world.each<PrefabComponent, VisibilityComponent>([&](Entity, PrefabComponent& prefab, VisibilityComponent& visibility) {
+				if (prefab.isStatic && visibility.visible)
+					staticInstances.push_back(&prefab.instance);
+			});
+			staticBatcher.build(staticObjects, staticInstances);
+			shadowMap.invalidateStatic();
+			fireShadow.invalidateAll();
+			if (virtualShadowMap)
+				virtualShadowMap->invalidateAll();
+			staticSceneChanged = false;
+		}
+
+		//Queue the scene objects that are still visible; static ones are drawn through their batches
+		renderQueue.clear();
+		Frustum cameraFrustum(perspective * camera);
+		renderQueue.setFrustum(RenderQueue::CameraView, cameraFrustum);
+
+		//Rasterize the occluders' meshes and cull the camera's draws they hide
+		occlusion.begin(perspective * camera);
+		world.each<MeshRefComponent, OccluderComponent, VisibilityComponent>([&](Entity, MeshRefComponent& mesh, OccluderComponent&, VisibilityComponent& visibility) {
+			if (!visibility.visible)
+				return;
+			occluderObjects.clear();
+			sceneGraph.collect(mesh.node, occluderObjects);
+			for (const Object3D* object : occluderObjects)
+				occlusion.addOccluder(object->getMesh(), object->getWorldMatrix());
+		});
+		occlusion.rasterize(JobSystem::shared());
+		renderQueue.setOcclusion(RenderQueue::CameraView, &occlusion);
+		stats.occluderTriangles = occlusion.triangleCount();
+
+		//Fit the shadow cascades to the camera, each sized for the nearest thing in its slice the occlusion buffer
+		//shows or the camera drew last frame. Only dynamic objects inside a cascade's volume whose shadows can fall
+		//somewhere the camera sees of its slice are that cascade's shadow casters. Static objects are only drawn
+		//into the cascades whose cached static shadows need rendering again, with the whole cascade's volume
+		shadowMap.update(camera, fieldOfView, aspect, nearClip, farClip, origin - sun, height, &occlusion, &cameraDrawBounds);
+		uint32_t staleShadowViews = 0;
+		for (uint32_t c = 0; c < shadowMap.cascadeCount() && !virtualShadows; c++)
+		{
+			renderQueue.setFrustum(RenderQueue::ShadowView + c, shadowMap.casters(c));
+			if (shadowMap.staticStale(c))
+			{
+				renderQueue.setFrustum(staticShadowView + c, shadowMap.volume(c));
+				staleShadowViews |= 1u << (staticShadowView + c);
+			}
+		}
+		if (fireShadow.staleFaces())
+		{
+			renderQueue.setFrustum(pointShadowView, fireShadow.bounds());
+			staleShadowViews |= 1u << pointShadowView;
+		}
+		if (virtualShadowMap && virtualShadowMap->update())
+		{
+			renderQueue.setFrustum(virtualShadowView, virtualShadowMap->casters());
+			staleShadowViews |= 1u << virtualShadowView;
+		}
+		staticBatcher.enqueue(renderQueue, (1u << RenderQueue::CameraView) | staleShadowViews);
+
+		occlusionQueries.beginFrame();
+
+		//Cull the dynamic entities through the spatial index, testing every culled view in one walk. Views without
+		//a frustum see everything, so while there are any the walk visits every entity
+		uint32_t culledViews = renderQueue.culledViews() & ~staticShadowViews;
+		uint32_t openViews = RenderQueue::AllViews & ~renderQueue.culledViews() & ~cachedShadowViews & ~unusedShadowViews;
+		dynamicIndex.cull(renderQueue.frusta(), culledViews, openViews != 0,
+			[&](uint32_t index, uint32_t views) {
+				Entity entity = world.entityAt(index);
+				VisibilityComponent* visibility = world.get<VisibilityComponent>(entity);
+				if (visibility && !visibility->visible)
+					return;
+				renderQueue.reportCulled(culledViews & ~views, 1);
+				views |= openViews;
+				size_t first = renderQueue.size();
+				if (MeshRefComponent* mesh = world.get<MeshRefComponent>(entity))
+					sceneGraph.enqueue(mesh->node, renderQueue, views);
+				else if (PrefabComponent* prefab = world.get<PrefabComponent>(entity))
+					prefab->instance.enqueue(renderQueue, views);
+
+				//Expensive objects the camera may see are drawn depending on an occlusion query of their bounds
+				if ((views & (1u << RenderQueue::CameraView)) && world.has<OcclusionQueryComponent>(entity))
+					renderQueue.setCondition(first, occlusionQueries.request(index, dynamicIndex.fatBounds(world.get<SpatialComponent>(entity)->proxy), cameraPos));
+			},
+			[&](uint32_t entities) { renderQueue.reportCulled(culledViews, entities); });
+
+		//Render the scene to a depth map per cascade
 		glCullFace(GL_FRONT); //Enable front face culling for rendering the depth map to avoid Peter Panning shadows
+		glEnable(GL_DEPTH_CLAMP); //Casters between the light and its near plane are flattened onto it rather than clipped
 
-		int i = 0;
-		for (auto obj : scene)
+		simpleDepthShader.activate();
+		stats.shadowTriangles = 0;
+		for (uint32_t c = 0; c < shadowMap.cascadeCount() && !virtualShadows; c++)
 		{
-			if (i > 5 && moundBools[i - 6] == false)
-				i++;
-			else
+			//Render the static casters again only if the cascade moved or they changed, then draw the dynamic
+			//casters over a copy of them
+			if (shadowMap.staticStale(c))
 			{
-				simpleDepthShader.activate();
-				simpleDepthShader.setUniform("lightSpaceMatrix", lightSpace);
-				obj.render(simpleDepthShader, 0);
-				simpleDepthShader.disable();
-				i++;
+				shadowMap.bindStaticCache(c);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				simpleDepthShader.setUniform("lightSpaceMatrix", shadowMap.lightSpace(c));
+				renderQueue.submit(simpleDepthShader, DrawMode::ShadowCaster, staticShadowView + c);
+				stats.shadowTriangles += renderQueue.triangles();
+				stats.meshesDrawn += renderQueue.drawn();
+				stats.drawCalls += renderQueue.drawCalls();
+				stats.shadowCacheRefreshes++;
 			}
+			shadowMap.bindCascade(c);
+			simpleDepthShader.setUniform("lightSpaceMatrix", shadowMap.lightSpace(c));
+			renderQueue.submit(simpleDepthShader, DrawMode::ShadowCaster, RenderQueue::ShadowView + c);
+			stats.shadowTriangles += renderQueue.triangles();
+			stats.meshesDrawn += renderQueue.drawn();
+			stats.drawCalls += renderQueue.drawCalls();
 		}
+
+		//Render the virtual shadow map's pages that were requested but are missing or out of date
+		for (uint32_t page = 0; virtualShadowMap && page < virtualShadowMap->pagesToRender(); page++)
+		{
+			virtualShadowMap->bindPage(page);
+			simpleDepthShader.setUniform("lightSpaceMatrix", virtualShadowMap->pageSpace(page));
+			renderQueue.submit(simpleDepthShader, DrawMode::ShadowCaster, virtualShadowView);
+			stats.shadowTriangles += renderQueue.triangles();
+			stats.meshesDrawn += renderQueue.drawn();
+			stats.drawCalls += renderQueue.drawCalls();
+			stats.virtualPagesRendered++;
+		}
+		simpleDepthShader.disable();
 		
+		glDisable(GL_DEPTH_CLAMP);
 		glCullFace(GL_BACK);  //Re-enable backface culling
+
+		//Render the stale faces of the fire's shadows into the atlas in one pass
+		if (fireShadow.staleFaces())
+		{
+			pointShadowShader.activate();
+			fireShadow.begin(pointShadowShader);
+			renderQueue.submit(pointShadowShader, DrawMode::ShadowCaster, pointShadowView);
+			stats.shadowTriangles += renderQueue.triangles();
+			stats.meshesDrawn += renderQueue.drawn();
+			stats.drawCalls += renderQueue.drawCalls();
+			stats.pointShadowFaces = fireShadow.end();
+			pointShadowShader.disable();
+		}
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+		//Give every cluster of the camera's view the point lights reaching it
+		clusteredLights.update(camera, pointLights, JobSystem::shared());
+		stats.pointLights = clusteredLights.lightCount();
+		stats.clusterLightIndices = clusteredLights.indexCount();
+		stats.maxClusterLights = clusteredLights.maxClusterLights();
+
 		//Reset the viewport
 		glViewport(0, 0, width, height);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		//Set the lights, shadows and their textures on a shader lighting the scene, or unbind the textures again
+		auto bindLighting = [&](Shader& shader) {
+			shader.setUniform("view", camera);
+			shader.setUniform("viewPos", cameraPos);
+			shader.setUniform("dirLight.direction", -sun);
+			clusteredLights.setUniforms(shader, width, height);
+			clusteredLights.bind();
+			shadowMap.setUniforms(shader);
+			fireShadow.setUniforms(shader, "pointShadows", 0);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMap.texture());
+			glActiveTexture(GL_TEXTURE3);
+			glBindTexture(GL_TEXTURE_2D, shadowAtlas.texture());
+			if (virtualShadowMap)
+			{
+				virtualShadowMap->setUniforms(shader);
+				glActiveTexture(GL_TEXTURE0 + VirtualShadowMap::PageTableUnit);
+				glBindTexture(GL_TEXTURE_2D, virtualShadowMap->pageTableTexture());
+				glActiveTexture(GL_TEXTURE0 + VirtualShadowMap::PoolUnit);
+				glBindTexture(GL_TEXTURE_2D, virtualShadowMap->poolTexture());
+			}
+			glActiveTexture(GL_TEXTURE0);
+		};
+		auto unbindLighting = [&]() {
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+			glActiveTexture(GL_TEXTURE3);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glActiveTexture(GL_TEXTURE0 + VirtualShadowMap::PageTableUnit);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glActiveTexture(GL_TEXTURE0 + VirtualShadowMap::PoolUnit);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glActiveTexture(GL_TEXTURE0 + ClusteredLights::LightUnit);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+			glActiveTexture(GL_TEXTURE0 + ClusteredLights::ClusterUnit);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+			glActiveTexture(GL_TEXTURE0);
+		};
+
+		//Render scene objects with default shading, or only their surfaces into the G-buffer when deferred
+		shadedTimer.begin();
+		glm::mat4 viewProjection = perspective * camera;
+		Shader& surfaceShader = gBuffer ? gBufferShader : defaultShader;
+		if (gBuffer)
+			gBuffer->bind();
+
+		//Lay down the depth of the draws where shading hidden pixels would cost more than drawing them twice, so
+		//their shading only runs on the nearest surface. A shaded pixel costs the sun's and the fire's shadow taps and
+		//the lights of its cluster, or only its G-buffer writes when deferred
+		uint32_t prepassed = 0;
+		if (depthPrepass)
+		{
+			DepthPrepassCosts prepassCosts;
+			float lightsPerCluster = static_cast<float>(clusteredLights.indexCount()) / ClusteredLights::ClusterCount;
+			prepassCosts.shadedPixel = gBuffer ? 3.0f : 2.0f * shadowFilters[benchmarkFilter].taps + 4.0f * lightsPerCluster;
+			prepassed = renderQueue.selectDepthPrepass(RenderQueue::CameraView, viewProjection, width, height, prepassCosts);
+		}
+		stats.prepassDraws = prepassed;
+		if (prepassed > 0)
+		{
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			simpleDepthShader.activate();
+			simpleDepthShader.setUniform("lightSpaceMatrix", viewProjection);
+			renderQueue.submit(simpleDepthShader, DrawMode::DepthOnly, RenderQueue::CameraView, DrawSet::Unconditional, PrepassSet::Prepassed);
+			stats.meshesDrawn += renderQueue.drawn();
+			stats.drawCalls += renderQueue.drawCalls();
+			stats.prepassTriangles = renderQueue.triangles();
+
+			//The expensive objects' boxes are tested against the prepass's depth instead of the shaded draws'
+			occlusionQueries.issue(viewProjection);
+			simpleDepthShader.activate();
+			renderQueue.submit(simpleDepthShader, DrawMode::DepthOnly, RenderQueue::CameraView, DrawSet::Conditional, PrepassSet::Prepassed);
+			stats.meshesDrawn += renderQueue.drawn();
+			stats.drawCalls += renderQueue.drawCalls();
+			stats.prepassTriangles += renderQueue.triangles();
+			simpleDepthShader.disable();
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		}
 
-		i = 0;
-		for (auto& animator : animators)
+		surfaceShader.activate();
+		surfaceShader.setUniform("viewProjection", viewProjection);
+		if (!gBuffer)
+			bindLighting(defaultShader);
+		if (prepassed > 0)
 		{
-			if (moundBools[i] == false)
-				animator.tick(deltaTime);
-			i++;
+			//Every prepassed pixel already holds its nearest depth, so only that surface passes
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+			renderQueue.submit(surfaceShader, DrawMode::Shaded, RenderQueue::CameraView, DrawSet::All, PrepassSet::Prepassed);
+			stats.meshesDrawn += renderQueue.drawn();
+			stats.drawCalls += renderQueue.drawCalls();
+			glDepthMask(GL_TRUE);
+			glDepthFunc(GL_LESS);
 		}
+		renderQueue.submit(surfaceShader, DrawMode::Shaded, RenderQueue::CameraView, DrawSet::Unconditional, PrepassSet::Rest);
+		stats.meshesDrawn += renderQueue.drawn();
+		stats.drawCalls += renderQueue.drawCalls();
 
-		//Render scene objects with default shading
-		i = 0;
-		for (auto& obj : scene)
+		//Test the expensive objects' boxes against everything else, then draw them only where any of a box showed
+		if (prepassed == 0)
 		{
-			if (i > 5 && moundBools[i - 6] == false)
-				i++;
-			else
-			{
-				defaultShader.activate();
-				defaultShader.setUniform("view", camera);
-				defaultShader.setUniform("projection", perspective);
-				defaultShader.setUniform("viewPos", cameraPos);
-				defaultShader.setUniform("dirLight.direction", -sun);
-				defaultShader.setUniform("pointLights[0].position", glm::vec3(3.85, -2.57, -1.91));
-				defaultShader.setUniform("pointLights[0].linear", 0.7f);
-				defaultShader.setUniform("pointLights[0].quadratic", 1.8f);
-				defaultShader.setUniform("lightSpaceMatrix", lightSpace);
-				obj.render(defaultShader, shadowMapID);
-				defaultShader.disable();
-				i++;
-			}
+			occlusionQueries.issue(viewProjection);
+			surfaceShader.activate();
+		}
+		stats.occlusionQueries = occlusionQueries.issued();
+		stats.queryHidden = occlusionQueries.hidden();
+		renderQueue.submit(surfaceShader, DrawMode::Shaded, RenderQueue::CameraView, DrawSet::Conditional, PrepassSet::Rest);
+		stats.meshesDrawn += renderQueue.drawn();
+		stats.drawCalls += renderQueue.drawCalls();
+		if (!gBuffer)
+			unbindLighting();
+		surfaceShader.disable();
+		shadedTimer.end();
+		stats.shadedMs = shadedTimer.lastMs();
+
+		//Light every pixel of the G-buffer once, leaving its depth in the window's for the skybox
+		if (gBuffer)
+		{
+			lightingTimer.begin();
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, width, height);
+			defaultShader.activate();
+			bindLighting(defaultShader);
+			gBuffer->setUniforms(defaultShader, viewProjection);
+			gBuffer->bindTextures();
+			gBuffer->draw();
+			gBuffer->unbindTextures();
+			unbindLighting();
+			defaultShader.disable();
+			lightingTimer.end();
+			stats.lightingMs = lightingTimer.lastMs();
+		}
+
+		//Render which pages of the virtual shadow map the camera's pixels need, read back in a later frame. The
+		//expensive objects are drawn under this frame's occlusion queries, as in the shaded pass
+		if (virtualShadowMap)
+		{
+			virtualFeedbackShader.activate();
+			virtualShadowMap->beginFeedback(virtualFeedbackShader, perspective * camera);
+			renderQueue.submit(virtualFeedbackShader, DrawMode::DepthOnly, RenderQueue::CameraView);
+			virtualShadowMap->endFeedback();
+			virtualFeedbackShader.disable();
+			glViewport(0, 0, width, height);
+			stats.virtualPagesResident = virtualShadowMap->pageTable().residentPages();
+			stats.virtualPagesRequested = virtualShadowMap->pageTable().requestedPages();
 		}
 
 		//Render skybox last so fragments behind other objects are not rendered
@@ -439,6 +934,54 @@ int main(int argc, char* argv[])
 		////Set the depth function back to default
 		glDepthFunc(GL_LESS);
 
+		//Fence this frame's region of the stream buffer now that nothing else reads from it
+		streamBuffer.endFrame();
+		stats.bytesStreamed = streamBuffer.bytesStreamed();
+		stats.streamFrameSize = streamBuffer.frameSize();
+		stats.fenceWaitMs = streamBuffer.fenceWaitMs();
+		stats.visibleMeshes = renderQueue.visible(RenderQueue::CameraView);
+		stats.culledMeshes = renderQueue.culled(RenderQueue::CameraView);
+		stats.occludedMeshes = renderQueue.occluded(RenderQueue::CameraView);
+		renderQueue.visibleBounds(RenderQueue::CameraView, cameraDrawBounds);
+		stats.shadowCasters = 0;
+		stats.shadowCastersCulled = 0;
+		for (uint32_t c = 0; c < shadowMap.cascadeCount(); c++)
+		{
+			stats.shadowCasters += renderQueue.visible(RenderQueue::ShadowView + c) + renderQueue.visible(staticShadowView + c);
+			stats.shadowCastersCulled += renderQueue.culled(RenderQueue::ShadowView + c) + renderQueue.culled(staticShadowView + c);
+		}
+		stats.shadowCasters += renderQueue.visible(virtualShadowView);
+		stats.shadowCastersCulled += renderQueue.culled(virtualShadowView);
+		stats.shadowCacheInvalidations = shadowMap.invalidations();
+		stats.shadowAtlasUsage = shadowAtlas.usage();
+		for (uint32_t c = 0; c < shadowMap.cascadeCount() && !virtualShadows; c++)
+			stats.cascadeTexels += shadowMap.resolution(c) * shadowMap.resolution(c);
+
+		if (benchmarkShadowFilters && ++benchmarkFrame > benchmarkWarmupFrames)
+		{
+			benchmarkGpuMs += shadedTimer.lastMs() + (gBuffer ? lightingTimer.lastMs() : 0.0f);
+			benchmarkFrameMs += deltaTime * 1000.0;
+			if (benchmarkFrame == benchmarkFrames)
+			{
+				uint32_t measured = benchmarkFrames - benchmarkWarmupFrames;
+				std::cout << shadowFilters[benchmarkFilter].name() << ": " << benchmarkGpuMs / measured << " ms shaded pass, "
+					<< benchmarkFrameMs / measured << " ms frame" << std::endl;
+				benchmarkFrame = 0;
+				benchmarkGpuMs = benchmarkFrameMs = 0.0;
+				if (++benchmarkFilter == shadowFilters.size())
+					destroyed = true;
+				else
+					defaultShader = shadedShaders[benchmarkFilter];
+			}
+		}
+
+		statsTimer += deltaTime;
+		if (statsTimer >= 1.0f)
+		{
+			SDL_SetWindowTitle(window, ("Pirate Island | " + stats.summary()).c_str());
+			statsTimer = 0.0f;
+		}
+
 		//Update the window with OpenGL rendering by swapping the back buffer with the front buffer.
 		//The front buffer contains the final image to draw to the window while the back buffer renders everything.
 		SDL_GL_SwapWindow(window);